@@ -0,0 +1,734 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* Compiled form of a CalendarSpec.
+
+   find_next() in calendarspec.c normalizes and validates every candidate
+   with mktime(), so even a simple search results in many calls into the
+   time zone code of glibc. The compiled form replaces this with plain
+   calendar arithmetic on the bitmaps of the spec, and local time is
+   converted with a table of UTC offset transitions which gets probed
+   once at compile time.
+
+   The walk mirrors find_next() step by step, so the result is the same.
+   Whenever a step would depend on how mktime() resolves a non-existing
+   or ambiguous local time, or leaves the range covered by the transition
+   table, the fast path gives up with -EAGAIN and the caller falls back
+   to find_next(). */
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calendarspec.h"
+
+#define SEC_PER_DAY (24*60*60)
+
+/* Highest year a valid spec can name, see calendar_spec_valid() */
+#define YEAR_MAX 2199
+
+/* Years ahead of the current one covered by the transition table */
+#define TZ_TABLE_YEARS 30
+
+/* Sampling step while probing for offset changes. Two transitions which
+   cancel each other out inside one step are not detected, the tz
+   database has no such case. */
+#define TZ_PROBE_STEP (7*SEC_PER_DAY)
+
+/* A span of UTC time [begin, next begin) with a fixed UTC offset */
+typedef struct TzSegment {
+        int64_t begin;
+        int32_t offset;
+} TzSegment;
+
+struct CalendarCompiled {
+        int weekdays_bits;
+
+        /* Local time only: UTC range covered by the segments */
+        int64_t tz_begin;
+        int64_t tz_end;
+        size_t n_segments;
+        TzSegment segments[];
+};
+
+typedef struct Civil {
+        int year;
+        int mon;        /* 1..12 */
+        int mday;       /* 1..31 */
+        int hour;
+        int min;
+        int sec;
+} Civil;
+
+enum {
+        LOCAL_UNIQUE,
+        LOCAL_AMBIGUOUS,
+        LOCAL_GAP,
+        LOCAL_UNKNOWN,
+};
+
+void calendar_compiled_free(CalendarCompiled *c) {
+        free(c);
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static int64_t days_from_civil(int64_t y, int m, int d) {
+        int64_t era;
+        unsigned yoe, doy, doe;
+
+        y -= m <= 2;
+        era = (y >= 0 ? y : y - 399) / 400;
+        yoe = (unsigned) (y - era * 400);
+        doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+        return era * 146097 + (int64_t) doe - 719468;
+}
+
+static void civil_from_days(int64_t z, Civil *c) {
+        int64_t era, y;
+        unsigned doe, yoe, doy, mp;
+
+        z += 719468;
+        era = (z >= 0 ? z : z - 146096) / 146097;
+        doe = (unsigned) (z - era * 146097);
+        yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        y = (int64_t) yoe + era * 400;
+        doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        mp = (5 * doy + 2) / 153;
+
+        c->mday = doy - (153 * mp + 2) / 5 + 1;
+        c->mon = mp < 10 ? mp + 3 : mp - 9;
+        c->year = y + (c->mon <= 2);
+}
+
+static int64_t floor_div(int64_t a, int64_t b) {
+        return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static bool is_leap_year(int y) {
+        return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+static int days_in_month(int y, int m) {
+        static const int dim[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+        if (m == 2 && is_leap_year(y))
+                return 29;
+
+        return dim[m - 1];
+}
+
+/* Seconds since the epoch the fields describe, as timegm() would do it,
+   fields out of range are carried over */
+static int64_t civil_to_seconds(const Civil *c) {
+        int64_t y, m;
+
+        m = c->mon - 1;
+        y = c->year + floor_div(m, 12);
+        m -= floor_div(m, 12) * 12;
+
+        return (days_from_civil(y, m + 1, 1) + c->mday - 1) * SEC_PER_DAY +
+                (int64_t) c->hour * 3600 + (int64_t) c->min * 60 + c->sec;
+}
+
+static void civil_from_seconds(int64_t s, Civil *c) {
+        int64_t days, rem;
+
+        days = floor_div(s, SEC_PER_DAY);
+        rem = s - days * SEC_PER_DAY;
+
+        civil_from_days(days, c);
+        c->hour = rem / 3600;
+        c->min = rem / 60 % 60;
+        c->sec = rem % 60;
+}
+
+static bool civil_in_range(const Civil *c) {
+        return
+                c->mon >= 1 && c->mon <= 12 &&
+                c->mday >= 1 && c->mday <= days_in_month(c->year, c->mon) &&
+                c->hour >= 0 && c->hour <= 23 &&
+                c->min >= 0 && c->min <= 59 &&
+                c->sec >= 0 && c->sec <= 59;
+}
+
+/* 0 = Monday, like weekdays_bits */
+static int civil_weekday(const Civil *c) {
+        int64_t days = days_from_civil(c->year, c->mon, c->mday);
+
+        return (int) (days + 3 - floor_div(days + 3, 7) * 7);
+}
+
+static int64_t segment_end(const CalendarCompiled *cc, size_t i) {
+        return i + 1 < cc->n_segments ? cc->segments[i + 1].begin : cc->tz_end;
+}
+
+static int utc_to_local(const CalendarCompiled *cc, int64_t t, int64_t *ret) {
+        size_t lo = 0, hi = cc->n_segments;
+
+        /* Stay a day away from the borders, a transition just outside of
+           the table would not be known */
+        if (t < cc->tz_begin + SEC_PER_DAY || t >= cc->tz_end - SEC_PER_DAY)
+                return -EAGAIN;
+
+        while (hi - lo > 1) {
+                size_t mid = (lo + hi) / 2;
+
+                if (cc->segments[mid].begin <= t)
+                        lo = mid;
+                else
+                        hi = mid;
+        }
+
+        *ret = t + cc->segments[lo].offset;
+        return 0;
+}
+
+/* Find the UTC time of a local time. Segments are at least a day long
+   and offsets differ by less than a day, so the local end of the
+   segments is increasing and at most two segments can match. */
+static int local_to_utc(const CalendarCompiled *cc, int64_t l, int64_t *ret) {
+        size_t lo = 0, hi = cc->n_segments, i;
+        int n = 0;
+
+        if (l < cc->tz_begin + 2 * SEC_PER_DAY || l >= cc->tz_end - 2 * SEC_PER_DAY)
+                return LOCAL_UNKNOWN;
+
+        /* First segment whose local end is behind l */
+        while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+
+                if (segment_end(cc, mid) + cc->segments[mid].offset > l)
+                        hi = mid;
+                else
+                        lo = mid + 1;
+        }
+
+        for (i = lo; i < cc->n_segments && i <= lo + 1; i++) {
+                int64_t t = l - cc->segments[i].offset;
+
+                if (t >= cc->segments[i].begin && t < segment_end(cc, i)) {
+                        if (n++ == 0)
+                                *ret = t;
+                }
+        }
+
+        if (n == 0)
+                return LOCAL_GAP;
+
+        return n == 1 ? LOCAL_UNIQUE : LOCAL_AMBIGUOUS;
+}
+
+/* What mktime() does with the fields at the begin of every round */
+static int normalize(const CalendarSpec *spec, Civil *c) {
+        int64_t l = civil_to_seconds(c), t;
+
+        if (!spec->utc) {
+                int r = local_to_utc(spec->compiled, l, &t);
+
+                /* mktime() would move the time out of the gap depending
+                   on its internal state */
+                if (r == LOCAL_GAP || r == LOCAL_UNKNOWN)
+                        return -EAGAIN;
+        }
+
+        civil_from_seconds(l, c);
+
+        if (c->year > YEAR_MAX + 1)
+                return -EAGAIN;
+
+        return 0;
+}
+
+/* Same as tm_out_of_bounds() */
+static int out_of_bounds(const CalendarSpec *spec, const Civil *c) {
+        int64_t t;
+
+        if (!civil_in_range(c))
+                return 1;
+
+        if (spec->utc)
+                return 0;
+
+        switch (local_to_utc(spec->compiled, civil_to_seconds(c), &t)) {
+        case LOCAL_UNIQUE:
+        case LOCAL_AMBIGUOUS:
+                return 0;
+        case LOCAL_GAP:
+                return 1;
+        default:
+                return -EAGAIN;
+        }
+}
+
+int calendar_compiled_next_usec(const CalendarSpec *spec, usec_t usec, usec_t *next) {
+        const CalendarCompiled *cc;
+        Civil c;
+        int64_t start, l, t;
+        int r;
+
+        assert(spec);
+        assert(next);
+
+        cc = spec->compiled;
+        if (!cc)
+                return -EAGAIN;
+
+        start = (int64_t) (usec / USEC_PER_SEC) + 1;
+        if (spec->utc)
+                l = start;
+        else {
+                r = utc_to_local(cc, start, &l);
+                if (r < 0)
+                        return r;
+        }
+        civil_from_seconds(l, &c);
+
+        for (;;) {
+                r = normalize(spec, &c);
+                if (r < 0)
+                        return r;
+
+                r = calendar_spec_next_year(spec, &c.year);
+                if (r > 0) {
+                        c.mon = 1;
+                        c.mday = 1;
+                        c.hour = c.min = c.sec = 0;
+                }
+                if (r < 0)
+                        return r;
+                r = out_of_bounds(spec, &c);
+                if (r < 0)
+                        return r;
+                if (r > 0) {
+                        /* find_next() gives up here without touching
+                           the start time */
+                        *next = (usec_t) start * USEC_PER_SEC;
+                        return 0;
+                }
+
+                r = calendar_field_next(&spec->month, &c.mon);
+                if (r > 0) {
+                        c.mday = 1;
+                        c.hour = c.min = c.sec = 0;
+                }
+                if (r >= 0)
+                        r = out_of_bounds(spec, &c);
+                if (r == -EAGAIN)
+                        return r;
+                if (r != 0) {
+                        c.year++;
+                        c.mon = 1;
+                        c.mday = 1;
+                        c.hour = c.min = c.sec = 0;
+                        continue;
+                }
+
+                r = calendar_field_next(&spec->day, &c.mday);
+                if (r > 0)
+                        c.hour = c.min = c.sec = 0;
+                if (r >= 0)
+                        r = out_of_bounds(spec, &c);
+                if (r == -EAGAIN)
+                        return r;
+                if (r != 0) {
+                        c.mon++;
+                        c.mday = 1;
+                        c.hour = c.min = c.sec = 0;
+                        continue;
+                }
+
+                if (!(cc->weekdays_bits & (1 << civil_weekday(&c)))) {
+                        c.mday++;
+                        c.hour = c.min = c.sec = 0;
+                        continue;
+                }
+
+                r = calendar_field_next(&spec->hour, &c.hour);
+                if (r > 0)
+                        c.min = c.sec = 0;
+                if (r >= 0)
+                        r = out_of_bounds(spec, &c);
+                if (r == -EAGAIN)
+                        return r;
+                if (r != 0) {
+                        c.mday++;
+                        c.hour = c.min = c.sec = 0;
+                        continue;
+                }
+
+                r = calendar_field_next(&spec->minute, &c.min);
+                if (r > 0)
+                        c.sec = 0;
+                if (r >= 0)
+                        r = out_of_bounds(spec, &c);
+                if (r == -EAGAIN)
+                        return r;
+                if (r != 0) {
+                        c.hour++;
+                        c.min = c.sec = 0;
+                        continue;
+                }
+
+                r = calendar_field_next(&spec->second, &c.sec);
+                if (r >= 0)
+                        r = out_of_bounds(spec, &c);
+                if (r == -EAGAIN)
+                        return r;
+                if (r != 0) {
+                        c.min++;
+                        c.sec = 0;
+                        continue;
+                }
+
+                break;
+        }
+
+        l = civil_to_seconds(&c);
+        if (spec->utc)
+                t = l;
+        else if (local_to_utc(cc, l, &t) != LOCAL_UNIQUE)
+                /* Which one mktime() picks depends on its state */
+                return -EAGAIN;
+
+        *next = (usec_t) t * USEC_PER_SEC;
+        return 0;
+}
+
+/* Counterparts of calendar_field_next() and calendar_spec_next_year()
+   for searching backwards */
+static int field_prev(const CalendarField *f, int *val) {
+        uint64_t m;
+        int d;
+
+        if (*val < 0)
+                return -ENOENT;
+
+        m = *val >= 63 ? f->bits : f->bits & (UINT64_MAX >> (63 - *val));
+        if (m == 0)
+                return -ENOENT;
+
+        d = 63 - __builtin_clzll(m);
+        if (d == *val)
+                return 0;
+
+        *val = d;
+        return 1;
+}
+
+static int year_prev(const CalendarSpec *spec, int *val) {
+        int d = -1;
+        bool d_set = false;
+        size_t i;
+
+        if (spec->n_years == 0)
+                return 0;
+
+        for (i = 0; i < spec->n_years; i++) {
+                const CalendarComponent *c = spec->year + i;
+                int k;
+
+                if (c->value > *val)
+                        continue;
+
+                k = c->repeat > 0 ? c->value + c->repeat * ((*val - c->value) / c->repeat) : c->value;
+                if (!d_set || k > d) {
+                        d = k;
+                        d_set = true;
+                }
+        }
+
+        if (!d_set)
+                return -ENOENT;
+
+        if (d == *val)
+                return 0;
+
+        *val = d;
+        return 1;
+}
+
+/* Whether the UTC offset changes somewhere in (from, to]. When the clock
+   is set back local time is not monotonic, and find_next() skips over
+   gaps in its own way, a backward search in local time could disagree
+   with both. */
+static bool has_transition(const CalendarCompiled *cc, int64_t from, int64_t to) {
+        size_t i;
+
+        for (i = 1; i < cc->n_segments; i++)
+                if (cc->segments[i].begin > from && cc->segments[i].begin <= to &&
+                    cc->segments[i].offset != cc->segments[i - 1].offset)
+                        return true;
+
+        return false;
+}
+
+/* Move to the last second before the current time */
+static void step_back(Civil *c) {
+        civil_from_seconds(civil_to_seconds(c) - 1, c);
+}
+
+int calendar_compiled_prev_usec(const CalendarSpec *spec, usec_t usec, usec_t since, usec_t *prev) {
+        const CalendarCompiled *cc;
+        Civil c;
+        int64_t last, l, t;
+        int r;
+
+        assert(spec);
+        assert(prev);
+
+        cc = spec->compiled;
+        if (!cc)
+                return -EAGAIN;
+
+        if (usec <= since)
+                return -ENOENT;
+
+        /* The last full second before usec */
+        last = (int64_t) ((usec + USEC_PER_SEC - 1) / USEC_PER_SEC) - 1;
+        if (spec->utc)
+                l = last;
+        else {
+                r = utc_to_local(cc, last, &l);
+                if (r < 0)
+                        return r;
+
+                if (has_transition(cc, (int64_t) (since / USEC_PER_SEC) - SEC_PER_DAY, last))
+                        return -EAGAIN;
+        }
+        civil_from_seconds(l, &c);
+
+        for (;;) {
+                /* Offsets are less than a day, local times further
+                   back are before since in any case */
+                if (civil_to_seconds(&c) + SEC_PER_DAY <= (int64_t) (since / USEC_PER_SEC) ||
+                    c.year < 1970)
+                        return -ENOENT;
+
+                r = year_prev(spec, &c.year);
+                if (r < 0)
+                        return -ENOENT;
+                if (r > 0) {
+                        c.mon = 12;
+                        c.mday = 31;
+                        c.hour = 23;
+                        c.min = c.sec = 59;
+                        continue;
+                }
+
+                r = field_prev(&spec->month, &c.mon);
+                if (r < 0) {
+                        c.mon = 1;
+                        c.mday = 1;
+                        c.hour = c.min = c.sec = 0;
+                        step_back(&c);
+                        continue;
+                }
+                if (r > 0) {
+                        c.mday = days_in_month(c.year, c.mon);
+                        c.hour = 23;
+                        c.min = c.sec = 59;
+                }
+
+                r = field_prev(&spec->day, &c.mday);
+                if (r < 0) {
+                        c.mday = 1;
+                        c.hour = c.min = c.sec = 0;
+                        step_back(&c);
+                        continue;
+                }
+                if (r > 0) {
+                        c.hour = 23;
+                        c.min = c.sec = 59;
+                }
+
+                if (!(cc->weekdays_bits & (1 << civil_weekday(&c)))) {
+                        c.hour = c.min = c.sec = 0;
+                        step_back(&c);
+                        continue;
+                }
+
+                r = field_prev(&spec->hour, &c.hour);
+                if (r < 0) {
+                        c.hour = c.min = c.sec = 0;
+                        step_back(&c);
+                        continue;
+                }
+                if (r > 0)
+                        c.min = c.sec = 59;
+
+                r = field_prev(&spec->minute, &c.min);
+                if (r < 0) {
+                        c.min = c.sec = 0;
+                        step_back(&c);
+                        continue;
+                }
+                if (r > 0)
+                        c.sec = 59;
+
+                r = field_prev(&spec->second, &c.sec);
+                if (r < 0) {
+                        c.sec = 0;
+                        step_back(&c);
+                        continue;
+                }
+
+                l = civil_to_seconds(&c);
+                if (spec->utc) {
+                        t = l;
+                        break;
+                }
+
+                r = local_to_utc(cc, l, &t);
+                if (r == LOCAL_UNIQUE)
+                        break;
+                if (r != LOCAL_GAP)
+                        /* Which one find_next() would report depends
+                           on mktime() */
+                        return -EAGAIN;
+
+                /* Skipped by the clock change, like find_next() does */
+                step_back(&c);
+        }
+
+        if (t > last)
+                return -EAGAIN;
+        if ((usec_t) t * USEC_PER_SEC <= since)
+                return -ENOENT;
+
+        *prev = (usec_t) t * USEC_PER_SEC;
+        return 0;
+}
+
+static int32_t probe_offset(const TzInfo *tz, int64_t t) {
+        time_t tt = (time_t) t;
+        struct tm tm;
+
+        if (tz)
+                return tz_info_offset(tz, t);
+
+        if (!localtime_r(&tt, &tm))
+                return 0;
+
+        return (int32_t) tm.tm_gmtoff;
+}
+
+static int append_segment(TzSegment **segments, size_t *n, size_t *allocated,
+                          int64_t begin, int32_t offset) {
+        if (*n >= *allocated) {
+                size_t k = *allocated ? *allocated * 2 : 64;
+                TzSegment *p;
+
+                p = realloc(*segments, k * sizeof(TzSegment));
+                if (!p)
+                        return -ENOMEM;
+
+                *segments = p;
+                *allocated = k;
+        }
+
+        (*segments)[(*n)++] = (TzSegment) { begin, offset };
+        return 0;
+}
+
+/* Sample the offset of the zone, NULL for the local one, and search the
+   exact second of every change */
+static int probe_segments(const TzInfo *tz, int64_t begin, int64_t end, TzSegment **ret, size_t *ret_n) {
+        TzSegment *segments = NULL;
+        size_t n = 0, allocated = 0;
+        int64_t sample = begin;
+        int32_t offset;
+        int r;
+
+        offset = probe_offset(tz, begin);
+        r = append_segment(&segments, &n, &allocated, begin, offset);
+        if (r < 0)
+                goto fail;
+
+        while (sample < end) {
+                int64_t next = sample + TZ_PROBE_STEP < end ? sample + TZ_PROBE_STEP : end;
+
+                /* probe_offset(sample) == offset, every change in
+                   between gets bisected */
+                while (probe_offset(tz, next) != offset) {
+                        int64_t lo = sample, hi = next;
+
+                        while (hi - lo > 1) {
+                                int64_t mid = lo + (hi - lo) / 2;
+
+                                if (probe_offset(tz, mid) == offset)
+                                        lo = mid;
+                                else
+                                        hi = mid;
+                        }
+
+                        sample = hi;
+                        offset = probe_offset(tz, hi);
+                        r = append_segment(&segments, &n, &allocated, hi, offset);
+                        if (r < 0)
+                                goto fail;
+                }
+
+                sample = next;
+        }
+
+        *ret = segments;
+        *ret_n = n;
+        return 0;
+
+fail:
+        free(segments);
+        return r;
+}
+
+int calendar_spec_compile(CalendarSpec *spec) {
+        TzSegment *segments = NULL;
+        CalendarCompiled *cc;
+        size_t n = 0;
+        int64_t begin = 0, end = 0;
+        int r;
+
+        assert(spec);
+
+        if (!spec->utc) {
+                Civil today;
+
+                /* A zone of its own needs no global state */
+                if (!spec->tz)
+                        tzset();
+
+                civil_from_seconds((int64_t) (now(CLOCK_REALTIME) / USEC_PER_SEC), &today);
+                begin = days_from_civil(today.year - 1, 1, 1) * SEC_PER_DAY;
+                end = days_from_civil(today.year + TZ_TABLE_YEARS + 1, 1, 1) * SEC_PER_DAY;
+
+                r = probe_segments(spec->tz, begin, end, &segments, &n);
+                if (r < 0)
+                        return r;
+        }
+
+        cc = malloc(offsetof(CalendarCompiled, segments) + n * sizeof(TzSegment));
+        if (!cc) {
+                free(segments);
+                return -ENOMEM;
+        }
+
+        *cc = (CalendarCompiled) {
+                .weekdays_bits = spec->weekdays_bits < 0 || spec->weekdays_bits >= 127 ? 127 : spec->weekdays_bits,
+                .tz_begin = begin,
+                .tz_end = end,
+                .n_segments = n,
+        };
+        if (n > 0)
+                memcpy(cc->segments, segments, n * sizeof(TzSegment));
+        free(segments);
+
+        calendar_compiled_free(spec->compiled);
+        spec->compiled = cc;
+
+        return 0;
+}
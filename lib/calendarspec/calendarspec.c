@@ -21,6 +21,8 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -91,96 +93,70 @@ static const char* endswith_no_case(const char *s, const char *postfix) {
 
 #define BITS_WEEKDAYS   127
 
-static void free_chain(CalendarComponent *c) {
-        CalendarComponent *n;
-
-        while (c) {
-                n = c->next;
-                free(c);
-                c = n;
-        }
-}
+/* Bits from..to of a CalendarField */
+#define FIELD_MASK(from, to) ((UINT64_MAX >> (63 - (to))) & (UINT64_MAX << (from)))
 
 void calendar_spec_free(CalendarSpec *c) {
 
         if (!c)
                 return;
 
-        free_chain(c->year);
-        free_chain(c->month);
-        free_chain(c->day);
-        free_chain(c->hour);
-        free_chain(c->minute);
-        free_chain(c->second);
+        calendar_compiled_free(c->compiled);
+        tz_info_free(c->tz);
 
         free(c);
 }
 
 static int component_compare(const void *_a, const void *_b) {
-        CalendarComponent * const *a = _a, * const *b = _b;
+        const CalendarComponent *a = _a, *b = _b;
 
-        if ((*a)->value < (*b)->value)
+        if (a->value < b->value)
                 return -1;
-        if ((*a)->value > (*b)->value)
+        if (a->value > b->value)
                 return 1;
 
-        if ((*a)->repeat < (*b)->repeat)
+        if (a->repeat < b->repeat)
                 return -1;
-        if ((*a)->repeat > (*b)->repeat)
+        if (a->repeat > b->repeat)
                 return 1;
 
         return 0;
 }
 
-static void sort_chain(CalendarComponent **c) {
-        unsigned n = 0, k;
-        CalendarComponent **b, *i, **j, *next;
+static void sort_years(CalendarSpec *c) {
+        size_t i, n = 0;
 
         assert(c);
 
-        for (i = *c; i; i = i->next)
-                n++;
-
-        if (n <= 1)
+        if (c->n_years <= 1)
                 return;
 
-        j = b = alloca(sizeof(CalendarComponent*) * n);
-        for (i = *c; i; i = i->next)
-                *(j++) = i;
-
-        qsort(b, n, sizeof(CalendarComponent*), component_compare);
-
-        b[n-1]->next = NULL;
-        next = b[n-1];
+        qsort(c->year, c->n_years, sizeof(CalendarComponent), component_compare);
 
         /* Drop non-unique entries */
-        for (k = n-1; k > 0; k--) {
-                if (b[k-1]->value == next->value &&
-                    b[k-1]->repeat == next->repeat) {
-                        free(b[k-1]);
+        for (i = 1; i < c->n_years; i++) {
+                if (c->year[i].value == c->year[n].value &&
+                    c->year[i].repeat == c->year[n].repeat)
                         continue;
-                }
 
-                b[k-1]->next = next;
-                next = b[k-1];
+                c->year[++n] = c->year[i];
         }
 
-        *c = next;
+        c->n_years = n + 1;
 }
 
-static void fix_year(CalendarComponent *c) {
+static void fix_year(CalendarSpec *c) {
         /* Turns 12 → 2012, 89 → 1989 */
+        size_t i;
 
-        while(c) {
-                CalendarComponent *n = c->next;
-
-                if (c->value >= 0 && c->value < 70)
-                        c->value += 2000;
+        for (i = 0; i < c->n_years; i++) {
+                CalendarComponent *y = c->year + i;
 
-                if (c->value >= 70 && c->value < 100)
-                        c->value += 1900;
+                if (y->value >= 0 && y->value < 70)
+                        y->value += 2000;
 
-                c = n;
+                if (y->value >= 70 && y->value < 100)
+                        y->value += 1900;
         }
 }
 
@@ -190,61 +166,140 @@ int calendar_spec_normalize(CalendarSpec *c) {
         if (c->weekdays_bits <= 0 || c->weekdays_bits >= BITS_WEEKDAYS)
                 c->weekdays_bits = -1;
 
-        fix_year(c->year);
-
-        sort_chain(&c->year);
-        sort_chain(&c->month);
-        sort_chain(&c->day);
-        sort_chain(&c->hour);
-        sort_chain(&c->minute);
-        sort_chain(&c->second);
+        fix_year(c);
+        sort_years(c);
 
         return 0;
 }
 
-_pure_ static bool chain_valid(CalendarComponent *c, int from, int to) {
-        if (!c)
-                return true;
-
-        if (c->value < from || c->value > to)
-                return false;
+_pure_ static bool field_valid(const CalendarField *f, int from, int to) {
+        uint64_t mask = FIELD_MASK(from, to);
 
-        if (c->value + c->repeat > to)
+        /* An empty field would never match */
+        if (f->bits == 0 || (f->bits & ~mask) != 0)
                 return false;
 
-        if (c->next)
-                return chain_valid(c->next, from, to);
-
-        return true;
+        return (f->repeat & ~f->bits) == 0;
 }
 
 _pure_ bool calendar_spec_valid(CalendarSpec *c) {
+        size_t i;
+
         assert(c);
 
         if (c->weekdays_bits > BITS_WEEKDAYS)
                 return false;
 
-        if (!chain_valid(c->year, 1970, 2199))
-                return false;
+        for (i = 0; i < c->n_years; i++)
+                if (c->year[i].value < 1970 || c->year[i].value > 2199 ||
+                    c->year[i].repeat > 2199 - c->year[i].value)
+                        return false;
 
-        if (!chain_valid(c->month, 1, 12))
+        if (!field_valid(&c->month, 1, 12))
                 return false;
 
-        if (!chain_valid(c->day, 1, 31))
+        if (!field_valid(&c->day, 1, 31))
                 return false;
 
-        if (!chain_valid(c->hour, 0, 23))
+        if (!field_valid(&c->hour, 0, 23))
                 return false;
 
-        if (!chain_valid(c->minute, 0, 59))
+        if (!field_valid(&c->minute, 0, 59))
                 return false;
 
-        if (!chain_valid(c->second, 0, 59))
+        if (!field_valid(&c->second, 0, 59))
                 return false;
 
         return true;
 }
 
+static bool is_leap_year(int y) {
+        return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+static int days_in_month(int y, int m) {
+        static const int dim[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+        if (m == 2 && is_leap_year(y))
+                return 29;
+
+        return dim[m - 1];
+}
+
+/* 0 = Monday, like weekdays_bits */
+static int weekday(int y, int m, int d) {
+        static const int t[] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+
+        y -= m < 3;
+        return (y + y / 4 - y / 100 + y / 400 + t[m - 1] + d + 6) % 7;
+}
+
+static bool year_can_match(const CalendarSpec *c, int year) {
+        int m, d;
+
+        for (m = 1; m <= 12; m++) {
+                uint64_t days;
+
+                if (!(c->month.bits & (UINT64_C(1) << m)))
+                        continue;
+
+                days = c->day.bits & FIELD_MASK(1, days_in_month(year, m));
+                if (days == 0)
+                        continue;
+
+                if (c->weekdays_bits < 0 || c->weekdays_bits >= BITS_WEEKDAYS)
+                        return true;
+
+                for (d = 1; d <= 31; d++)
+                        if ((days & (UINT64_C(1) << d)) &&
+                            (c->weekdays_bits & (1 << weekday(year, m, d))))
+                                return true;
+        }
+
+        return false;
+}
+
+static int gcd(int a, int b) {
+        while (b != 0) {
+                int t = a % b;
+
+                a = b;
+                b = t;
+        }
+
+        return a;
+}
+
+/* The Gregorian calendar repeats every 400 years, so looking at 400
+   years, or at 400 repetitions of a year at most, is enough to know if
+   the date part ever matches. Whether the time exists in the time zone
+   is not checked. */
+_pure_ bool calendar_spec_can_match(const CalendarSpec *c) {
+        size_t i;
+        int k;
+
+        assert(c);
+
+        if (c->n_years == 0) {
+                for (k = 2000; k < 2400; k++)
+                        if (year_can_match(c, k))
+                                return true;
+
+                return false;
+        }
+
+        for (i = 0; i < c->n_years; i++) {
+                const CalendarComponent *y = c->year + i;
+                int steps = y->repeat > 0 ? 400 / gcd(y->repeat, 400) : 1;
+
+                for (k = 0; k < steps; k++)
+                        if (year_can_match(c, y->value + k * y->repeat))
+                                return true;
+        }
+
+        return false;
+}
+
 static void format_weekdays(FILE *f, const CalendarSpec *c) {
         static const char *const days[] = {
                 "Mon",
@@ -294,23 +349,86 @@ static void format_weekdays(FILE *f, const CalendarSpec *c) {
         }
 }
 
-static void format_chain(FILE *f, int space, const CalendarComponent *c) {
+static void format_years(FILE *f, const CalendarSpec *c) {
+        size_t i;
+
         assert(f);
 
-        if (!c) {
+        if (c->n_years == 0) {
                 fputc('*', f);
                 return;
         }
 
-        assert(c->value >= 0);
-        fprintf(f, "%0*i", space, c->value);
+        for (i = 0; i < c->n_years; i++) {
+                if (i > 0)
+                        fputc(',', f);
+
+                assert(c->year[i].value >= 0);
+                fprintf(f, "%04i", c->year[i].value);
+
+                if (c->year[i].repeat > 0)
+                        fprintf(f, "/%i", c->year[i].repeat);
+        }
+}
+
+/* The smallest repeat for which v and all following steps up to the
+   end of the field match, 0 if there is none */
+static int field_repeat(const CalendarField *c, int v, int to) {
+        int r, k;
+
+        for (r = 1; v + r <= to; r++) {
+                for (k = v + r; k <= to; k += r)
+                        if (!(c->bits & (UINT64_C(1) << k)))
+                                break;
+
+                if (k > to)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void format_field(FILE *f, int space, const CalendarField *c, int from, int to) {
+        uint64_t done = 0;
+        bool first = true;
+        int v, k;
+
+        assert(f);
+
+        if (c->bits == FIELD_MASK(from, to) && c->repeat == 0) {
+                fputc('*', f);
+                return;
+        }
+
+        for (v = from; v <= to; v++) {
+                uint64_t b = UINT64_C(1) << v, m = b;
+                int r = 0;
+
+                if (!(c->bits & b))
+                        continue;
+
+                if (c->repeat & b)
+                        r = field_repeat(c, v, to);
+
+                if (r > 0)
+                        for (k = v + r; k <= to; k += r)
+                                m |= UINT64_C(1) << k;
+
+                /* Already part of an earlier repetition, as a single
+                   value or with all of its steps */
+                if ((done & m) == m)
+                        continue;
+
+                if (!first)
+                        fputc(',', f);
+                first = false;
 
-        if (c->repeat > 0)
-                fprintf(f, "/%i", c->repeat);
+                fprintf(f, "%0*i", space, v);
 
-        if (c->next) {
-                fputc(',', f);
-                format_chain(f, space, c->next);
+                if (r > 0)
+                        fprintf(f, "/%i", r);
+
+                done |= m;
         }
 }
 
@@ -332,20 +450,24 @@ int calendar_spec_to_string(const CalendarSpec *c, char **p) {
                 fputc(' ', f);
         }
 
-        format_chain(f, 4, c->year);
+        format_years(f, c);
         fputc('-', f);
-        format_chain(f, 2, c->month);
+        format_field(f, 2, &c->month, 1, 12);
         fputc('-', f);
-        format_chain(f, 2, c->day);
+        format_field(f, 2, &c->day, 1, 31);
         fputc(' ', f);
-        format_chain(f, 2, c->hour);
+        format_field(f, 2, &c->hour, 0, 23);
         fputc(':', f);
-        format_chain(f, 2, c->minute);
+        format_field(f, 2, &c->minute, 0, 59);
         fputc(':', f);
-        format_chain(f, 2, c->second);
+        format_field(f, 2, &c->second, 0, 59);
 
         if (c->utc)
                 fputs(" UTC", f);
+        else if (c->tz) {
+                fputc(' ', f);
+                fputs(tz_info_name(c->tz), f);
+        }
 
         r = fflush_and_check(f);
         if (r < 0) {
@@ -453,13 +575,21 @@ static int parse_weekdays(const char **p, CalendarSpec *c) {
         }
 }
 
-static int prepend_component(const char **p, CalendarComponent **c) {
+/* Components of one field while parsing. Whether the first part of a
+   date is the year or the month is only known once the rest has been
+   parsed, so they are collected first and then stored into the spec. An
+   empty list stands for "*". */
+typedef struct ComponentList {
+        CalendarComponent *items;
+        size_t n, allocated;
+} ComponentList;
+
+static int append_component(const char **p, ComponentList *l) {
         unsigned long value, repeat = 0;
         char *e = NULL, *ee = NULL;
-        CalendarComponent *cc;
 
         assert(p);
-        assert(c);
+        assert(l);
 
         errno = 0;
         value = strtoul(*p, &e, 10);
@@ -487,74 +617,121 @@ static int prepend_component(const char **p, CalendarComponent **c) {
         if (*e != 0 && *e != ' ' && *e != ',' && *e != '-' && *e != ':')
                 return -EINVAL;
 
-        cc = new0(CalendarComponent, 1);
-        if (!cc)
-                return -ENOMEM;
+        if (l->n >= l->allocated) {
+                size_t k = l->allocated > 0 ? l->allocated * 2 : 8;
+                CalendarComponent *n;
+
+                n = realloc(l->items, k * sizeof(CalendarComponent));
+                if (!n)
+                        return -ENOMEM;
 
-        cc->value = value;
-        cc->repeat = repeat;
-        cc->next = *c;
+                l->items = n;
+                l->allocated = k;
+        }
+
+        l->items[l->n++] = (CalendarComponent) {
+                .value = value,
+                .repeat = repeat,
+        };
 
         *p = e;
-        *c = cc;
 
         if (*e ==',') {
                 *p += 1;
-                return prepend_component(p, c);
+                return append_component(p, l);
         }
 
         return 0;
 }
 
-static int parse_chain(const char **p, CalendarComponent **c) {
+static int parse_chain(const char **p, ComponentList *l) {
         const char *t;
-        CalendarComponent *cc = NULL;
         int r;
 
         assert(p);
-        assert(c);
+        assert(l);
 
         t = *p;
 
         if (t[0] == '*') {
                 *p = t + 1;
-                *c = NULL;
                 return 0;
         }
 
-        r = prepend_component(&t, &cc);
-        if (r < 0) {
-                free_chain(cc);
+        r = append_component(&t, l);
+        if (r < 0)
                 return r;
-        }
 
         *p = t;
-        *c = cc;
         return 0;
 }
 
-static int const_chain(int value, CalendarComponent **c) {
-        CalendarComponent *cc = NULL;
+static void const_field(int value, CalendarField *f) {
+        assert(f);
+
+        f->bits |= UINT64_C(1) << value;
+}
+
+static int set_field(CalendarField *f, const ComponentList *l, int from, int to) {
+        size_t i;
+
+        assert(f);
+        assert(l);
+
+        for (i = 0; i < l->n; i++) {
+                const CalendarComponent *cc = l->items + i;
+                int v;
+
+                if (cc->value < from || cc->value > to || cc->repeat > to - cc->value)
+                        return -EINVAL;
+
+                for (v = cc->value; v <= to; v += cc->repeat) {
+                        f->bits |= UINT64_C(1) << v;
+
+                        if (cc->repeat <= 0)
+                                break;
+                }
+
+                if (cc->repeat > 0)
+                        f->repeat |= UINT64_C(1) << cc->value;
+        }
+
+        return 0;
+}
+
+/* The years are stored behind the spec, which hence might move */
+static int set_years(CalendarSpec **c, const ComponentList *l) {
+        CalendarSpec *n;
 
         assert(c);
+        assert(*c);
+        assert(l);
 
-        cc = new0(CalendarComponent, 1);
-        if (!cc)
-                return -ENOMEM;
+        if (l->n == 0)
+                return 0;
 
-        cc->value = value;
-        cc->repeat = 0;
-        cc->next = *c;
+        n = realloc(*c, offsetof(CalendarSpec, year) + l->n * sizeof(CalendarComponent));
+        if (!n)
+                return -ENOMEM;
 
-        *c = cc;
+        memcpy(n->year, l->items, l->n * sizeof(CalendarComponent));
+        n->n_years = l->n;
 
+        *c = n;
         return 0;
 }
 
-static int parse_date(const char **p, CalendarSpec *c) {
+static void wildcard_field(CalendarField *f, int from, int to) {
+        assert(f);
+
+        if (f->bits == 0)
+                f->bits = FIELD_MASK(from, to);
+}
+
+static int parse_date(const char **p, CalendarSpec **c) {
+        ComponentList first = {}, second = {}, third = {};
         const char *t;
         int r;
-        CalendarComponent *first, *second, *third;
 
         assert(p);
         assert(*p);
@@ -567,65 +744,65 @@ static int parse_date(const char **p, CalendarSpec *c) {
 
         r = parse_chain(&t, &first);
         if (r < 0)
-                return r;
+                goto finish;
 
         /* Already the end? A ':' as separator? In that case this was a time, not a date */
         if (*t == 0 || *t == ':') {
-                free_chain(first);
-                return 0;
+                r = 0;
+                goto finish;
         }
 
         if (*t != '-') {
-                free_chain(first);
-                return -EINVAL;
+                r = -EINVAL;
+                goto finish;
         }
 
         t++;
         r = parse_chain(&t, &second);
-        if (r < 0) {
-                free_chain(first);
-                return r;
-        }
+        if (r < 0)
+                goto finish;
 
         /* Got two parts, hence it's month and day */
         if (*t == ' ' || *t == 0) {
                 *p = t + strspn(t, " ");
-                c->month = first;
-                c->day = second;
-                return 0;
+                r = set_field(&(*c)->month, &first, 1, 12);
+                if (r >= 0)
+                        r = set_field(&(*c)->day, &second, 1, 31);
+                goto finish;
         }
 
         if (*t != '-') {
-                free_chain(first);
-                free_chain(second);
-                return -EINVAL;
+                r = -EINVAL;
+                goto finish;
         }
 
         t++;
         r = parse_chain(&t, &third);
-        if (r < 0) {
-                free_chain(first);
-                free_chain(second);
-                return r;
-        }
+        if (r < 0)
+                goto finish;
 
         /* Got tree parts, hence it is year, month and day */
         if (*t == ' ' || *t == 0) {
                 *p = t + strspn(t, " ");
-                c->year = first;
-                c->month = second;
-                c->day = third;
-                return 0;
+                r = set_field(&(*c)->month, &second, 1, 12);
+                if (r >= 0)
+                        r = set_field(&(*c)->day, &third, 1, 31);
+                if (r >= 0)
+                        r = set_years(c, &first);
+                goto finish;
         }
 
-        free_chain(first);
-        free_chain(second);
-        free_chain(third);
-        return -EINVAL;
+        r = -EINVAL;
+
+finish:
+        free(first.items);
+        free(second.items);
+        free(third.items);
+        return r;
 }
 
 static int parse_calendar_time(const char **p, CalendarSpec *c) {
-        CalendarComponent *h = NULL, *m = NULL, *s = NULL;
+        ComponentList h = {}, m = {}, s = {};
         const char *t;
         int r;
 
@@ -638,7 +815,7 @@ static int parse_calendar_time(const char **p, CalendarSpec *c) {
         if (*t == 0) {
                 /* If no time is specified at all, but a date of some
                  * kind, then this means 00:00:00 */
-                if (c->day || c->weekdays_bits > 0)
+                if (c->day.bits != 0 || c->weekdays_bits > 0)
                         goto null_hour;
 
                 goto finish;
@@ -660,7 +837,7 @@ static int parse_calendar_time(const char **p, CalendarSpec *c) {
 
         /* Already at the end? Then it's hours and minutes, and seconds are 0 */
         if (*t == 0) {
-                if (m != NULL)
+                if (m.n > 0)
                         goto null_second;
 
                 goto finish;
@@ -684,30 +861,24 @@ static int parse_calendar_time(const char **p, CalendarSpec *c) {
         goto fail;
 
 null_hour:
-        r = const_chain(0, &h);
-        if (r < 0)
-                goto fail;
-
-        r = const_chain(0, &m);
-        if (r < 0)
-                goto fail;
+        const_field(0, &c->hour);
+        const_field(0, &c->minute);
 
 null_second:
-        r = const_chain(0, &s);
-        if (r < 0)
-                goto fail;
+        const_field(0, &c->second);
 
 finish:
         *p = t;
-        c->hour = h;
-        c->minute = m;
-        c->second = s;
-        return 0;
+        r = set_field(&c->hour, &h, 0, 23);
+        if (r >= 0)
+                r = set_field(&c->minute, &m, 0, 59);
+        if (r >= 0)
+                r = set_field(&c->second, &s, 0, 59);
 
 fail:
-        free_chain(h);
-        free_chain(m);
-        free_chain(s);
+        free(h.items);
+        free(m.items);
+        free(s.items);
         return r;
 }
 
@@ -730,137 +901,84 @@ int calendar_spec_from_string(const char *p, CalendarSpec **spec) {
         if (utc) {
                 c->utc = true;
                 p = strndupa(p, utc - p);
+        } else {
+                const char *zone = strrchr(p, ' ');
+
+                /* A last word which names a zone of the tz database */
+                if (zone && tz_name_is_valid(zone + 1)) {
+                        r = tz_info_load(zone + 1, &c->tz);
+                        if (r == -ENOMEM)
+                                goto fail;
+                        if (r >= 0)
+                                p = strndupa(p, zone - p);
+                }
         }
 
         if (strcaseeq(p, "minutely")) {
-                r = const_chain(0, &c->second);
-                if (r < 0)
-                        goto fail;
+                const_field(0, &c->second);
 
         } else if (strcaseeq(p, "hourly")) {
-                r = const_chain(0, &c->minute);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->second);
-                if (r < 0)
-                        goto fail;
+                const_field(0, &c->minute);
+                const_field(0, &c->second);
 
         } else if (strcaseeq(p, "daily")) {
-                r = const_chain(0, &c->hour);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->minute);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->second);
-                if (r < 0)
-                        goto fail;
+                const_field(0, &c->hour);
+                const_field(0, &c->minute);
+                const_field(0, &c->second);
 
         } else if (strcaseeq(p, "monthly")) {
-                r = const_chain(1, &c->day);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->hour);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->minute);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->second);
-                if (r < 0)
-                        goto fail;
+                const_field(1, &c->day);
+                const_field(0, &c->hour);
+                const_field(0, &c->minute);
+                const_field(0, &c->second);
 
         } else if (strcaseeq(p, "annually") ||
                    strcaseeq(p, "yearly") ||
                    strcaseeq(p, "anually") /* backwards compatibility */ ) {
 
-                r = const_chain(1, &c->month);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(1, &c->day);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->hour);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->minute);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->second);
-                if (r < 0)
-                        goto fail;
+                const_field(1, &c->month);
+                const_field(1, &c->day);
+                const_field(0, &c->hour);
+                const_field(0, &c->minute);
+                const_field(0, &c->second);
 
         } else if (strcaseeq(p, "weekly")) {
 
                 c->weekdays_bits = 1;
 
-                r = const_chain(0, &c->hour);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->minute);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->second);
-                if (r < 0)
-                        goto fail;
+                const_field(0, &c->hour);
+                const_field(0, &c->minute);
+                const_field(0, &c->second);
 
         } else if (strcaseeq(p, "quarterly")) {
 
-                r = const_chain(1, &c->month);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(4, &c->month);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(7, &c->month);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(10, &c->month);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(1, &c->day);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->hour);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->minute);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->second);
-                if (r < 0)
-                        goto fail;
+                const_field(1, &c->month);
+                const_field(4, &c->month);
+                const_field(7, &c->month);
+                const_field(10, &c->month);
+                const_field(1, &c->day);
+                const_field(0, &c->hour);
+                const_field(0, &c->minute);
+                const_field(0, &c->second);
 
         } else if (strcaseeq(p, "biannually") ||
                    strcaseeq(p, "bi-annually") ||
                    strcaseeq(p, "semiannually") ||
                    strcaseeq(p, "semi-annually")) {
 
-                r = const_chain(1, &c->month);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(7, &c->month);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(1, &c->day);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->hour);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->minute);
-                if (r < 0)
-                        goto fail;
-                r = const_chain(0, &c->second);
-                if (r < 0)
-                        goto fail;
+                const_field(1, &c->month);
+                const_field(7, &c->month);
+                const_field(1, &c->day);
+                const_field(0, &c->hour);
+                const_field(0, &c->minute);
+                const_field(0, &c->second);
 
         } else {
                 r = parse_weekdays(&p, c);
                 if (r < 0)
                         goto fail;
 
-                r = parse_date(&p, c);
+                r = parse_date(&p, &c);
                 if (r < 0)
                         goto fail;
 
@@ -874,6 +992,13 @@ int calendar_spec_from_string(const char *p, CalendarSpec **spec) {
                 }
         }
 
+        /* Fields which were not given match everything */
+        wildcard_field(&c->month, 1, 12);
+        wildcard_field(&c->day, 1, 31);
+        wildcard_field(&c->hour, 0, 23);
+        wildcard_field(&c->minute, 0, 59);
+        wildcard_field(&c->second, 0, 59);
+
         r = calendar_spec_normalize(c);
         if (r < 0)
                 goto fail;
@@ -883,6 +1008,11 @@ int calendar_spec_from_string(const char *p, CalendarSpec **spec) {
                 goto fail;
         }
 
+        if (!calendar_spec_can_match(c)) {
+                r = -ERANGE;
+                goto fail;
+        }
+
         *spec = c;
         return 0;
 
@@ -891,19 +1021,44 @@ fail:
         return r;
 }
 
-static int find_matching_component(const CalendarComponent *c, int *val) {
-        const CalendarComponent *n;
+int calendar_field_next(const CalendarField *f, int *val) {
+        uint64_t m;
+        int d;
+
+        assert(f);
+        assert(val);
+
+        /* A value past the end of the field could never be valid, so
+           running out of bits has the same result as a candidate which
+           is out of bounds */
+        if (*val > 63)
+                return -ENOENT;
+
+        m = *val > 0 ? f->bits >> *val : f->bits;
+        if (m == 0)
+                return -ENOENT;
+
+        d = (*val > 0 ? *val : 0) + __builtin_ctzll(m);
+        if (d == *val)
+                return 0;
+
+        *val = d;
+        return 1;
+}
+
+int calendar_spec_next_year(const CalendarSpec *spec, int *val) {
         int d = -1;
         bool d_set = false;
-        int r;
+        size_t i;
 
+        assert(spec);
         assert(val);
 
-        if (!c)
+        if (spec->n_years == 0)
                 return 0;
 
-        while (c) {
-                n = c->next;
+        for (i = 0; i < spec->n_years; i++) {
+                const CalendarComponent *c = spec->year + i;
 
                 if (c->value >= *val) {
 
@@ -922,25 +1077,41 @@ static int find_matching_component(const CalendarComponent *c, int *val) {
                                 d_set = true;
                         }
                 }
-
-                c = n;
         }
 
         if (!d_set)
                 return -ENOENT;
 
-        r = *val != d;
+        if (d == *val)
+                return 0;
+
         *val = d;
-        return r;
+        return 1;
 }
 
-static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
+/* mktime() and localtime_r() in the time zone of the spec, with a zone
+   of its own without touching the global state of the C library */
+static time_t spec_mktime(const CalendarSpec *spec, struct tm *tm) {
+        if (spec->tz)
+                return tz_mktime(spec->tz, tm);
+
+        return mktime_or_timegm(tm, spec->utc);
+}
+
+static struct tm *spec_localtime_r(const CalendarSpec *spec, const time_t *t, struct tm *tm) {
+        if (spec->tz)
+                return tz_localtime_r(spec->tz, *t, tm);
+
+        return localtime_or_gmtime_r(t, tm, spec->utc);
+}
+
+static bool tm_out_of_bounds(const CalendarSpec *spec, const struct tm *tm) {
         struct tm t;
         assert(tm);
 
         t = *tm;
 
-        if (mktime_or_timegm(&t, utc) == (time_t) -1)
+        if (spec_mktime(spec, &t) == (time_t) -1)
                 return true;
 
         /* Did any normalization take place? If so, it was out of bounds before */
@@ -953,23 +1124,30 @@ static bool tm_out_of_bounds(const struct tm *tm, bool utc) {
                 t.tm_sec != tm->tm_sec;
 }
 
-static bool matches_weekday(int weekdays_bits, const struct tm *tm, bool utc) {
+static bool matches_weekday(const CalendarSpec *spec, const struct tm *tm) {
         struct tm t;
         int k;
 
-        if (weekdays_bits < 0 || weekdays_bits >= BITS_WEEKDAYS)
+        if (spec->weekdays_bits < 0 || spec->weekdays_bits >= BITS_WEEKDAYS)
                 return true;
 
         t = *tm;
-        if (mktime_or_timegm(&t, utc) == (time_t) -1)
+        if (spec_mktime(spec, &t) == (time_t) -1)
                 return false;
 
         k = t.tm_wday == 0 ? 6 : t.tm_wday - 1;
-        return (weekdays_bits & (1 << k));
+        return (spec->weekdays_bits & (1 << k));
 }
 
+/* Upper limit for the rounds of find_next(). Even a rare date like
+   Feb 29th on a Monday needs less than a hundred. Without a limit, a
+   spec which only matches at a time the clock change skips every year
+   would loop until mktime() overflows. */
+#define FIND_NEXT_ROUNDS_MAX 1000
+
 static int find_next(const CalendarSpec *spec, struct tm *tm) {
         struct tm c;
+        unsigned rounds;
         int r;
 
         assert(spec);
@@ -977,13 +1155,16 @@ static int find_next(const CalendarSpec *spec, struct tm *tm) {
 
         c = *tm;
 
-        for (;;) {
+        for (rounds = 0;; rounds++) {
+                if (rounds >= FIND_NEXT_ROUNDS_MAX)
+                        return -ENOENT;
+
                 /* Normalize the current date */
-                mktime_or_timegm(&c, spec->utc);
+                spec_mktime(spec, &c);
                 c.tm_isdst = -1;
 
                 c.tm_year += 1900;
-                r = find_matching_component(spec->year, &c.tm_year);
+                r = calendar_spec_next_year(spec, &c.tm_year);
                 c.tm_year -= 1900;
 
                 if (r > 0) {
@@ -991,18 +1172,18 @@ static int find_next(const CalendarSpec *spec, struct tm *tm) {
                         c.tm_mday = 1;
                         c.tm_hour = c.tm_min = c.tm_sec = 0;
                 }
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc))
+                if (r < 0 || tm_out_of_bounds(spec, &c))
                         return r;
 
                 c.tm_mon += 1;
-                r = find_matching_component(spec->month, &c.tm_mon);
+                r = calendar_field_next(&spec->month, &c.tm_mon);
                 c.tm_mon -= 1;
 
                 if (r > 0) {
                         c.tm_mday = 1;
                         c.tm_hour = c.tm_min = c.tm_sec = 0;
                 }
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(spec, &c)) {
                         c.tm_year ++;
                         c.tm_mon = 0;
                         c.tm_mday = 1;
@@ -1010,42 +1191,42 @@ static int find_next(const CalendarSpec *spec, struct tm *tm) {
                         continue;
                 }
 
-                r = find_matching_component(spec->day, &c.tm_mday);
+                r = calendar_field_next(&spec->day, &c.tm_mday);
                 if (r > 0)
                         c.tm_hour = c.tm_min = c.tm_sec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(spec, &c)) {
                         c.tm_mon ++;
                         c.tm_mday = 1;
                         c.tm_hour = c.tm_min = c.tm_sec = 0;
                         continue;
                 }
 
-                if (!matches_weekday(spec->weekdays_bits, &c, spec->utc)) {
+                if (!matches_weekday(spec, &c)) {
                         c.tm_mday++;
                         c.tm_hour = c.tm_min = c.tm_sec = 0;
                         continue;
                 }
 
-                r = find_matching_component(spec->hour, &c.tm_hour);
+                r = calendar_field_next(&spec->hour, &c.tm_hour);
                 if (r > 0)
                         c.tm_min = c.tm_sec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(spec, &c)) {
                         c.tm_mday ++;
                         c.tm_hour = c.tm_min = c.tm_sec = 0;
                         continue;
                 }
 
-                r = find_matching_component(spec->minute, &c.tm_min);
+                r = calendar_field_next(&spec->minute, &c.tm_min);
                 if (r > 0)
                         c.tm_sec = 0;
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                if (r < 0 || tm_out_of_bounds(spec, &c)) {
                         c.tm_hour ++;
                         c.tm_min = c.tm_sec = 0;
                         continue;
                 }
 
-                r = find_matching_component(spec->second, &c.tm_sec);
-                if (r < 0 || tm_out_of_bounds(&c, spec->utc)) {
+                r = calendar_field_next(&spec->second, &c.tm_sec);
+                if (r < 0 || tm_out_of_bounds(spec, &c)) {
                         c.tm_min ++;
                         c.tm_sec = 0;
                         continue;
@@ -1065,17 +1246,136 @@ int calendar_spec_next_usec(const CalendarSpec *spec, usec_t usec, usec_t *next)
         assert(spec);
         assert(next);
 
+        if (spec->compiled) {
+                r = calendar_compiled_next_usec(spec, usec, next);
+                if (r != -EAGAIN)
+                        return r;
+        }
+
         t = (time_t) (usec / USEC_PER_SEC) + 1;
-        assert_se(localtime_or_gmtime_r(&t, &tm, spec->utc));
+        assert_se(spec_localtime_r(spec, &t, &tm));
 
         r = find_next(spec, &tm);
         if (r < 0)
                 return r;
 
-        t = mktime_or_timegm(&tm, spec->utc);
+        t = spec_mktime(spec, &tm);
         if (t == (time_t) -1)
                 return -EINVAL;
 
         *next = (usec_t) t * USEC_PER_SEC;
         return 0;
 }
+
+int calendar_spec_next_n_usec(const CalendarSpec *spec, usec_t usec, size_t n, usec_t *ret) {
+        size_t i;
+        int r;
+
+        assert(spec);
+        assert(ret || n == 0);
+
+        if (n > INT_MAX)
+                return -EINVAL;
+
+        /* One search per occurrence, each starting right behind the
+           previous one. Only a compiled spec makes this cheap, without
+           it every step costs a full calendar_spec_next_usec(). */
+        for (i = 0; i < n; i++) {
+                r = calendar_spec_next_usec(spec, usec, &usec);
+                if (r == -ENOENT)
+                        break;
+                if (r < 0)
+                        return r;
+
+                ret[i] = usec;
+        }
+
+        return (int) i;
+}
+
+/* Latest occurrence in (since, usec), found with forward searches only:
+   whether the next occurrence after some point comes before usec tells
+   if one lies in between. The distance to usec grows exponentially until
+   that is the case, then the range is bisected, so dense specs need no
+   more steps than sparse ones. If windows overlap, the latest one is
+   reported. */
+static int find_prev(const CalendarSpec *spec, usec_t usec, usec_t since, usec_t *prev) {
+        usec_t lo, hi, step, t, start = 0;
+        int r;
+
+        /* One search from since tells if there is anything at all, instead
+           of one exhausted search per step below */
+        r = calendar_spec_next_usec(spec, since, &t);
+        if (r < 0)
+                return r;
+        if (t >= usec)
+                return -ENOENT;
+
+        hi = usec;
+        for (step = USEC_PER_SEC;; step *= 2) {
+                lo = usec - since > step ? usec - step : since;
+
+                r = calendar_spec_next_usec(spec, lo, &t);
+                if (r < 0 && r != -ENOENT)
+                        return r;
+                if (r >= 0 && t < usec) {
+                        start = t;
+                        break;
+                }
+                if (lo == since)
+                        return -ENOENT;
+
+                hi = lo;
+        }
+
+        /* Something starts after lo, nothing after hi */
+        while (hi - lo > 1) {
+                usec_t mid = lo + (hi - lo) / 2;
+
+                r = calendar_spec_next_usec(spec, mid, &t);
+                if (r < 0 && r != -ENOENT)
+                        return r;
+                if (r >= 0 && t < usec) {
+                        lo = mid;
+                        start = t;
+                } else
+                        hi = mid;
+        }
+
+        *prev = start;
+        return 0;
+}
+
+int calendar_spec_window_contains(const CalendarSpec *spec, usec_t duration, usec_t usec,
+                                  usec_t *ret_start, usec_t *ret_end) {
+        usec_t since, start;
+        int r;
+
+        assert(spec);
+
+        if (duration == 0)
+                return 0;
+
+        /* Only windows beginning after since can still be open */
+        since = usec > duration ? usec - duration : 0;
+
+        r = -EAGAIN;
+        if (spec->compiled)
+                r = calendar_compiled_prev_usec(spec, usec, since, &start);
+        if (r == -EAGAIN)
+                r = find_prev(spec, usec, since, &start);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        if (start >= usec || usec - start >= duration)
+                return 0;
+
+        if (ret_start)
+                *ret_start = start;
+        if (ret_end)
+                *ret_end = start + duration;
+
+        return 1;
+}
@@ -25,35 +25,91 @@
  * time, a la cron */
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "time-util.h"
+#include "tzfile.h"
 // #include "util.h"
 
 typedef struct CalendarComponent {
         int value;
         int repeat;
-
-        struct CalendarComponent *next;
 } CalendarComponent;
 
+/* All values of one field, bit n set means n matches. Values which
+ * were written as the start of a repetition ("v/r") are remembered in
+ * repeat, only so that they can be formatted the same way again. */
+typedef struct CalendarField {
+        uint64_t bits;
+        uint64_t repeat;
+} CalendarField;
+
+typedef struct CalendarCompiled CalendarCompiled;
+
 typedef struct CalendarSpec {
         int weekdays_bits;
         bool utc;
+        /* Zone named at the end of the spec, owned by the spec. NULL
+         * means UTC or the local time zone of the process. */
+        TzInfo *tz;
 
-        CalendarComponent *year;
-        CalendarComponent *month;
-        CalendarComponent *day;
+        CalendarField month;
+        CalendarField day;
 
-        CalendarComponent *hour;
-        CalendarComponent *minute;
-        CalendarComponent *second;
+        CalendarField hour;
+        CalendarField minute;
+        CalendarField second;
+
+        /* Set by calendar_spec_compile(), owned by the spec */
+        CalendarCompiled *compiled;
+
+        /* A repeated year has no upper limit, so the years are a sorted
+         * list instead of a bitmap. No entry means every year. */
+        size_t n_years;
+        CalendarComponent year[];
 } CalendarSpec;
 
 void calendar_spec_free(CalendarSpec *c);
 
 int calendar_spec_normalize(CalendarSpec *spec);
 bool calendar_spec_valid(CalendarSpec *spec);
+/* Whether any date matches, "*-02-30" or "Tue 2027-02-01" never do */
+bool calendar_spec_can_match(const CalendarSpec *spec);
 
 int calendar_spec_to_string(const CalendarSpec *spec, char **p);
+/* Returns -ERANGE for a spec which is well formed, but never matches */
 int calendar_spec_from_string(const char *p, CalendarSpec **spec);
 
 int calendar_spec_next_usec(const CalendarSpec *spec, usec_t usec, usec_t *next);
+
+/* Store the next n occurrences after usec in ret. Returns how many were
+ * found, which is less than n if the spec has no more occurrences.
+ * Compile the spec first, else this is n separate searches. */
+int calendar_spec_next_n_usec(const CalendarSpec *spec, usec_t usec, size_t n, usec_t *ret);
+
+/* Check if usec is inside a window of the given length which begins at
+ * an occurrence of the spec. Returns 1 and the latest such window if
+ * yes, 0 if not. */
+int calendar_spec_window_contains(const CalendarSpec *spec, usec_t duration, usec_t usec,
+                                  usec_t *ret_start, usec_t *ret_end);
+
+/* Precompute bitmasks and the UTC offset transitions of the time zone,
+ * so that calendar_spec_next_usec() can use plain arithmetic instead of
+ * calling mktime() for every step. For the local time zone the compiled
+ * form reflects it at the time of the call, recompile if it changes. A
+ * spec with its own zone does not depend on the local one at all. */
+int calendar_spec_compile(CalendarSpec *spec);
+
+/* Internal: the compiled fast path, returns -EAGAIN if the result cannot
+ * be determined without falling back to mktime() */
+int calendar_compiled_next_usec(const CalendarSpec *spec, usec_t usec, usec_t *next);
+/* Internal: the latest occurrence before usec and after since, searched
+ * backwards. Returns -ENOENT if there is none, -EAGAIN like above. */
+int calendar_compiled_prev_usec(const CalendarSpec *spec, usec_t usec, usec_t since, usec_t *prev);
+void calendar_compiled_free(CalendarCompiled *c);
+
+/* Internal: move *val to the next value the field or the year list
+ * matches. Returns 1 if *val changed, 0 if it matched already and
+ * -ENOENT if nothing is left. */
+int calendar_field_next(const CalendarField *f, int *val);
+int calendar_spec_next_year(const CalendarSpec *spec, int *val);
@@ -20,6 +20,7 @@
 ***/
 
 #include <assert.h>
+#include <sys/timex.h>
 #define assert_se assert
 
 #include "time-util.h"
@@ -79,3 +80,15 @@ char *format_timestamp(char *buf, size_t l, usec_t t) {
         return format_timestamp_internal(buf, l, t, false);
 }
 
+bool ntp_synced(void) {
+        struct timex txc = {};
+
+        if (adjtimex(&txc) < 0)
+                return false;
+
+        if (txc.status & STA_UNSYNC)
+                return false;
+
+        return true;
+}
+
@@ -0,0 +1,632 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* TZif reader, see RFC 8536.
+
+   Only the 64bit data block of version 2 and later files is used, plus
+   the POSIX TZ string in the footer, which describes the offsets after
+   the last transition. Leap second records are ignored, like the C
+   library does with the files in the default "posix" form. */
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tzfile.h"
+
+#define SEC_PER_DAY (24*60*60)
+
+/* The tz database has no file larger than a few KiB */
+#define TZ_FILE_MAX (256*1024)
+
+#define TZ_ABBR_MAX 16
+
+#define TZIF_HEADER_SIZE 44
+
+typedef struct TzType {
+        int32_t offset;
+        bool isdst;
+        char abbr[TZ_ABBR_MAX];
+} TzType;
+
+/* Start or end of DST in the POSIX TZ string: "Jn" (kind 'J'), "n"
+   (kind 0, counting from zero) or "Mm.w.d" (kind 'M') */
+typedef struct TzRuleDate {
+        char kind;
+        int month;
+        int week;
+        int day;
+        int32_t time;   /* local time of the change, may be negative */
+} TzRuleDate;
+
+struct TzInfo {
+        char *name;
+
+        size_t n_transitions;
+        int64_t *transitions;
+        uint8_t *transition_types;
+
+        size_t n_types;
+        TzType *types;
+
+        /* From the footer, for everything after the last transition */
+        bool has_rule;
+        bool has_dst;
+        TzType std;
+        TzType dst;
+        TzRuleDate start;
+        TzRuleDate end;
+};
+
+bool tz_name_is_valid(const char *name) {
+        const char *p;
+
+        if (!name || !name[0] || name[0] == '/' || strlen(name) > 255)
+                return false;
+
+        for (p = name; *p; p++)
+                if (!isalnum((unsigned char) *p) && !strchr("/_+-.", *p))
+                        return false;
+
+        /* No ".." and no hidden files */
+        for (p = name; p; p = strchr(p, '/')) {
+                if (*p == '/')
+                        p++;
+                if (*p == '.' || *p == '/' || *p == '\0')
+                        return false;
+        }
+
+        return true;
+}
+
+void tz_info_free(TzInfo *tz) {
+        if (!tz)
+                return;
+
+        free(tz->name);
+        free(tz->transitions);
+        free(tz->transition_types);
+        free(tz->types);
+        free(tz);
+}
+
+const char *tz_info_name(const TzInfo *tz) {
+        assert(tz);
+
+        return tz->name;
+}
+
+static uint32_t be32(const uint8_t *p) {
+        return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static int64_t be64(const uint8_t *p) {
+        return (int64_t) ((uint64_t) be32(p) << 32 | be32(p + 4));
+}
+
+/* Parse a number of at most max, returns NULL if there is none */
+static const char *parse_number(const char *p, int min, int max, int *ret) {
+        int v = 0;
+
+        if (!isdigit((unsigned char) *p))
+                return NULL;
+
+        for (; isdigit((unsigned char) *p); p++) {
+                v = v * 10 + (*p - '0');
+                if (v > max)
+                        return NULL;
+        }
+
+        if (v < min)
+                return NULL;
+
+        *ret = v;
+        return p;
+}
+
+/* "[+-]hh[:mm[:ss]]" */
+static const char *parse_hms(const char *p, int max_hours, int32_t *ret) {
+        int sign = 1, h, m = 0, s = 0;
+
+        if (*p == '+' || *p == '-') {
+                if (*p == '-')
+                        sign = -1;
+                p++;
+        }
+
+        p = parse_number(p, 0, max_hours, &h);
+        if (p && *p == ':') {
+                p = parse_number(p + 1, 0, 59, &m);
+                if (p && *p == ':')
+                        p = parse_number(p + 1, 0, 59, &s);
+        }
+        if (!p)
+                return NULL;
+
+        *ret = sign * (h * 3600 + m * 60 + s);
+        return p;
+}
+
+/* "ABC" or "<+01>" */
+static const char *parse_abbr(const char *p, char abbr[static TZ_ABBR_MAX]) {
+        const char *b, *e;
+        size_t l;
+
+        if (*p == '<') {
+                b = ++p;
+                while (isalnum((unsigned char) *p) || *p == '+' || *p == '-')
+                        p++;
+                if (*p != '>')
+                        return NULL;
+                e = p++;
+        } else {
+                b = p;
+                while (isalpha((unsigned char) *p))
+                        p++;
+                e = p;
+        }
+
+        if (e - b < 3)
+                return NULL;
+
+        l = (size_t) (e - b) < TZ_ABBR_MAX ? (size_t) (e - b) : TZ_ABBR_MAX - 1;
+        memcpy(abbr, b, l);
+        abbr[l] = '\0';
+
+        return p;
+}
+
+static const char *parse_rule_date(const char *p, TzRuleDate *d) {
+        *d = (TzRuleDate) { .time = 7200 };
+
+        if (*p == 'J') {
+                d->kind = 'J';
+                p = parse_number(p + 1, 1, 365, &d->day);
+        } else if (*p == 'M') {
+                d->kind = 'M';
+                p = parse_number(p + 1, 1, 12, &d->month);
+                if (p && *p == '.')
+                        p = parse_number(p + 1, 1, 5, &d->week);
+                else
+                        p = NULL;
+                if (p && *p == '.')
+                        p = parse_number(p + 1, 0, 6, &d->day);
+                else
+                        p = NULL;
+        } else
+                p = parse_number(p, 0, 365, &d->day);
+
+        /* Version 3 allows -167..167 hours */
+        if (p && *p == '/')
+                p = parse_hms(p + 1, 167, &d->time);
+
+        return p;
+}
+
+/* std offset [dst [offset] [,start[/time],end[/time]]] */
+static int parse_tz_string(TzInfo *tz, const char *p) {
+        int32_t offset;
+
+        p = parse_abbr(p, tz->std.abbr);
+        if (p)
+                p = parse_hms(p, 24, &offset);
+        if (!p)
+                return -EINVAL;
+        tz->std.offset = -offset;
+
+        if (*p != '\0') {
+                tz->has_dst = true;
+                tz->dst.isdst = true;
+
+                p = parse_abbr(p, tz->dst.abbr);
+                if (!p)
+                        return -EINVAL;
+
+                if (*p != '\0' && *p != ',') {
+                        p = parse_hms(p, 24, &offset);
+                        if (!p)
+                                return -EINVAL;
+                        tz->dst.offset = -offset;
+                } else
+                        tz->dst.offset = tz->std.offset + 3600;
+
+                if (*p == ',') {
+                        p = parse_rule_date(p + 1, &tz->start);
+                        if (!p || *p != ',')
+                                return -EINVAL;
+                        p = parse_rule_date(p + 1, &tz->end);
+                        if (!p)
+                                return -EINVAL;
+                } else {
+                        /* Not in any TZif file, the default of glibc */
+                        tz->start = (TzRuleDate) { 'M', 3, 2, 0, 7200 };
+                        tz->end = (TzRuleDate) { 'M', 11, 1, 0, 7200 };
+                }
+
+                if (*p != '\0' || tz->dst.offset <= -SEC_PER_DAY || tz->dst.offset >= SEC_PER_DAY)
+                        return -EINVAL;
+        }
+
+        if (tz->std.offset <= -SEC_PER_DAY || tz->std.offset >= SEC_PER_DAY)
+                return -EINVAL;
+
+        tz->has_rule = true;
+        return 0;
+}
+
+static bool is_leap_year(int y) {
+        return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+/* Midnight of the day the rule names in year, as seconds of local
+   time since the epoch */
+static int64_t rule_date_seconds(int year, const TzRuleDate *d) {
+        struct tm tm = {
+                .tm_year = year - 1900,
+                .tm_mday = 1,
+        };
+        int wday, mday;
+
+        switch (d->kind) {
+        case 'J':
+                /* February 29th is never counted */
+                tm.tm_mday += d->day - 1 + (is_leap_year(year) && d->day >= 60);
+                break;
+        case 'M':
+                tm.tm_mon = d->month - 1;
+                timegm(&tm);
+                /* Weekday of the first of the month, 0 is Sunday */
+                wday = tm.tm_wday;
+                mday = 1 + (d->day - wday + 7) % 7 + (d->week - 1) * 7;
+
+                /* Week 5 is the last one */
+                tm.tm_mon++;
+                tm.tm_mday = 0;
+                timegm(&tm);
+                if (mday > tm.tm_mday)
+                        mday -= 7;
+
+                tm.tm_mon = d->month - 1;
+                tm.tm_mday = mday;
+                break;
+        default:
+                tm.tm_mday += d->day;
+        }
+
+        return timegm(&tm);
+}
+
+static const TzType *rule_type(const TzInfo *tz, int64_t t) {
+        struct tm tm;
+        time_t l;
+        int64_t start, end;
+
+        if (!tz->has_dst)
+                return &tz->std;
+
+        l = (time_t) (t + tz->std.offset);
+        if (!gmtime_r(&l, &tm))
+                return &tz->std;
+
+        start = rule_date_seconds(tm.tm_year + 1900, &tz->start) + tz->start.time - tz->std.offset;
+        end = rule_date_seconds(tm.tm_year + 1900, &tz->end) + tz->end.time - tz->dst.offset;
+
+        /* On the southern hemisphere DST spans the turn of the year */
+        if (start < end)
+                return t >= start && t < end ? &tz->dst : &tz->std;
+
+        return t >= end && t < start ? &tz->std : &tz->dst;
+}
+
+static const TzType *find_type(const TzInfo *tz, int64_t t) {
+        size_t lo = 0, hi = tz->n_transitions;
+
+        if (tz->has_rule && (hi == 0 || t >= tz->transitions[hi - 1]))
+                return rule_type(tz, t);
+
+        /* Before the first transition the first type applies */
+        if (hi == 0 || t < tz->transitions[0])
+                return &tz->types[0];
+
+        while (hi - lo > 1) {
+                size_t mid = lo + (hi - lo) / 2;
+
+                if (tz->transitions[mid] <= t)
+                        lo = mid;
+                else
+                        hi = mid;
+        }
+
+        return &tz->types[tz->transition_types[lo]];
+}
+
+int32_t tz_info_offset(const TzInfo *tz, int64_t t) {
+        assert(tz);
+
+        return find_type(tz, t)->offset;
+}
+
+struct tm *tz_localtime_r(const TzInfo *tz, time_t t, struct tm *tm) {
+        const TzType *type;
+        time_t l;
+
+        assert(tz);
+        assert(tm);
+
+        type = find_type(tz, t);
+        l = t + type->offset;
+        if (!gmtime_r(&l, tm))
+                return NULL;
+
+        tm->tm_isdst = type->isdst;
+        tm->tm_gmtoff = type->offset;
+        tm->tm_zone = type->abbr;
+
+        return tm;
+}
+
+time_t tz_mktime(const TzInfo *tz, struct tm *tm) {
+        struct tm u;
+        time_t l, t, ta, tb;
+        int32_t oa, ob;
+        bool va, vb;
+
+        assert(tz);
+        assert(tm);
+
+        u = *tm;
+        l = timegm(&u);
+        if (l == (time_t) -1)
+                return (time_t) -1;
+
+        /* Offsets are less than a day and transitions further apart, so
+           the offsets a day before and after are the only candidates */
+        oa = tz_info_offset(tz, l - SEC_PER_DAY);
+        ob = tz_info_offset(tz, l + SEC_PER_DAY);
+        ta = l - oa;
+        tb = l - ob;
+        va = tz_info_offset(tz, ta) == oa;
+        vb = tz_info_offset(tz, tb) == ob;
+
+        if (va && vb)
+                t = ta < tb ? ta : tb;
+        else if (va)
+                t = ta;
+        else if (vb)
+                t = tb;
+        else
+                /* In the gap the clock was not set forward yet */
+                t = ta;
+
+        if (!tz_localtime_r(tz, t, tm))
+                return (time_t) -1;
+
+        return t;
+}
+
+/* Counts of the header in the order of the file */
+typedef struct TzHeader {
+        char version;
+        uint32_t isutcnt;
+        uint32_t isstdcnt;
+        uint32_t leapcnt;
+        uint32_t timecnt;
+        uint32_t typecnt;
+        uint32_t charcnt;
+} TzHeader;
+
+static int parse_header(const uint8_t *data, size_t size, TzHeader *h) {
+        if (size < TZIF_HEADER_SIZE || memcmp(data, "TZif", 4) != 0)
+                return -EINVAL;
+
+        *h = (TzHeader) {
+                .version = (char) data[4],
+                .isutcnt = be32(data + 20),
+                .isstdcnt = be32(data + 24),
+                .leapcnt = be32(data + 28),
+                .timecnt = be32(data + 32),
+                .typecnt = be32(data + 36),
+                .charcnt = be32(data + 40),
+        };
+
+        if (h->typecnt == 0 || h->typecnt > 256 || h->charcnt == 0 ||
+            (h->isutcnt != 0 && h->isutcnt != h->typecnt) ||
+            (h->isstdcnt != 0 && h->isstdcnt != h->typecnt))
+                return -EINVAL;
+
+        return 0;
+}
+
+static uint64_t data_block_size(const TzHeader *h, unsigned time_size) {
+        return (uint64_t) h->timecnt * (time_size + 1) + (uint64_t) h->typecnt * 6 +
+                h->charcnt + (uint64_t) h->leapcnt * (time_size + 4) +
+                h->isstdcnt + h->isutcnt;
+}
+
+static int parse_data_block(TzInfo *tz, const TzHeader *h, const uint8_t *p, unsigned time_size) {
+        const uint8_t *types, *chars;
+        size_t i;
+
+        tz->n_transitions = h->timecnt;
+        tz->n_types = h->typecnt;
+
+        tz->transitions = calloc(h->timecnt + 1, sizeof(int64_t));
+        tz->transition_types = calloc(h->timecnt + 1, sizeof(uint8_t));
+        tz->types = calloc(h->typecnt, sizeof(TzType));
+        if (!tz->transitions || !tz->transition_types || !tz->types)
+                return -ENOMEM;
+
+        for (i = 0; i < h->timecnt; i++) {
+                tz->transitions[i] = time_size == 8 ? be64(p + i * 8) : (int32_t) be32(p + i * 4);
+                if (i > 0 && tz->transitions[i] <= tz->transitions[i - 1])
+                        return -EINVAL;
+        }
+        p += (size_t) h->timecnt * time_size;
+
+        for (i = 0; i < h->timecnt; i++) {
+                if (p[i] >= h->typecnt)
+                        return -EINVAL;
+                tz->transition_types[i] = p[i];
+        }
+        p += h->timecnt;
+
+        types = p;
+        chars = types + (size_t) h->typecnt * 6;
+        for (i = 0; i < h->typecnt; i++) {
+                TzType *type = &tz->types[i];
+                int32_t offset = (int32_t) be32(types + i * 6);
+                uint8_t idx = types[i * 6 + 5];
+                size_t l;
+
+                if (offset <= -SEC_PER_DAY || offset >= SEC_PER_DAY || types[i * 6 + 4] > 1 ||
+                    idx >= h->charcnt)
+                        return -EINVAL;
+
+                type->offset = offset;
+                type->isdst = types[i * 6 + 4];
+
+                l = strnlen((const char *) chars + idx, h->charcnt - idx);
+                if (l >= TZ_ABBR_MAX)
+                        l = TZ_ABBR_MAX - 1;
+                memcpy(type->abbr, chars + idx, l);
+        }
+
+        return 0;
+}
+
+int tz_info_from_data(const char *name, const uint8_t *data, size_t size, TzInfo **ret) {
+        TzInfo *tz;
+        TzHeader h;
+        uint64_t block;
+        unsigned time_size = 4;
+        int r;
+
+        assert(name);
+        assert(data || size == 0);
+        assert(ret);
+
+        r = parse_header(data, size, &h);
+        if (r < 0)
+                return r;
+
+        block = data_block_size(&h, 4);
+        if (block > size - TZIF_HEADER_SIZE)
+                return -EINVAL;
+
+        /* Skip the 32bit data of version 1 */
+        if (h.version >= '2') {
+                data += TZIF_HEADER_SIZE + block;
+                size -= TZIF_HEADER_SIZE + block;
+
+                r = parse_header(data, size, &h);
+                if (r < 0)
+                        return r;
+
+                time_size = 8;
+                block = data_block_size(&h, 8);
+                if (block > size - TZIF_HEADER_SIZE)
+                        return -EINVAL;
+        }
+
+        tz = calloc(1, sizeof(TzInfo));
+        if (!tz)
+                return -ENOMEM;
+
+        tz->name = strdup(name);
+        if (!tz->name) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        r = parse_data_block(tz, &h, data + TZIF_HEADER_SIZE, time_size);
+        if (r < 0)
+                goto fail;
+
+        if (time_size == 8) {
+                const char *footer = (const char *) data + TZIF_HEADER_SIZE + block;
+                size_t l = size - TZIF_HEADER_SIZE - block;
+                const char *e;
+                char *s;
+
+                /* "\n<TZ string>\n", the string can be empty */
+                e = l > 0 && footer[0] == '\n' ? memchr(footer + 1, '\n', l - 1) : NULL;
+                if (!e) {
+                        r = -EINVAL;
+                        goto fail;
+                }
+
+                if (e > footer + 1) {
+                        s = strndup(footer + 1, e - footer - 1);
+                        if (!s) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+
+                        r = parse_tz_string(tz, s);
+                        free(s);
+                        if (r < 0)
+                                goto fail;
+                }
+        }
+
+        *ret = tz;
+        return 0;
+
+fail:
+        tz_info_free(tz);
+        return r;
+}
+
+int tz_info_load(const char *name, TzInfo **ret) {
+        uint8_t *data;
+        struct stat st;
+        ssize_t n;
+        char *path;
+        int fd, r;
+
+        assert(ret);
+
+        if (!tz_name_is_valid(name))
+                return -EINVAL;
+
+        if (asprintf(&path, TZ_DIR "/%s", name) < 0)
+                return -ENOMEM;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        free(path);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0) {
+                r = -errno;
+                close(fd);
+                return r;
+        }
+        if (!S_ISREG(st.st_mode) || st.st_size > TZ_FILE_MAX) {
+                close(fd);
+                return -EINVAL;
+        }
+
+        data = malloc(st.st_size > 0 ? st.st_size : 1);
+        if (!data) {
+                close(fd);
+                return -ENOMEM;
+        }
+
+        n = read(fd, data, st.st_size);
+        if (n < 0)
+                r = -errno;
+        else
+                r = tz_info_from_data(name, data, (size_t) n, ret);
+
+        free(data);
+        close(fd);
+        return r;
+}
@@ -0,0 +1,38 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+/* Reader for the TZif files of the tz database (RFC 8536), so that a
+ * calendar spec can be evaluated in a named time zone without TZ,
+ * tzset() or any other global state of the C library. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define TZ_DIR "/usr/share/zoneinfo"
+
+typedef struct TzInfo TzInfo;
+
+/* Names like "Europe/Berlin", nothing which could leave TZ_DIR */
+bool tz_name_is_valid(const char *name);
+
+/* Load TZ_DIR/name. Returns -ENOENT if there is no such zone and
+ * -EINVAL if the file is not a usable TZif file. */
+int tz_info_load(const char *name, TzInfo **ret);
+int tz_info_from_data(const char *name, const uint8_t *data, size_t size, TzInfo **ret);
+void tz_info_free(TzInfo *tz);
+
+const char *tz_info_name(const TzInfo *tz);
+
+/* UTC offset in seconds at t */
+int32_t tz_info_offset(const TzInfo *tz, int64_t t);
+
+/* Counterparts of localtime_r() and of mktime() with tm_isdst = -1.
+ * An ambiguous local time resolves to the earlier point in time, one
+ * in a gap is moved forward by the length of the gap. */
+struct tm *tz_localtime_r(const TzInfo *tz, time_t t, struct tm *tm);
+time_t tz_mktime(const TzInfo *tz, struct tm *tm);
@@ -27,8 +27,58 @@ extern int mkdir_p(const char *path, mode_t mode);
 #define RM_GROUP "rebootmgr"
 extern int load_config(RM_CTX *ctx);
 extern int save_config(RM_RebootStrategy reboot_strategy,
-            	       CalendarSpec *maint_window_start,
-                       time_t maint_window_duration);
+		       const RM_Window *windows, size_t n_windows);
+
+/* persistent reboot request, see state.c */
+extern int save_state(const char *path, RM_RebootStatus status,
+		      RM_RebootMethod method, usec_t reboot_time,
+		      bool forced, bool lock_held);
+extern int load_state(const char *path, RM_RebootStatus *status,
+		      RM_RebootMethod *method, usec_t *reboot_time,
+		      bool *forced, bool *lock_held);
+
+/* offset of the reboot inside of the maintenance window, see jitter.c */
+#define RM_MACHINE_ID_FILE "/etc/machine-id"
+extern int rm_jitter_offset(RM_JitterMode mode, const char *machine_id,
+			    usec_t duration, usec_t *ret);
+extern int rm_domain_slot(const char *domain, unsigned size, int index,
+			  const char *machine_id, usec_t duration,
+			  usec_t *ret_offset, usec_t *ret_width);
+
+/* load of the machine in hundredths, see pressure.c */
+#define RM_PROC_ROOT "/proc"
+extern int rm_parse_centi(const char *str, unsigned *ret);
+extern int rm_pressure_read(const char *proc, unsigned *ret_pressure,
+			    unsigned *ret_load);
+
+/* maintenance windows, a list is separated by ';', see windows.c */
+extern void rm_windows_free(RM_Window *windows, size_t n);
+extern int rm_windows_from_string(const char *str, RM_Window **ret,
+				  size_t *ret_n);
+extern int rm_durations_from_string(const char *str, time_t **ret,
+				    size_t *ret_n);
+/* A single duration applies to all windows, else every window
+   needs its own */
+extern int rm_windows_set_durations(RM_Window *windows, size_t n,
+				    const time_t *durations, size_t n_durations);
+extern int rm_windows_to_string(const RM_Window *windows, size_t n,
+				char **ret_start, char **ret_duration);
+extern void rm_window_index_reset(RM_WindowIndex *idx);
+extern int rm_window_find(RM_WindowIndex *idx, const RM_Window *windows,
+			  size_t n, const RM_Interval *blackouts,
+			  size_t n_blackouts, usec_t usec,
+			  usec_t *ret_start, usec_t *ret_end);
+extern int rm_windows_list(const RM_Window *windows, size_t n,
+			   const RM_Interval *blackouts, size_t n_blackouts,
+			   usec_t usec, size_t count,
+			   RM_Interval **ret, size_t *ret_n);
+/* periods without reboots, which are cut out of the windows */
+extern int rm_blackouts_from_string(const char *str, const char *file,
+				    RM_Interval **ret, size_t *ret_n);
+extern usec_t rm_blackout_end(const RM_Interval *blackouts, size_t n,
+			      usec_t usec);
+/* end of the window for reboots which may be deferred, else 0 */
+extern usec_t rm_defer_deadline(RM_CTX *ctx, usec_t curr);
 
 /* logging */
 #include <syslog.h>
@@ -44,3 +94,5 @@ int rm_strategy_to_str(RM_RebootStrategy strategy, const char **ret);
 int rm_status_to_str(RM_RebootStatus status, RM_RebootMethod method,
 		     const char **ret);
 int rm_method_to_str(RM_RebootMethod method, const char **ret);
+int rm_string_to_jitter(const char *str_jitter, RM_JitterMode *ret);
+int rm_jitter_to_str(RM_JitterMode mode, const char **ret);
@@ -0,0 +1,155 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Machines of a fleet should not all reboot at the begin of the
+   maintenance window. The offset into the window is either random
+   for every reboot or derived from the machine-id, so that a machine
+   always reboots at the same time and the fleet is spread evenly. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "common.h"
+
+#define MACHINE_ID_LEN 32
+
+static int
+read_machine_id(char buf[MACHINE_ID_LEN + 1])
+{
+  FILE *fp;
+  int r = 0;
+
+  fp = fopen(RM_MACHINE_ID_FILE, "re");
+  if (fp == NULL)
+    return -errno;
+
+  if (fgets(buf, MACHINE_ID_LEN + 1, fp) == NULL ||
+      strlen(buf) != MACHINE_ID_LEN)
+    r = -EBADMSG;
+  fclose(fp);
+
+  return r;
+}
+
+/* FNV-1a, followed by the finalizer of splitmix64: machine-ids are
+   random already, but the finalizer makes sure that every bit of
+   the id influences the low bits used for the offset */
+static uint64_t
+hash_string(const char *str)
+{
+  uint64_t h = UINT64_C(0xcbf29ce484222325);
+
+  for (const char *p = str; *p; p++)
+    {
+      h ^= (unsigned char) *p;
+      h *= UINT64_C(0x100000001b3);
+    }
+
+  h = (h ^ (h >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  h = (h ^ (h >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return h ^ (h >> 31);
+}
+
+/* Return an offset between 0 and duration, with a resolution of
+   seconds. If machine_id is NULL, /etc/machine-id is used. */
+int
+rm_jitter_offset(RM_JitterMode mode, const char *machine_id,
+		 usec_t duration, usec_t *ret)
+{
+  char buf[MACHINE_ID_LEN + 1];
+  uint64_t v;
+  int r;
+
+  if (duration < USEC_PER_SEC)
+    {
+      *ret = 0;
+      return 0;
+    }
+
+  switch (mode)
+    {
+    case RM_JITTER_RANDOM:
+      if (getrandom(&v, sizeof(v), 0) != sizeof(v))
+	return errno > 0 ? -errno : -EIO;
+      *ret = (v % (duration / USEC_PER_SEC)) * USEC_PER_SEC;
+      return 0;
+
+    case RM_JITTER_MACHINE_ID:
+      if (machine_id == NULL)
+	{
+	  r = read_machine_id(buf);
+	  if (r < 0)
+	    return r;
+	  machine_id = buf;
+	}
+      v = hash_string(machine_id);
+      *ret = (v % (duration / USEC_PER_SEC)) * USEC_PER_SEC;
+      return 0;
+
+    default:
+      return -EINVAL;
+    }
+}
+
+/* Every member of a failure domain gets its own part of the window,
+   so that no two members reboot at the same time. Without an index
+   the member is chosen by the machine-id, which doesn't guarantee
+   that. The domain name rotates the slots, so that the first members
+   of all domains don't start together. */
+int
+rm_domain_slot(const char *domain, unsigned size, int index,
+	       const char *machine_id, usec_t duration,
+	       usec_t *ret_offset, usec_t *ret_width)
+{
+  char buf[MACHINE_ID_LEN + 1];
+  uint64_t slot;
+  usec_t width;
+  int r;
+
+  if (size == 0 || index >= (int) size)
+    return -EINVAL;
+
+  width = duration / size / USEC_PER_SEC * USEC_PER_SEC;
+  if (width == 0)
+    return -ERANGE;
+
+  if (index >= 0)
+    slot = index;
+  else
+    {
+      if (machine_id == NULL)
+	{
+	  r = read_machine_id(buf);
+	  if (r < 0)
+	    return r;
+	  machine_id = buf;
+	}
+      slot = hash_string(machine_id) % size;
+    }
+
+  if (domain)
+    slot = (slot + hash_string(domain) % size) % size;
+
+  *ret_offset = slot * width;
+  *ret_width = width;
+
+  return 0;
+}
@@ -19,6 +19,8 @@
 #include "config.h"
 
 #include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 #include <libeconf.h>
 
@@ -26,6 +28,21 @@
 #include "common.h"
 #include "parse-duration.h"
 
+static int
+parse_uint(const char *str, unsigned *ret)
+{
+  char *ep;
+  unsigned long l;
+
+  errno = 0;
+  l = strtoul(str, &ep, 10);
+  if (errno != 0 || ep == str || *ep != '\0' || str[0] == '-' || l > INT_MAX)
+    return -EINVAL;
+
+  *ret = l;
+  return 0;
+}
+
 static econf_err
 open_config_file(econf_file **key_file)
 {
@@ -60,6 +77,15 @@ load_config(RM_CTX *ctx)
   else
     {
       _cleanup_(freep) char *str_start = NULL, *str_duration = NULL, *str_strategy = NULL;
+      _cleanup_(freep) char *str_lock_server = NULL, *str_lock_group = NULL;
+      _cleanup_(freep) char *str_jitter = NULL, *str_domain = NULL;
+      _cleanup_(freep) char *str_domain_size = NULL, *str_domain_index = NULL;
+      _cleanup_(freep) char *str_kexec_kernel = NULL, *str_kexec_initrd = NULL;
+      _cleanup_(freep) char *str_kexec_cmdline = NULL;
+      _cleanup_(freep) char *str_prepare_lead = NULL, *str_prepare_units = NULL;
+      _cleanup_(freep) char *str_hook_timeout = NULL;
+      _cleanup_(freep) char *str_max_pressure = NULL, *str_max_load = NULL;
+      _cleanup_(freep) char *str_blackout = NULL, *str_blackout_file = NULL;
 
       error = econf_getStringValue(key_file, RM_GROUP, "window-start", &str_start);
       if (error && error != ECONF_NOKEY)
@@ -76,6 +102,21 @@ load_config(RM_CTX *ctx)
 	  return -1;
 	}
 
+      error = econf_getStringValue(key_file, RM_GROUP, "lock-server", &str_lock_server);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'lock-server': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "lock-group", &str_lock_group);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'lock-group': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+
       error = econf_getStringValue(key_file, RM_GROUP, "strategy", &str_strategy);
       if (error && error != ECONF_NOKEY)
 	{
@@ -84,6 +125,116 @@ load_config(RM_CTX *ctx)
 	  return -1;
 	}
 
+      error = econf_getStringValue(key_file, RM_GROUP, "jitter", &str_jitter);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'jitter': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+
+      error = econf_getStringValue(key_file, RM_GROUP, "failure-domain", &str_domain);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'failure-domain': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "domain-size", &str_domain_size);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'domain-size': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "domain-index", &str_domain_index);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'domain-index': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+
+      error = econf_getStringValue(key_file, RM_GROUP, "kexec-kernel", &str_kexec_kernel);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'kexec-kernel': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "kexec-initrd", &str_kexec_initrd);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'kexec-initrd': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "kexec-cmdline", &str_kexec_cmdline);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'kexec-cmdline': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+
+      error = econf_getStringValue(key_file, RM_GROUP, "prepare-lead", &str_prepare_lead);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'prepare-lead': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "prepare-units", &str_prepare_units);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'prepare-units': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "hook-timeout", &str_hook_timeout);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'hook-timeout': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      bool require_time_sync = ctx->require_time_sync;
+      error = econf_getBoolValue(key_file, RM_GROUP, "require-time-sync", &require_time_sync);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'require-time-sync': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "max-pressure", &str_max_pressure);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'max-pressure': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "max-load", &str_max_load);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'max-load': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "blackout", &str_blackout);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'blackout': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+      error = econf_getStringValue(key_file, RM_GROUP, "blackout-file", &str_blackout_file);
+      if (error && error != ECONF_NOKEY)
+	{
+	  log_msg(LOG_ERR, "ERROR (econf): cannot get key 'blackout-file': %s",
+		  econf_errString(error));
+	  return -1;
+	}
+
       RM_RebootStrategy new_strategy = RM_REBOOTSTRATEGY_UNKNOWN;
       if (str_strategy != NULL)
 	{
@@ -96,23 +247,143 @@ load_config(RM_CTX *ctx)
 	    }
 	}
 
-      CalendarSpec *new_start = NULL;
-      if (str_start != NULL && strlen(str_start) > 0)
+      RM_JitterMode new_jitter = RM_JITTER_UNKNOWN;
+      if (str_jitter != NULL && strlen(str_jitter) > 0)
 	{
-	  r = calendar_spec_from_string(str_start, &new_start);
+	  r = rm_string_to_jitter(str_jitter, &new_jitter);
 	  if (r < 0)
 	    {
-	      log_msg(LOG_ERR, "ERROR: cannot parse window-start (%s): %s",
-		      str_start, strerror(-r));
+	      log_msg(LOG_ERR, "ERROR: cannot parse jitter (%s): %s",
+		      str_jitter, strerror(-r));
+	      return -1;
+	    }
+	}
+
+      unsigned new_domain_size = ctx->domain_size;
+      if (str_domain_size != NULL && strlen(str_domain_size) > 0)
+	{
+	  if (parse_uint(str_domain_size, &new_domain_size) < 0 || new_domain_size == 0)
+	    {
+	      log_msg(LOG_ERR, "ERROR: cannot parse domain-size (%s)",
+		      str_domain_size);
+	      return -1;
+	    }
+	}
+
+      int new_domain_index = ctx->domain_index;
+      if (str_domain_index != NULL && strlen(str_domain_index) > 0)
+	{
+	  unsigned u;
+
+	  if (parse_uint(str_domain_index, &u) < 0 || u >= new_domain_size)
+	    {
+	      log_msg(LOG_ERR, "ERROR: domain-index (%s) is invalid or not smaller than domain-size (%u)",
+		      str_domain_index, new_domain_size);
 	      return -1;
 	    }
+	  new_domain_index = u;
 	}
 
-      time_t new_duration = BAD_TIME;
+      time_t new_prepare_lead = BAD_TIME;
+      if (str_prepare_lead != NULL && strlen(str_prepare_lead) > 0)
+	{
+	  if ((new_prepare_lead = parse_duration(str_prepare_lead)) == BAD_TIME)
+	    {
+	      log_msg(LOG_ERR, "ERROR: cannot parse prepare-lead (%s)",
+		      str_prepare_lead);
+	      return -1;
+	    }
+	}
+
+      time_t new_hook_timeout = BAD_TIME;
+      if (str_hook_timeout != NULL && strlen(str_hook_timeout) > 0)
+	{
+	  if ((new_hook_timeout = parse_duration(str_hook_timeout)) == BAD_TIME ||
+	      new_hook_timeout == 0)
+	    {
+	      log_msg(LOG_ERR, "ERROR: cannot parse hook-timeout (%s)",
+		      str_hook_timeout);
+	      return -1;
+	    }
+	}
+
+      unsigned new_max_pressure = ctx->max_pressure;
+      if (str_max_pressure != NULL)
+	{
+	  if (strlen(str_max_pressure) == 0)
+	    new_max_pressure = 0;
+	  else if (rm_parse_centi(str_max_pressure, &new_max_pressure) < 0 ||
+		   new_max_pressure > 100 * 100)
+	    {
+	      log_msg(LOG_ERR, "ERROR: cannot parse max-pressure (%s)",
+		      str_max_pressure);
+	      return -1;
+	    }
+	}
+
+      unsigned new_max_load = ctx->max_load;
+      if (str_max_load != NULL)
+	{
+	  if (strlen(str_max_load) == 0)
+	    new_max_load = 0;
+	  else if (rm_parse_centi(str_max_load, &new_max_load) < 0)
+	    {
+	      log_msg(LOG_ERR, "ERROR: cannot parse max-load (%s)",
+		      str_max_load);
+	      return -1;
+	    }
+	}
+
+      /* Only checked here, rebootmgrd parses the blackouts again
+	 if the time zone changes */
+      if (str_blackout != NULL || str_blackout_file != NULL)
+	{
+	  const char *blackout = str_blackout ? str_blackout : ctx->blackout;
+	  const char *file = str_blackout_file ? str_blackout_file : ctx->blackout_file;
+	  RM_Interval *blackouts;
+	  size_t n_blackouts;
+
+	  r = rm_blackouts_from_string(blackout,
+				       file && strlen(file) > 0 ? file : NULL,
+				       &blackouts, &n_blackouts);
+	  if (r < 0)
+	    {
+	      log_msg(LOG_ERR, "ERROR: cannot parse blackout (%s) or blackout-file (%s): %s",
+		      blackout ? blackout : "", file ? file : "", strerror(-r));
+	      return -1;
+	    }
+	  free(blackouts);
+	}
+
+      RM_Window *new_windows = NULL;
+      size_t n_new_windows = 0;
+      if (str_start != NULL)
+	{
+	  r = rm_windows_from_string(str_start, &new_windows, &n_new_windows);
+	  if (r < 0)
+	    {
+	      if (r == -ERANGE)
+		log_msg(LOG_ERR, "ERROR: window-start (%s) never matches", str_start);
+	      else
+		log_msg(LOG_ERR, "ERROR: cannot parse window-start (%s): %s",
+			str_start, strerror(-r));
+	      return -1;
+	    }
+	  /* Without window-duration the windows keep the old length */
+	  for (size_t i = 0; i < n_new_windows && ctx->n_windows > 0; i++)
+	    new_windows[i].duration = ctx->windows[0].duration;
+	}
+
+      _cleanup_(freep) time_t *new_durations = NULL;
+      size_t n_new_durations = 0;
       if (str_duration != NULL && strlen(str_duration) > 0)
 	{
-	  if ((new_duration = parse_duration(str_duration)) == BAD_TIME)
+	  size_t n = str_start != NULL ? n_new_windows : ctx->n_windows;
+
+	  r = rm_durations_from_string(str_duration, &new_durations, &n_new_durations);
+	  if (r < 0 || (n > 0 && n_new_durations != 1 && n_new_durations != n))
 	    {
+	      rm_windows_free(new_windows, n_new_windows);
 	      log_msg(LOG_ERR, "ERROR: cannot parse window-duration (%s)",
 		      str_duration);
 	      return -1;
@@ -121,13 +392,71 @@ load_config(RM_CTX *ctx)
 
       if (new_strategy != RM_REBOOTSTRATEGY_UNKNOWN)
 	ctx->reboot_strategy = new_strategy;
-      if (str_start != NULL || new_start != NULL)
+      if (str_start != NULL)
+	{
+	  rm_windows_free(ctx->windows, ctx->n_windows);
+	  ctx->windows = new_windows;
+	  ctx->n_windows = n_new_windows;
+	}
+      if (new_durations != NULL)
+	rm_windows_set_durations(ctx->windows, ctx->n_windows,
+				 new_durations, n_new_durations);
+      if (new_jitter != RM_JITTER_UNKNOWN)
+	ctx->jitter = new_jitter;
+      if (str_domain != NULL)
+	{
+	  free(ctx->failure_domain);
+	  ctx->failure_domain = strlen(str_domain) > 0 ? TAKE_PTR(str_domain) : NULL;
+	}
+      ctx->domain_size = new_domain_size;
+      if (new_prepare_lead != BAD_TIME)
+	ctx->prepare_lead = new_prepare_lead;
+      ctx->require_time_sync = require_time_sync;
+      ctx->max_pressure = new_max_pressure;
+      ctx->max_load = new_max_load;
+      if (new_hook_timeout != BAD_TIME)
+	ctx->hook_timeout = new_hook_timeout;
+      if (str_blackout != NULL)
+	{
+	  free(ctx->blackout);
+	  ctx->blackout = strlen(str_blackout) > 0 ? TAKE_PTR(str_blackout) : NULL;
+	}
+      if (str_blackout_file != NULL)
+	{
+	  free(ctx->blackout_file);
+	  ctx->blackout_file = strlen(str_blackout_file) > 0 ? TAKE_PTR(str_blackout_file) : NULL;
+	}
+      if (str_prepare_units != NULL)
+	{
+	  free(ctx->prepare_units);
+	  ctx->prepare_units = strlen(str_prepare_units) > 0 ? TAKE_PTR(str_prepare_units) : NULL;
+	}
+      if (str_kexec_kernel != NULL)
+	{
+	  free(ctx->kexec_kernel);
+	  ctx->kexec_kernel = strlen(str_kexec_kernel) > 0 ? TAKE_PTR(str_kexec_kernel) : NULL;
+	}
+      if (str_kexec_initrd != NULL)
+	{
+	  free(ctx->kexec_initrd);
+	  ctx->kexec_initrd = strlen(str_kexec_initrd) > 0 ? TAKE_PTR(str_kexec_initrd) : NULL;
+	}
+      if (str_kexec_cmdline != NULL)
+	{
+	  free(ctx->kexec_cmdline);
+	  ctx->kexec_cmdline = strlen(str_kexec_cmdline) > 0 ? TAKE_PTR(str_kexec_cmdline) : NULL;
+	}
+      ctx->domain_index = new_domain_index;
+      if (str_lock_server != NULL)
+	{
+	  free(ctx->lock_server);
+	  ctx->lock_server = strlen(str_lock_server) > 0 ? TAKE_PTR(str_lock_server) : NULL;
+	}
+      if (str_lock_group != NULL && strlen(str_lock_group) > 0)
 	{
-	  calendar_spec_free(ctx->maint_window_start);
-	  ctx->maint_window_start = new_start;
+	  free(ctx->lock_group);
+	  ctx->lock_group = TAKE_PTR(str_lock_group);
 	}
-      if (new_duration != BAD_TIME)
-	ctx->maint_window_duration = new_duration;
     }
   return 0;
 }
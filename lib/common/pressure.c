@@ -0,0 +1,137 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Current load of the machine, read from the PSI files and loadavg
+   of procfs. The kernel prints all values with two decimals, they are
+   parsed as integers in hundredths to be independent of the locale. */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+
+static const char *const pressure_files[] = {
+  "pressure/cpu",
+  "pressure/io",
+  "pressure/memory",
+};
+
+/* "12.34" -> 1234, at most two decimals */
+int
+rm_parse_centi(const char *str, unsigned *ret)
+{
+  unsigned long v = 0;
+  const char *p = str;
+  int decimals = -1;
+
+  if (*p == '\0' || *p == '.')
+    return -EINVAL;
+
+  for (; *p != '\0'; p++)
+    {
+      if (*p == '.' && decimals < 0)
+	{
+	  decimals = 0;
+	  continue;
+	}
+      if (*p < '0' || *p > '9' || decimals == 2)
+	break;
+      v = v * 10 + (*p - '0');
+      if (v > UINT_MAX / 100)
+	return -ERANGE;
+      if (decimals >= 0)
+	decimals++;
+    }
+  if (*p != '\0' && *p != ' ' && *p != '\n')
+    return -EINVAL;
+
+  for (decimals = decimals < 0 ? 0 : decimals; decimals < 2; decimals++)
+    v *= 10;
+
+  *ret = v;
+  return 0;
+}
+
+/* First word of a file, or the value of key in the line starting
+   with prefix */
+static int
+read_value(const char *proc, const char *file, const char *prefix,
+	   const char *key, unsigned *ret)
+{
+  char path[PATH_MAX], line[256];
+  int r = -ENODATA;
+  FILE *fp;
+
+  if (snprintf(path, sizeof(path), "%s/%s", proc, file) >= (int) sizeof(path))
+    return -ENAMETOOLONG;
+
+  fp = fopen(path, "re");
+  if (fp == NULL)
+    return -errno;
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+    {
+      const char *p = line;
+
+      if (prefix)
+	{
+	  if (strncmp(line, prefix, strlen(prefix)) != 0)
+	    continue;
+	  p = strstr(line, key);
+	  if (p == NULL)
+	    break;
+	  p += strlen(key);
+	}
+      r = rm_parse_centi(p, ret);
+      break;
+    }
+  fclose(fp);
+
+  return r;
+}
+
+/* Highest "some avg10" of cpu, io and memory in hundredths of percent
+   and the load average of the last minute in hundredths. Kernels
+   without PSI report 0 pressure. */
+int
+rm_pressure_read(const char *proc, unsigned *ret_pressure, unsigned *ret_load)
+{
+  unsigned max = 0, v;
+  int r;
+
+  for (size_t i = 0; i < sizeof(pressure_files) / sizeof(pressure_files[0]); i++)
+    {
+      r = read_value(proc, pressure_files[i], "some ", "avg10=", &v);
+      if (r == -ENOENT || r == -EOPNOTSUPP)
+	continue;
+      if (r < 0)
+	return r;
+      if (v > max)
+	max = v;
+    }
+
+  r = read_value(proc, "loadavg", NULL, NULL, &v);
+  if (r < 0)
+    return r;
+
+  *ret_pressure = max;
+  *ret_load = v;
+  return 0;
+}
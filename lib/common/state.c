@@ -0,0 +1,141 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "basics.h"
+#include "common.h"
+
+/* The state file contains one line:
+   <version> <reboot status> <reboot method> <reboot time in usec> <forced> <lock held>
+   Version 1 had no forced field, it is read as 0. Versions 1 and 2 had
+   no lock field, it is read as 1, so that a lock is given back in doubt. */
+#define STATE_VERSION 3
+
+static int
+fsync_directory_of(const char *path)
+{
+  _cleanup_(freep) char *buf = strdup(path);
+  int fd, r = 0;
+
+  if (buf == NULL)
+    return -ENOMEM;
+
+  fd = open(dirname(buf), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if (fd < 0)
+    return -errno;
+
+  if (fsync(fd) < 0)
+    r = -errno;
+  close(fd);
+
+  return r;
+}
+
+/* Write the state to a temporary file and rename it, so that the
+   file is complete at any time, even after a crash */
+int
+save_state(const char *path, RM_RebootStatus status,
+	   RM_RebootMethod method, usec_t reboot_time, bool forced,
+	   bool lock_held)
+{
+  _cleanup_(freep) char *tmp = NULL;
+  char buf[128];
+  int fd, len, r;
+
+  if (path == NULL)
+    return -EINVAL;
+
+  if (asprintf(&tmp, "%s.new", path) < 0)
+    return -ENOMEM;
+
+  len = snprintf(buf, sizeof(buf), "%d %d %d %" PRIu64 " %d %d\n",
+		 STATE_VERSION, status, method, reboot_time, forced ? 1 : 0,
+		 lock_held ? 1 : 0);
+
+  fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  if (fd < 0)
+    return -errno;
+
+  if (write(fd, buf, len) != len)
+    r = errno > 0 ? -errno : -EIO;
+  else if (fsync(fd) < 0)
+    r = -errno;
+  else
+    r = 0;
+
+  if (close(fd) < 0 && r == 0)
+    r = -errno;
+
+  if (r == 0 && rename(tmp, path) < 0)
+    r = -errno;
+
+  if (r < 0)
+    {
+      unlink(tmp);
+      return r;
+    }
+
+  return fsync_directory_of(path);
+}
+
+int
+load_state(const char *path, RM_RebootStatus *status,
+	   RM_RebootMethod *method, usec_t *reboot_time, bool *forced,
+	   bool *lock_held)
+{
+  FILE *fp;
+  int version, s, m, f = 0, l = 1;
+  uint64_t t;
+  int n;
+
+  if (path == NULL)
+    return -EINVAL;
+
+  fp = fopen(path, "re");
+  if (fp == NULL)
+    return -errno;
+
+  n = fscanf(fp, "%d %d %d %" SCNu64 " %d %d", &version, &s, &m, &t, &f, &l);
+  fclose(fp);
+
+  if (!(n == 4 && version == 1) && !(n == 5 && version == 2) &&
+      !(n == 6 && version == STATE_VERSION))
+    return -EINVAL;
+  if ((f != 0 && f != 1) || (l != 0 && l != 1))
+    return -EINVAL;
+
+  if (s < RM_REBOOTSTATUS_NOT_REQUESTED || s > RM_REBOOTSTATUS_WAITING_WINDOW ||
+      m < RM_REBOOTMETHOD_UNKNOWN || m > RM_REBOOTMETHOD_KEXEC)
+    return -EINVAL;
+
+  *status = s;
+  *method = m;
+  *reboot_time = t;
+  *forced = f;
+  *lock_held = l;
+
+  return 0;
+}
@@ -100,12 +100,16 @@ rm_status_to_str (RM_RebootStatus status, RM_RebootMethod method,
     case RM_REBOOTSTATUS_REQUESTED:
       if (method == RM_REBOOTMETHOD_SOFT)
 	*ret = _("Soft-reboot requested");
+      else if (method == RM_REBOOTMETHOD_KEXEC)
+	*ret = _("Kexec reboot requested");
       else
 	*ret = _("Reboot requested");
       break;
     case RM_REBOOTSTATUS_WAITING_WINDOW:
       if (method == RM_REBOOTMETHOD_SOFT)
 	*ret = _("Soft-reboot requested, waiting for maintenance window");
+      else if (method == RM_REBOOTMETHOD_KEXEC)
+	*ret = _("Kexec reboot requested, waiting for maintenance window");
       else
 	*ret = _("Reboot requested, waiting for maintenance window");
       break;
@@ -154,6 +158,9 @@ rm_method_to_str (RM_RebootMethod method, const char **ret)
   case RM_REBOOTMETHOD_SOFT:
     *ret = "soft-reboot";
     break;
+  case RM_REBOOTMETHOD_KEXEC:
+    *ret = "kexec-reboot";
+    break;
   case RM_REBOOTMETHOD_UNKNOWN:
   default:
     *ret = "unknown";
@@ -161,3 +168,38 @@ rm_method_to_str (RM_RebootMethod method, const char **ret)
   }
   return 0;
 }
+
+int
+rm_string_to_jitter (const char *str_jitter, RM_JitterMode *ret)
+{
+  *ret = RM_JITTER_UNKNOWN;
+  if (!str_jitter)
+    return -EINVAL;
+
+  if (strcasecmp (str_jitter, "random") == 0)
+    *ret = RM_JITTER_RANDOM;
+  else if (strcasecmp (str_jitter, "machine-id") == 0)
+    *ret = RM_JITTER_MACHINE_ID;
+  else
+    return -EINVAL;
+
+  return 0;
+}
+
+int
+rm_jitter_to_str (RM_JitterMode mode, const char **ret)
+{
+  switch (mode) {
+  case RM_JITTER_RANDOM:
+    *ret = "random";
+    break;
+  case RM_JITTER_MACHINE_ID:
+    *ret = "machine-id";
+    break;
+  case RM_JITTER_UNKNOWN:
+  default:
+    *ret = "unknown";
+    return -EINVAL;
+  }
+  return 0;
+}
@@ -0,0 +1,730 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Several maintenance windows, e.g. a short one every night and a
+   long one at the weekend. Their occurrences are collected for some
+   days ahead in a sorted array, overlapping windows are merged. Which
+   window is open at a point in time and which one comes next is then
+   a binary search instead of a calendar calculation per window.
+
+   Blackouts are periods without any reboot, e.g. a change freeze.
+   They are cut out of the windows of the index. */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "basics.h"
+#include "common.h"
+#include "parse-duration.h"
+
+#define RM_WINDOW_SEPARATOR ";"
+/* How far the index looks ahead, and how many occurrences of one
+   window it takes at most, which shortens the range for dense ones */
+#define RM_WINDOW_INDEX_USEC (7 * USEC_PER_DAY)
+#define RM_WINDOW_INDEX_MAX  256
+
+void
+rm_windows_free(RM_Window *windows, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    calendar_spec_free(windows[i].start);
+  free(windows);
+}
+
+/* Split a list at the separator and strip the white space around
+   every entry. Empty entries are an error, an empty list is not. */
+static int
+split_list(char *str, char ***ret, size_t *ret_n)
+{
+  _cleanup_(freep) char **list = NULL;
+  size_t n = 0;
+  char *p = str;
+
+  while (isspace((unsigned char) *p))
+    p++;
+  if (*p == '\0')
+    {
+      *ret = NULL;
+      *ret_n = 0;
+      return 0;
+    }
+
+  while (p != NULL)
+    {
+      char *entry = strsep(&p, RM_WINDOW_SEPARATOR);
+      char *e;
+
+      while (isspace((unsigned char) *entry))
+	entry++;
+      e = entry + strlen(entry);
+      while (e > entry && isspace((unsigned char) e[-1]))
+	*--e = '\0';
+      if (*entry == '\0')
+	return -EINVAL;
+
+      char **l = reallocarray(list, n + 1, sizeof(char *));
+      if (l == NULL)
+	return -ENOMEM;
+      list = l;
+      list[n++] = entry;
+    }
+
+  *ret = TAKE_PTR(list);
+  *ret_n = n;
+  return 0;
+}
+
+/* The windows get RM_WINDOW_DURATION_DEFAULT as duration */
+int
+rm_windows_from_string(const char *str, RM_Window **ret, size_t *ret_n)
+{
+  _cleanup_(freep) char *buf = strdup(str);
+  _cleanup_(freep) char **list = NULL;
+  RM_Window *windows;
+  size_t n;
+  int r;
+
+  if (buf == NULL)
+    return -ENOMEM;
+
+  r = split_list(buf, &list, &n);
+  if (r < 0)
+    return r;
+  if (n == 0)
+    {
+      *ret = NULL;
+      *ret_n = 0;
+      return 0;
+    }
+
+  windows = calloc(n, sizeof(RM_Window));
+  if (windows == NULL)
+    return -ENOMEM;
+
+  for (size_t i = 0; i < n; i++)
+    {
+      r = calendar_spec_from_string(list[i], &windows[i].start);
+      if (r < 0)
+	{
+	  rm_windows_free(windows, i);
+	  return r;
+	}
+      windows[i].duration = RM_WINDOW_DURATION_DEFAULT;
+    }
+
+  *ret = windows;
+  *ret_n = n;
+  return 0;
+}
+
+int
+rm_durations_from_string(const char *str, time_t **ret, size_t *ret_n)
+{
+  _cleanup_(freep) char *buf = strdup(str);
+  _cleanup_(freep) char **list = NULL;
+  _cleanup_(freep) time_t *durations = NULL;
+  size_t n;
+  int r;
+
+  if (buf == NULL)
+    return -ENOMEM;
+
+  r = split_list(buf, &list, &n);
+  if (r < 0)
+    return r;
+  if (n == 0)
+    return -EINVAL;
+
+  durations = calloc(n, sizeof(time_t));
+  if (durations == NULL)
+    return -ENOMEM;
+
+  for (size_t i = 0; i < n; i++)
+    if ((durations[i] = parse_duration(list[i])) == BAD_TIME)
+      return -EINVAL;
+
+  *ret = TAKE_PTR(durations);
+  *ret_n = n;
+  return 0;
+}
+
+int
+rm_windows_set_durations(RM_Window *windows, size_t n,
+			 const time_t *durations, size_t n_durations)
+{
+  if (n_durations != 1 && n_durations != n)
+    return -EINVAL;
+
+  for (size_t i = 0; i < n; i++)
+    windows[i].duration = durations[n_durations == 1 ? 0 : i];
+
+  return 0;
+}
+
+static int
+append_entry(char **list, const char *entry)
+{
+  char *p;
+
+  if (*list == NULL)
+    p = strdup(entry);
+  else if (asprintf(&p, "%s" RM_WINDOW_SEPARATOR " %s", *list, entry) < 0)
+    p = NULL;
+  if (p == NULL)
+    return -ENOMEM;
+
+  free(*list);
+  *list = p;
+  return 0;
+}
+
+/* The inverse of rm_windows_from_string() and
+   rm_durations_from_string(), if all windows have the same length,
+   only one duration is written. */
+int
+rm_windows_to_string(const RM_Window *windows, size_t n,
+		     char **ret_start, char **ret_duration)
+{
+  _cleanup_(freep) char *starts = NULL;
+  _cleanup_(freep) char *durations = NULL;
+  bool same = true;
+  int r;
+
+  for (size_t i = 1; i < n; i++)
+    if (windows[i].duration != windows[0].duration)
+      same = false;
+
+  for (size_t i = 0; i < n; i++)
+    {
+      _cleanup_(freep) char *start_str = NULL;
+
+      r = calendar_spec_to_string(windows[i].start, &start_str);
+      if (r < 0)
+	return r;
+      r = append_entry(&starts, start_str);
+      if (r < 0)
+	return r;
+
+      if (i == 0 || !same)
+	{
+	  _cleanup_(freep) const char *duration_str = NULL;
+
+	  r = rm_duration_to_string(windows[i].duration, &duration_str);
+	  if (r < 0)
+	    return r;
+	  r = append_entry(&durations, duration_str);
+	  if (r < 0)
+	    return r;
+	}
+    }
+
+  if (starts == NULL && (starts = strdup("")) == NULL)
+    return -ENOMEM;
+  if (durations == NULL && (durations = strdup("")) == NULL)
+    return -ENOMEM;
+
+  *ret_start = TAKE_PTR(starts);
+  if (ret_duration)
+    *ret_duration = TAKE_PTR(durations);
+  return 0;
+}
+
+void
+rm_window_index_reset(RM_WindowIndex *idx)
+{
+  idx->intervals = mfree(idx->intervals);
+  idx->n_intervals = 0;
+  idx->from = idx->until = idx->next = 0;
+}
+
+static int
+interval_compare(const void *_a, const void *_b)
+{
+  const RM_Interval *a = _a, *b = _b;
+
+  return a->start < b->start ? -1 : a->start > b->start;
+}
+
+static int
+append_interval(RM_Interval **list, size_t *n, size_t *size,
+		usec_t start, usec_t end)
+{
+  if (*n >= *size)
+    {
+      size_t new_size = *size > 0 ? *size * 2 : 16;
+      RM_Interval *l = reallocarray(*list, new_size, sizeof(RM_Interval));
+
+      if (l == NULL)
+	return -ENOMEM;
+      *list = l;
+      *size = new_size;
+    }
+
+  (*list)[(*n)++] = (RM_Interval) {start, end};
+  return 0;
+}
+
+/* Sort the intervals and merge those which overlap or touch each
+   other, intervals which begin at or after until are dropped. Returns
+   the new number of intervals. */
+static size_t
+merge_intervals(RM_Interval *list, size_t n, usec_t until)
+{
+  size_t j = 0;
+
+  if (n > 1)
+    qsort(list, n, sizeof(RM_Interval), interval_compare);
+
+  for (size_t i = 0; i < n && list[i].start < until; i++)
+    {
+      if (j > 0 && list[i].start <= list[j - 1].end)
+	{
+	  if (list[i].end > list[j - 1].end)
+	    list[j - 1].end = list[i].end;
+	}
+      else
+	list[j++] = list[i];
+    }
+
+  return j;
+}
+
+/* First interval which is not over at usec, n if there is none. The
+   ends are sorted like the starts after merging. */
+static size_t
+find_interval(const RM_Interval *list, size_t n, usec_t usec)
+{
+  size_t lo = 0, hi = n;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (list[mid].end > usec)
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+
+  return lo;
+}
+
+/* Cut the blackouts out of the merged windows */
+static int
+subtract_blackouts(RM_Interval **list, size_t *n,
+		   const RM_Interval *blackouts, size_t n_blackouts)
+{
+  _cleanup_(freep) RM_Interval *result = NULL;
+  size_t n_result = 0, size = 0;
+  int r;
+
+  if (n_blackouts == 0)
+    return 0;
+
+  for (size_t i = 0; i < *n; i++)
+    {
+      usec_t start = (*list)[i].start, end = (*list)[i].end;
+
+      for (size_t b = find_interval(blackouts, n_blackouts, start);
+	   b < n_blackouts && blackouts[b].start < end; b++)
+	{
+	  if (blackouts[b].start > start)
+	    {
+	      r = append_interval(&result, &n_result, &size,
+				  start, blackouts[b].start);
+	      if (r < 0)
+		return r;
+	    }
+	  start = blackouts[b].end;
+	}
+
+      if (start < end)
+	{
+	  r = append_interval(&result, &n_result, &size, start, end);
+	  if (r < 0)
+	    return r;
+	}
+    }
+
+  free(*list);
+  *list = TAKE_PTR(result);
+  *n = n_result;
+  return 0;
+}
+
+/* "YYYY-MM-DD[ HH:MM[:SS]]" in local time. A plain date is the begin
+   of the day, or with end_of_day the begin of the next one. */
+static int
+parse_local_time(const char *str, bool end_of_day, usec_t *ret)
+{
+  static const char *const formats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d"};
+
+  for (size_t i = 0; i < ELEMENTSOF(formats); i++)
+    {
+      struct tm tm = {};
+      const char *e;
+      time_t t;
+
+      e = strptime(str, formats[i], &tm);
+      if (e == NULL || *e != '\0')
+	continue;
+
+      if (end_of_day && i == ELEMENTSOF(formats) - 1)
+	tm.tm_mday++;
+      tm.tm_isdst = -1;
+      t = mktime(&tm);
+      if (t < 0)
+	return -EINVAL;
+
+      *ret = (usec_t) t * USEC_PER_SEC;
+      return 0;
+    }
+
+  return -EINVAL;
+}
+
+/* "FROM..TO" with both ends included, or a single day */
+static int
+parse_blackout(char *entry, RM_Interval **list, size_t *n, size_t *size)
+{
+  char *to = strstr(entry, "..");
+  usec_t start, end;
+  int r;
+
+  if (to == NULL)
+    to = entry;
+  else
+    {
+      char *e = to;
+
+      while (e > entry && isspace((unsigned char) e[-1]))
+	e--;
+      *e = '\0';
+      to += 2;
+      while (isspace((unsigned char) *to))
+	to++;
+    }
+
+  r = parse_local_time(entry, false, &start);
+  if (r < 0)
+    return r;
+  r = parse_local_time(to, true, &end);
+  if (r < 0)
+    return r;
+  if (end <= start)
+    return -EINVAL;
+
+  return append_interval(list, n, size, start, end);
+}
+
+/* Blackouts from a list separated by ';' and from a file with one
+   per line, both can be NULL. Empty lines and lines starting with '#'
+   in the file are ignored. The result is sorted and merged. */
+int
+rm_blackouts_from_string(const char *str, const char *file,
+			 RM_Interval **ret, size_t *ret_n)
+{
+  _cleanup_(freep) RM_Interval *list = NULL;
+  size_t n = 0, size = 0;
+  int r;
+
+  if (str != NULL)
+    {
+      _cleanup_(freep) char *buf = strdup(str);
+      _cleanup_(freep) char **entries = NULL;
+      size_t n_entries;
+
+      if (buf == NULL)
+	return -ENOMEM;
+
+      r = split_list(buf, &entries, &n_entries);
+      if (r < 0)
+	return r;
+
+      for (size_t i = 0; i < n_entries; i++)
+	{
+	  r = parse_blackout(entries[i], &list, &n, &size);
+	  if (r < 0)
+	    return r;
+	}
+    }
+
+  if (file != NULL)
+    {
+      _cleanup_(freep) char *line = NULL;
+      size_t len = 0;
+      FILE *fp;
+
+      fp = fopen(file, "re");
+      if (fp == NULL)
+	return -errno;
+
+      r = 0;
+      while (r >= 0 && getline(&line, &len, fp) > 0)
+	{
+	  char *p = line, *e;
+
+	  while (isspace((unsigned char) *p))
+	    p++;
+	  e = p + strlen(p);
+	  while (e > p && isspace((unsigned char) e[-1]))
+	    *--e = '\0';
+	  if (*p == '\0' || *p == '#')
+	    continue;
+
+	  r = parse_blackout(p, &list, &n, &size);
+	}
+      fclose(fp);
+      if (r < 0)
+	return r;
+    }
+
+  *ret_n = merge_intervals(list, n, USEC_INFINITY);
+  *ret = TAKE_PTR(list);
+  return 0;
+}
+
+/* End of the blackout usec is in, usec itself if it is in none */
+usec_t
+rm_blackout_end(const RM_Interval *blackouts, size_t n, usec_t usec)
+{
+  size_t i = find_interval(blackouts, n, usec);
+
+  if (i < n && blackouts[i].start <= usec)
+    return blackouts[i].end;
+
+  return usec;
+}
+
+/* Collect the window open at usec and all which begin before
+   usec + RM_WINDOW_INDEX_USEC. A window which is cut off by the end of
+   the range is merged with what is known, so its end can be too early
+   if another one directly follows it. */
+static int
+window_index_build(RM_WindowIndex *idx, const RM_Window *windows, size_t n,
+		   const RM_Interval *blackouts, size_t n_blackouts,
+		   usec_t usec)
+{
+  _cleanup_(freep) RM_Interval *list = NULL;
+  size_t n_list = 0, size = 0;
+  usec_t until = usec + RM_WINDOW_INDEX_USEC;
+  usec_t next = USEC_INFINITY;
+  int r;
+
+  rm_window_index_reset(idx);
+
+  for (size_t i = 0; i < n; i++)
+    {
+      usec_t duration = windows[i].duration * USEC_PER_SEC;
+      /* One which begins right at usec is not inside yet */
+      usec_t start, end, t = usec > 0 ? usec - 1 : 0;
+      unsigned count = 0;
+
+      r = calendar_spec_window_contains(windows[i].start, duration, usec,
+					&start, &end);
+      if (r < 0)
+	return r;
+      if (r > 0)
+	{
+	  r = append_interval(&list, &n_list, &size, start, end);
+	  if (r < 0)
+	    return r;
+	}
+
+      for (;;)
+	{
+	  r = calendar_spec_next_usec(windows[i].start, t, &t);
+	  if (r == -ENOENT)
+	    break;
+	  if (r < 0)
+	    return r;
+
+	  /* Too many occurrences, the range ends here */
+	  if (count++ >= RM_WINDOW_INDEX_MAX && t < until)
+	    until = t;
+	  if (t >= until)
+	    {
+	      if (t < next)
+		next = t;
+	      break;
+	    }
+
+	  r = append_interval(&list, &n_list, &size, t, t + duration);
+	  if (r < 0)
+	    return r;
+	}
+    }
+
+  n_list = merge_intervals(list, n_list, until);
+  r = subtract_blackouts(&list, &n_list, blackouts, n_blackouts);
+  if (r < 0)
+    return r;
+
+  idx->intervals = TAKE_PTR(list);
+  idx->n_intervals = n_list;
+  idx->from = usec;
+  idx->until = until;
+  idx->next = next;
+
+  return 0;
+}
+
+/* Current or next window at usec outside of the blackouts, -ENOENT if
+   there is none. The index is rebuilt if usec is outside of its range,
+   e.g. after the clock was set back. */
+int
+rm_window_find(RM_WindowIndex *idx, const RM_Window *windows, size_t n,
+	       const RM_Interval *blackouts, size_t n_blackouts,
+	       usec_t usec, usec_t *ret_start, usec_t *ret_end)
+{
+  int r;
+
+  if (n == 0)
+    return -ENOENT;
+
+  for (;;)
+    {
+      size_t lo;
+
+      if (idx->until == 0 || usec < idx->from || usec >= idx->until)
+	{
+	  r = window_index_build(idx, windows, n, blackouts, n_blackouts, usec);
+	  if (r < 0)
+	    return r;
+	}
+
+      lo = find_interval(idx->intervals, idx->n_intervals, usec);
+      if (lo < idx->n_intervals)
+	{
+	  *ret_start = idx->intervals[lo].start;
+	  *ret_end = idx->intervals[lo].end;
+	  return 0;
+	}
+
+      /* Nothing until the end of the range, continue at the next
+	 occurrence behind it */
+      if (idx->next == USEC_INFINITY)
+	return -ENOENT;
+      usec = idx->next;
+    }
+}
+
+/* Latest time a reboot can be deferred to, e.g. while the system is
+   busy: the end of the current window, or of our slot in it if the
+   window is shared by a failure domain. Only reboots waiting for a
+   window can be deferred, for forced and instant ones and outside of
+   a window this returns 0. */
+usec_t
+rm_defer_deadline(RM_CTX *ctx, usec_t curr)
+{
+  if (ctx->reboot_status != RM_REBOOTSTATUS_WAITING_WINDOW ||
+      ctx->reboot_forced || ctx->n_windows == 0)
+    return 0;
+
+  if (ctx->defer_deadline == 0)
+    {
+      usec_t start, end;
+      int r;
+
+      r = rm_window_find(&ctx->window_index, ctx->windows, ctx->n_windows,
+			 ctx->blackouts, ctx->n_blackouts, curr, &start, &end);
+      if (r < 0 || curr < start)
+	return 0;
+
+      if (ctx->domain_size > 1)
+	{
+	  usec_t offset, width;
+
+	  /* Don't run into the slots of the other members */
+	  r = rm_domain_slot(ctx->failure_domain, ctx->domain_size,
+			     ctx->domain_index, NULL, end - start,
+			     &offset, &width);
+	  if (r < 0)
+	    return 0;
+	  end = start + offset + width;
+	}
+      ctx->defer_deadline = end;
+    }
+
+  return ctx->defer_deadline;
+}
+
+/* The next count windows which begin after usec, outside of the
+   blackouts. The index cuts windows at the end of its range, so the
+   pieces are joined again: windows which overlap or touch are one.
+   Longer than the range of the index they are not joined, so that a
+   window which never closes doesn't keep this busy forever. */
+int
+rm_windows_list(const RM_Window *windows, size_t n,
+		const RM_Interval *blackouts, size_t n_blackouts,
+		usec_t usec, size_t count, RM_Interval **ret, size_t *ret_n)
+{
+  _cleanup_(rm_window_index_reset) RM_WindowIndex idx = {};
+  _cleanup_(freep) RM_Interval *list = NULL;
+  size_t n_list = 0, size = 0;
+  RM_Interval cur = {0, 0};
+  usec_t t = usec;
+  int r;
+
+  while (n_list < count)
+    {
+      usec_t start, end;
+
+      r = rm_window_find(&idx, windows, n, blackouts, n_blackouts, t,
+			 &start, &end);
+      if (r == -ENOENT)
+	break;
+      if (r < 0)
+	return r;
+
+      if (cur.end > 0 && start <= cur.end &&
+	  cur.end - cur.start < RM_WINDOW_INDEX_USEC)
+	{
+	  if (end > cur.end)
+	    cur.end = end;
+	}
+      else
+	{
+	  /* Only windows which begin after usec */
+	  if (cur.end > 0 && cur.start > usec)
+	    {
+	      r = append_interval(&list, &n_list, &size, cur.start, cur.end);
+	      if (r < 0)
+		return r;
+	    }
+	  cur = (RM_Interval) {start, end};
+	}
+      t = end;
+    }
+
+  if (n_list < count && cur.end > 0 && cur.start > usec)
+    {
+      r = append_interval(&list, &n_list, &size, cur.start, cur.end);
+      if (r < 0)
+	return r;
+    }
+
+  *ret = TAKE_PTR(list);
+  *ret_n = n_list;
+
+  return 0;
+}
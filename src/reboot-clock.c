@@ -0,0 +1,136 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* The reboot time is calculated in local time when the reboot is
+   requested. If the clock is set or /etc/localtime is replaced later,
+   the time has to be calculated again. A timerfd with
+   TFD_TIMER_CANCEL_ON_SET reports every change of CLOCK_REALTIME
+   which is not a normal tick, inotify the change of the time zone. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-clock.h"
+
+#define LOCALTIME_DIR  "/etc"
+#define LOCALTIME_NAME "localtime"
+
+/* Never expires, only canceled by a change of the clock */
+static int
+arm_timerfd(int fd)
+{
+  struct itimerspec its = {
+    .it_value.tv_sec = TIME_T_MAX,
+  };
+
+  if (timerfd_settime(fd, TFD_TIMER_ABSTIME|TFD_TIMER_CANCEL_ON_SET, &its, NULL) < 0)
+    return -errno;
+
+  return 0;
+}
+
+static int
+clock_handler(sd_event_source _unused_(*s), int fd, uint32_t _unused_(revents),
+	      void *userdata)
+{
+  RM_CTX *ctx = userdata;
+  uint64_t expirations;
+  int r;
+
+  /* fails with ECANCELED after the clock was set */
+  if (read(fd, &expirations, sizeof(expirations)) < 0 && errno == EAGAIN)
+    return 0;
+
+  r = arm_timerfd(fd);
+  if (r < 0)
+    log_msg(LOG_WARNING, "Cannot watch the system clock anymore: %s", strerror(-r));
+
+  log_msg(LOG_INFO, "System clock changed");
+  ctx->clock_fn(ctx);
+
+  return 0;
+}
+
+static int
+localtime_handler(sd_event_source _unused_(*s), const struct inotify_event *event,
+		  void *userdata)
+{
+  RM_CTX *ctx = userdata;
+
+  if (event->len == 0 || strcmp(event->name, LOCALTIME_NAME) != 0)
+    return 0;
+
+  /* glibc reads the file again if it changed */
+  tzset();
+
+  log_msg(LOG_INFO, "Time zone changed");
+  ctx->clock_fn(ctx);
+
+  return 0;
+}
+
+int
+rm_clock_watch(RM_CTX *ctx, void (*fn)(RM_CTX *ctx))
+{
+  int fd, r;
+
+  ctx->clock_fn = fn;
+
+  fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK|TFD_CLOEXEC);
+  if (fd < 0)
+    return -errno;
+
+  r = arm_timerfd(fd);
+  if (r >= 0)
+    r = sd_event_add_io(ctx->loop, &ctx->clock_event, fd, EPOLLIN,
+			clock_handler, ctx);
+  if (r < 0)
+    {
+      close(fd);
+      return r;
+    }
+  sd_event_source_set_io_fd_own(ctx->clock_event, true);
+
+  /* /etc/localtime is a symlink, which gets replaced */
+  r = sd_event_add_inotify(ctx->loop, &ctx->localtime_event, LOCALTIME_DIR,
+			   IN_CLOSE_WRITE|IN_MOVED_TO|IN_CREATE|IN_DELETE|
+			   IN_ATTRIB|IN_DONT_FOLLOW|IN_ONLYDIR,
+			   localtime_handler, ctx);
+  if (r < 0)
+    log_msg(LOG_WARNING, "Cannot watch "LOCALTIME_DIR"/"LOCALTIME_NAME": %s",
+	    strerror(-r));
+
+  return 0;
+}
+
+void
+rm_clock_done(RM_CTX *ctx)
+{
+  ctx->clock_event = sd_event_source_disable_unref(ctx->clock_event);
+  ctx->localtime_event = sd_event_source_disable_unref(ctx->localtime_event);
+}
@@ -0,0 +1,9 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "rebootmgr.h"
+
+/* Call fn whenever the system clock is set or the time zone changes */
+extern int rm_clock_watch(RM_CTX *ctx, void (*fn)(RM_CTX *ctx));
+extern void rm_clock_done(RM_CTX *ctx);
@@ -0,0 +1,261 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* The reboot is requested from logind with RebootWithFlags() from
+   inside of the event loop. Only if this fails, /usr/bin/systemctl is
+   called like before, and its exit status is collected. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/pidfd.h>
+#include <sys/wait.h>
+#include <systemd/sd-bus.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-exec.h"
+#include "reboot-lock.h"
+
+/* Flags of RebootWithFlags(), see org.freedesktop.login1(5). Without
+   SD_LOGIND_SOFT_REBOOT_IF_NEXTROOT_SET_UP logind never switches to a
+   soft-reboot on its own, which is what systemctl does if
+   SYSTEMCTL_SKIP_AUTO_SOFT_REBOOT is set. */
+#define SD_LOGIND_REBOOT_VIA_KEXEC (UINT64_C(1) << 1)
+#define SD_LOGIND_SOFT_REBOOT      (UINT64_C(1) << 2)
+
+static const char *
+method_to_verb(RM_RebootMethod method)
+{
+  switch (method)
+    {
+    case RM_REBOOTMETHOD_SOFT:
+      return "soft-reboot";
+    case RM_REBOOTMETHOD_KEXEC:
+      return "kexec";
+    default:
+      return "reboot";
+    }
+}
+
+static uint64_t
+method_to_flags(RM_RebootMethod method)
+{
+  switch (method)
+    {
+    case RM_REBOOTMETHOD_SOFT:
+      return SD_LOGIND_SOFT_REBOOT;
+    case RM_REBOOTMETHOD_KEXEC:
+      return SD_LOGIND_REBOOT_VIA_KEXEC;
+    default:
+      return 0;
+    }
+}
+
+static void
+exec_finished(RM_CTX *ctx, int result)
+{
+  ctx->exec_result = result;
+  if (ctx->exec_fn)
+    ctx->exec_fn(ctx, result);
+}
+
+/* The reboot failed for good, let the other machines go */
+static void
+exec_failed(RM_CTX *ctx, int error)
+{
+  rm_lock_release(ctx);
+  exec_finished(ctx, error);
+}
+
+static int
+systemctl_handler(sd_event_source _unused_(*s), const siginfo_t *si,
+		  void *userdata)
+{
+  RM_CTX *ctx = userdata;
+
+  ctx->exec_child = sd_event_source_unref(ctx->exec_child);
+
+  if (si->si_code == CLD_EXITED && si->si_status == 0)
+    {
+      exec_finished(ctx, 0);
+      return 0;
+    }
+
+  log_msg(LOG_ERR, "/usr/bin/systemctl %s failed with %s %i",
+	  method_to_verb(ctx->exec_method),
+	  si->si_code == CLD_EXITED ? "exit status" : "signal", si->si_status);
+  exec_failed(ctx, -EPROTO);
+
+  return 0;
+}
+
+static int
+exec_systemctl(RM_CTX *ctx)
+{
+  pid_t pid;
+  int pidfd, r;
+
+  pid = fork();
+  if (pid < 0)
+    {
+      r = -errno;
+      log_msg(LOG_ERR, "Calling /usr/bin/systemctl failed: %m");
+      return r;
+    }
+  if (pid == 0)
+    {
+      if (ctx->exec_method == RM_REBOOTMETHOD_HARD)
+	{
+	  char envar1[] = "SYSTEMCTL_SKIP_AUTO_SOFT_REBOOT=1";
+	  char *env[] = {envar1, NULL};
+
+	  execle("/usr/bin/systemctl", "systemctl", "reboot", NULL, env);
+	}
+      else
+	execl("/usr/bin/systemctl", "systemctl",
+	      method_to_verb(ctx->exec_method), NULL);
+
+      log_msg(LOG_ERR, "Calling /usr/bin/systemctl %s failed: %m",
+	      method_to_verb(ctx->exec_method));
+      _exit(1);
+    }
+
+  /* A pidfd doesn't need SIGCHLD to be blocked */
+  pidfd = pidfd_open(pid, 0);
+  if (pidfd < 0)
+    {
+      r = -errno;
+      log_msg(LOG_WARNING, "Cannot watch /usr/bin/systemctl: %s", strerror(-r));
+      exec_finished(ctx, 0); /* unknown, but don't block further reboots */
+      return 0;
+    }
+
+  r = sd_event_add_child_pidfd(ctx->loop, &ctx->exec_child, pidfd, WEXITED,
+			       systemctl_handler, ctx);
+  if (r < 0)
+    {
+      close(pidfd);
+      log_msg(LOG_WARNING, "Cannot watch /usr/bin/systemctl: %s", strerror(-r));
+      exec_finished(ctx, 0); /* unknown, but don't block further reboots */
+      return 0;
+    }
+  sd_event_source_set_child_pidfd_own(ctx->exec_child, true);
+
+  return 0;
+}
+
+static int
+logind_handler(sd_bus_message *m, void *userdata, sd_bus_error _unused_(*ret_error))
+{
+  RM_CTX *ctx = userdata;
+  const sd_bus_error *e;
+  int r;
+
+  ctx->exec_slot = sd_bus_slot_unref(ctx->exec_slot);
+
+  e = sd_bus_message_get_error(m);
+  if (e == NULL)
+    {
+      if (debug_flag)
+	log_msg(LOG_DEBUG, "logind accepted %s", method_to_verb(ctx->exec_method));
+      exec_finished(ctx, 0);
+      return 0;
+    }
+
+  log_msg(LOG_WARNING, "logind refused %s, calling systemctl: %s",
+	  method_to_verb(ctx->exec_method), e->message ? e->message : e->name);
+
+  r = exec_systemctl(ctx);
+  if (r < 0)
+    exec_failed(ctx, r);
+
+  return 0;
+}
+
+int
+rm_bus_connect(RM_CTX *ctx)
+{
+  int r;
+
+  if (ctx->bus)
+    return 0;
+
+  r = sd_bus_open_system(&ctx->bus);
+  if (r < 0)
+    return r;
+
+  r = sd_bus_attach_event(ctx->bus, ctx->loop, SD_EVENT_PRIORITY_NORMAL);
+  if (r < 0)
+    ctx->bus = sd_bus_flush_close_unref(ctx->bus);
+
+  return r;
+}
+
+static int
+exec_logind(RM_CTX *ctx)
+{
+  int r;
+
+  r = rm_bus_connect(ctx);
+  if (r < 0)
+    return r;
+
+  return sd_bus_call_method_async(ctx->bus, &ctx->exec_slot,
+				  "org.freedesktop.login1",
+				  "/org/freedesktop/login1",
+				  "org.freedesktop.login1.Manager",
+				  "RebootWithFlags",
+				  logind_handler, ctx, "t",
+				  method_to_flags(ctx->exec_method));
+}
+
+int
+rm_exec_reboot(RM_CTX *ctx, RM_RebootMethod method, rm_exec_fn fn)
+{
+  int r;
+
+  if (ctx->exec_result > 0)
+    return -EBUSY;
+
+  ctx->exec_method = method;
+  ctx->exec_result = 1;
+  ctx->exec_fn = fn;
+
+  r = exec_logind(ctx);
+  if (r >= 0)
+    return 0;
+
+  log_msg(LOG_WARNING, "Cannot call logind, calling systemctl: %s", strerror(-r));
+  r = exec_systemctl(ctx);
+  if (r < 0)
+    exec_failed(ctx, r);
+
+  return r;
+}
+
+void
+rm_exec_done(RM_CTX *ctx)
+{
+  ctx->exec_slot = sd_bus_slot_unref(ctx->exec_slot);
+  ctx->exec_child = sd_event_source_unref(ctx->exec_child);
+  ctx->bus = sd_bus_flush_close_unref(ctx->bus);
+}
@@ -0,0 +1,17 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "rebootmgr.h"
+
+/* Called with 0 if logind or systemctl accepted the reboot, else
+   with a negative errno */
+typedef void (*rm_exec_fn)(RM_CTX *ctx, int result);
+
+/* Start the reboot via logind, falling back to systemctl. This returns
+   as soon as the request is sent, ctx->exec_result gets the result and
+   fn is called with it. */
+extern int rm_exec_reboot(RM_CTX *ctx, RM_RebootMethod method, rm_exec_fn fn);
+extern void rm_exec_done(RM_CTX *ctx);
+/* Connect ctx->bus to the system bus, if not done yet */
+extern int rm_bus_connect(RM_CTX *ctx);
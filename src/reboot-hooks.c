@@ -0,0 +1,117 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Executables in RM_HOOKS_DIR are run in parallel after the reboot
+   lock was acquired. They can drain a node, stop a database or check
+   a cluster, every hook which fails or doesn't finish in time vetoes
+   the reboot. */
+
+#include "config.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-hooks.h"
+#include "reboot-task.h"
+
+/* Runs in the child, the method is passed as argument and in
+   the environment */
+static int
+run_hook(const RM_CTX *ctx, const char *path)
+{
+  const char *method;
+
+  if (rm_method_to_str(ctx->reboot_method, &method) < 0 ||
+      setenv("REBOOTMGR_METHOD", method, 1) < 0)
+    return 1;
+
+  execl(path, path, method, NULL);
+  return 1;
+}
+
+static int
+hook_filter(const struct dirent *d)
+{
+  size_t len = strlen(d->d_name);
+
+  /* hidden files, backup files of editors and rpm leftovers */
+  if (d->d_name[0] == '.' || d->d_name[len - 1] == '~' ||
+      strstr(d->d_name, ".rpm") != NULL)
+    return 0;
+
+  return 1;
+}
+
+int
+rm_hooks_start(RM_CTX *ctx)
+{
+  RM_TaskSet *set = &ctx->hooks;
+  struct dirent **list = NULL;
+  int n, r, ret = 0;
+  int started = 0;
+
+  /* Results of the last attempt */
+  rm_task_set_reset(set);
+
+  n = scandir(RM_HOOKS_DIR, &list, hook_filter, alphasort);
+  if (n < 0)
+    return errno == ENOENT ? 0 : -errno;
+
+  for (int i = 0; i < n; i++)
+    {
+      _cleanup_(freep) char *path = NULL;
+      struct stat st;
+
+      if (ret == 0 &&
+	  asprintf(&path, "%s/%s", RM_HOOKS_DIR, list[i]->d_name) < 0)
+	ret = -ENOMEM;
+
+      if (ret == 0 && stat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+	  access(path, X_OK) == 0)
+	{
+	  r = rm_task_start(set, list[i]->d_name, run_hook, path,
+			    (usec_t) ctx->hook_timeout * USEC_PER_SEC);
+	  if (r < 0)
+	    ret = r;
+	  else
+	    started++;
+	}
+      free(list[i]);
+    }
+  free(list);
+
+  if (ret < 0)
+    {
+      /* Don't reboot with only a part of the hooks */
+      rm_task_set_reset(set);
+      return ret;
+    }
+
+  if (started > 0)
+    log_msg(LOG_INFO, "Started %i reboot hook(s)", started);
+
+  return started;
+}
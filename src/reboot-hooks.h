@@ -0,0 +1,9 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "rebootmgr.h"
+
+/* Start every executable in RM_HOOKS_DIR as task of ctx->hooks.
+   Returns the number of started hooks, 0 if there is none. */
+extern int rm_hooks_start(RM_CTX *ctx);
@@ -0,0 +1,180 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Backup jobs and the like take a "shutdown" block inhibitor of
+   logind. A reboot in the maintenance window waits until all of them
+   are gone: the inhibitors are listed again whenever logind reports
+   a change of BlockInhibited. The match for these changes is in place
+   before the first listing, so no release in between gets lost. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <systemd/sd-bus.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-exec.h"
+#include "reboot-inhibit.h"
+
+/* what is a colon separated list like "shutdown:sleep" */
+static bool
+blocks_shutdown(const char *what, const char *mode)
+{
+  size_t len = strlen("shutdown");
+
+  if (strcmp(mode, "block") != 0)
+    return false;
+
+  for (const char *p = what; p; p = strchr(p, ':'))
+    {
+      if (*p == ':')
+	p++;
+      if (strncmp(p, "shutdown", len) == 0 &&
+	  (p[len] == '\0' || p[len] == ':'))
+	return true;
+    }
+
+  return false;
+}
+
+static int list_inhibitors(RM_CTX *ctx);
+
+static int
+changed_handler(sd_bus_message _unused_(*m), void *userdata,
+		sd_bus_error _unused_(*ret_error))
+{
+  RM_CTX *ctx = userdata;
+  int r;
+
+  /* An answer is on the way already */
+  if (ctx->inhibit_call)
+    return 0;
+
+  r = list_inhibitors(ctx);
+  if (r < 0)
+    {
+      rm_inhibit_reset(ctx);
+      ctx->inhibit_fn(ctx, r);
+    }
+
+  return 0;
+}
+
+static int
+list_handler(sd_bus_message *m, void *userdata, sd_bus_error _unused_(*ret_error))
+{
+  RM_CTX *ctx = userdata;
+  const char *what, *who, *why, *mode;
+  uint32_t uid, pid;
+  int r, n = 0;
+
+  ctx->inhibit_call = sd_bus_slot_unref(ctx->inhibit_call);
+
+  r = sd_bus_message_get_errno(m);
+  if (r > 0)
+    r = -r;
+  else
+    r = sd_bus_message_enter_container(m, 'a', "(ssssuu)");
+
+  while (r >= 0 &&
+	 (r = sd_bus_message_read(m, "(ssssuu)", &what, &who, &why, &mode, &uid, &pid)) > 0)
+    if (blocks_shutdown(what, mode))
+      {
+	/* Only once, not after every change */
+	if (!ctx->inhibit_logged)
+	  log_msg(LOG_NOTICE, "Reboot blocked by %s (PID %u, UID %u): %s",
+		  who, pid, uid, why);
+	n++;
+      }
+  if (r >= 0)
+    r = sd_bus_message_exit_container(m);
+  ctx->inhibit_logged = true;
+
+  if (r < 0 || n == 0)
+    rm_inhibit_reset(ctx);
+
+  /* Last, this can free everything */
+  ctx->inhibit_fn(ctx, r < 0 ? r : n);
+
+  return 0;
+}
+
+static int
+list_inhibitors(RM_CTX *ctx)
+{
+  return sd_bus_call_method_async(ctx->bus, &ctx->inhibit_call,
+				  "org.freedesktop.login1",
+				  "/org/freedesktop/login1",
+				  "org.freedesktop.login1.Manager",
+				  "ListInhibitors",
+				  list_handler, ctx, NULL);
+}
+
+/* The match is active now, list the inhibitors for the first time */
+static int
+installed_handler(sd_bus_message *m, void *userdata,
+		  sd_bus_error _unused_(*ret_error))
+{
+  RM_CTX *ctx = userdata;
+  int r;
+
+  r = sd_bus_message_get_errno(m);
+  if (r > 0)
+    r = -r;
+  else if (ctx->inhibit_call == NULL) /* else a change came first */
+    r = list_inhibitors(ctx);
+
+  if (r < 0)
+    {
+      rm_inhibit_reset(ctx);
+      ctx->inhibit_fn(ctx, r);
+    }
+
+  return 0;
+}
+
+int
+rm_inhibit_watch(RM_CTX *ctx, rm_inhibit_fn fn)
+{
+  int r;
+
+  rm_inhibit_reset(ctx);
+
+  r = rm_bus_connect(ctx);
+  if (r < 0)
+    return r;
+
+  ctx->inhibit_fn = fn;
+  return sd_bus_match_signal_async(ctx->bus, &ctx->inhibit_match,
+				   "org.freedesktop.login1",
+				   "/org/freedesktop/login1",
+				   "org.freedesktop.DBus.Properties",
+				   "PropertiesChanged",
+				   changed_handler, installed_handler, ctx);
+}
+
+void
+rm_inhibit_reset(RM_CTX *ctx)
+{
+  ctx->inhibit_call = sd_bus_slot_unref(ctx->inhibit_call);
+  ctx->inhibit_match = sd_bus_slot_unref(ctx->inhibit_match);
+  ctx->inhibit_logged = false;
+}
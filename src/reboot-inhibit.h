@@ -0,0 +1,13 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "rebootmgr.h"
+
+/* Called with the number of "shutdown" block inhibitors of logind,
+   again after every change until there is none left, or with a
+   negative errno */
+typedef void (*rm_inhibit_fn)(RM_CTX *ctx, int blocked);
+
+extern int rm_inhibit_watch(RM_CTX *ctx, rm_inhibit_fn fn);
+extern void rm_inhibit_reset(RM_CTX *ctx);
@@ -0,0 +1,168 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Load the kernel for a kexec reboot when the reboot gets scheduled,
+   so that only "systemctl kexec" is left when the timer fires. The
+   kernel is loaded with kexec_file_load(), so the kernel checks the
+   signature of the image if Secure Boot is enabled. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/kexec.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-kexec.h"
+
+#define KEXEC_LOADED_FILE "/sys/kernel/kexec_loaded"
+#define CMDLINE_MAX 4096
+
+/* Use the command line of the running kernel, without the options
+   the boot loader added for this boot only */
+static int
+read_cmdline(char *buf, size_t size)
+{
+  char line[CMDLINE_MAX];
+  char *sp, *tok;
+  size_t len = 0;
+  FILE *fp;
+
+  fp = fopen("/proc/cmdline", "re");
+  if (fp == NULL)
+    return -errno;
+  if (fgets(line, sizeof(line), fp) == NULL)
+    {
+      fclose(fp);
+      return -EIO;
+    }
+  fclose(fp);
+
+  buf[0] = '\0';
+  for (tok = strtok_r(line, " \t\n", &sp); tok; tok = strtok_r(NULL, " \t\n", &sp))
+    {
+      if (strncmp(tok, "BOOT_IMAGE=", 11) == 0 ||
+	  strncmp(tok, "initrd=", 7) == 0)
+	continue;
+
+      int n = snprintf(buf + len, size - len, "%s%s", len > 0 ? " " : "", tok);
+      if (n < 0 || (size_t) n >= size - len)
+	return -E2BIG;
+      len += n;
+    }
+
+  return 0;
+}
+
+int
+rm_kexec_load(const RM_CTX *ctx)
+{
+  const char *kernel = ctx->kexec_kernel ? ctx->kexec_kernel : RM_KEXEC_KERNEL;
+  const char *initrd = ctx->kexec_initrd ? ctx->kexec_initrd : RM_KEXEC_INITRD;
+  char buf[CMDLINE_MAX];
+  const char *cmdline;
+  unsigned long flags = 0;
+  int kernel_fd, initrd_fd;
+  int r;
+
+  if (ctx->kexec_cmdline)
+    cmdline = ctx->kexec_cmdline;
+  else
+    {
+      r = read_cmdline(buf, sizeof(buf));
+      if (r < 0)
+	{
+	  log_msg(LOG_ERR, "Cannot read kernel command line: %s", strerror(-r));
+	  return r;
+	}
+      cmdline = buf;
+    }
+
+  kernel_fd = open(kernel, O_RDONLY|O_CLOEXEC);
+  if (kernel_fd < 0)
+    {
+      r = -errno;
+      log_msg(LOG_ERR, "Cannot open kernel '%s': %s", kernel, strerror(-r));
+      return r;
+    }
+
+  initrd_fd = open(initrd, O_RDONLY|O_CLOEXEC);
+  if (initrd_fd < 0)
+    {
+      /* The configured one has to exist */
+      if (errno != ENOENT || ctx->kexec_initrd)
+	{
+	  r = -errno;
+	  log_msg(LOG_ERR, "Cannot open initrd '%s': %s", initrd, strerror(-r));
+	  close(kernel_fd);
+	  return r;
+	}
+      flags |= KEXEC_FILE_NO_INITRAMFS;
+    }
+
+  if (syscall(SYS_kexec_file_load, kernel_fd, initrd_fd,
+	      strlen(cmdline) + 1, cmdline, flags) < 0)
+    {
+      r = -errno;
+      log_msg(LOG_ERR, "Loading kernel '%s' for kexec failed: %s",
+	      kernel, strerror(-r));
+    }
+  else
+    {
+      r = 0;
+      if (debug_flag)
+	log_msg(LOG_DEBUG, "Loaded kernel '%s' for kexec with \"%s\"",
+		kernel, cmdline);
+    }
+
+  close(kernel_fd);
+  if (initrd_fd >= 0)
+    close(initrd_fd);
+
+  return r;
+}
+
+int
+rm_kexec_unload(void)
+{
+  if (syscall(SYS_kexec_file_load, -1, -1, 0, NULL, KEXEC_FILE_UNLOAD) < 0)
+    return -errno;
+
+  return 0;
+}
+
+bool
+rm_kexec_loaded(void)
+{
+  FILE *fp;
+  int c;
+
+  fp = fopen(KEXEC_LOADED_FILE, "re");
+  if (fp == NULL)
+    return false;
+  c = fgetc(fp);
+  fclose(fp);
+
+  return c == '1';
+}
@@ -0,0 +1,16 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "rebootmgr.h"
+
+/* Default kernel and initrd, on openSUSE these are symlinks to the
+   newest installed kernel */
+#define RM_KEXEC_KERNEL "/boot/vmlinuz"
+#define RM_KEXEC_INITRD "/boot/initrd"
+
+extern int rm_kexec_load(const RM_CTX *ctx);
+extern int rm_kexec_unload(void);
+extern bool rm_kexec_loaded(void);
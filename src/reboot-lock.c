@@ -0,0 +1,235 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <systemd/sd-varlink.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-lock.h"
+
+static const char *
+lock_group(const RM_CTX *ctx)
+{
+  return ctx->lock_group ? ctx->lock_group : RM_LOCK_GROUP_DEFAULT;
+}
+
+/* Call a method of org.openSUSE.rebootmgr.Lock from inside of the event
+   loop, reply gets the answer. Connecting doesn't block either, a slow
+   or unreachable server only delays the reply until the timeout. */
+static int
+varlink_lock_call(RM_CTX *ctx, sd_varlink **ret, const char *method,
+		  const char *holder, sd_varlink_reply_t reply)
+{
+  _cleanup_(sd_varlink_close_unrefp) sd_varlink *link = NULL;
+  int r;
+
+  /* A plain path or an URL like "ssh-unix:host:/path" */
+  if (ctx->lock_server[0] == '/')
+    r = sd_varlink_connect_address(&link, ctx->lock_server);
+  else
+    r = sd_varlink_connect_url(&link, ctx->lock_server);
+  if (r < 0)
+    {
+      log_msg(LOG_ERR, "Failed to connect to lock server %s: %s",
+	      ctx->lock_server, strerror(-r));
+      return r;
+    }
+
+  sd_varlink_set_userdata(link, ctx);
+
+  r = sd_varlink_set_relative_timeout(link, RM_LOCK_TIMEOUT_USEC);
+  if (r >= 0)
+    r = sd_varlink_attach_event(link, ctx->loop, SD_EVENT_PRIORITY_NORMAL);
+  if (r >= 0)
+    r = sd_varlink_bind_reply(link, reply);
+  if (r >= 0)
+    r = sd_varlink_invokebo(link, method,
+			    SD_JSON_BUILD_PAIR_STRING("Group", lock_group(ctx)),
+			    SD_JSON_BUILD_PAIR_STRING("Holder", holder));
+  if (r < 0)
+    {
+      log_msg(LOG_ERR, "Failed to call %s: %s", method, strerror(-r));
+      return r;
+    }
+
+  *ret = TAKE_PTR(link);
+  return 0;
+}
+
+/* The boolean field of a reply, or a negative errno */
+static int
+varlink_lock_result(sd_json_variant *parameters, const char *error_id,
+		    const char *method, const char *field)
+{
+  sd_json_variant *v;
+
+  if (error_id && strlen(error_id) > 0)
+    {
+      log_msg(LOG_ERR, "Calling %s failed: %s", method, error_id);
+      return -EIO;
+    }
+
+  v = sd_json_variant_by_key(parameters, field);
+  if (v == NULL || !sd_json_variant_is_boolean(v))
+    return -EBADMSG;
+
+  return sd_json_variant_boolean(v);
+}
+
+static int
+acquire_reply(sd_varlink _unused_(*link), sd_json_variant *parameters,
+	      const char *error_id, sd_varlink_reply_flags_t _unused_(flags),
+	      void *userdata)
+{
+  RM_CTX *ctx = userdata;
+  int r;
+
+  r = varlink_lock_result(parameters, error_id,
+			  "org.openSUSE.rebootmgr.Lock.Acquire", "Acquired");
+  ctx->lock_call = sd_varlink_close_unref(ctx->lock_call);
+
+  if (r > 0)
+    {
+      ctx->lock_held = true;
+      if (debug_flag)
+	log_msg(LOG_DEBUG, "Got reboot lock of group %s", lock_group(ctx));
+    }
+
+  if (ctx->lock_fn)
+    ctx->lock_fn(ctx, r);
+
+  return 0;
+}
+
+static int
+release_reply(sd_varlink _unused_(*link), sd_json_variant *parameters,
+	      const char *error_id, sd_varlink_reply_flags_t _unused_(flags),
+	      void *userdata)
+{
+  RM_CTX *ctx = userdata;
+  int r;
+
+  r = varlink_lock_result(parameters, error_id,
+			  "org.openSUSE.rebootmgr.Lock.Release", "Released");
+  ctx->unlock_call = sd_varlink_close_unref(ctx->unlock_call);
+
+  if (r < 0)
+    log_msg(LOG_WARNING, "Failed to release reboot lock: %s", strerror(-r));
+
+  return 0;
+}
+
+static int
+varlink_acquire(RM_CTX *ctx, const char *holder)
+{
+  return varlink_lock_call(ctx, &ctx->lock_call,
+			   "org.openSUSE.rebootmgr.Lock.Acquire", holder,
+			   acquire_reply);
+}
+
+static int
+varlink_release(RM_CTX *ctx, const char *holder)
+{
+  return varlink_lock_call(ctx, &ctx->unlock_call,
+			   "org.openSUSE.rebootmgr.Lock.Release", holder,
+			   release_reply);
+}
+
+static const RM_LockBackend lock_backend_varlink = {
+  .name = "varlink",
+  .acquire = varlink_acquire,
+  .release = varlink_release,
+};
+
+static const RM_LockBackend *
+get_backend(const RM_CTX *ctx)
+{
+  if (ctx->lock_server == NULL)
+    return NULL;
+
+  return &lock_backend_varlink;
+}
+
+/* Machines are identified by their hostname */
+static int
+get_holder(char *buf, size_t size)
+{
+  if (gethostname(buf, size) < 0)
+    return -errno;
+  buf[size - 1] = '\0';
+
+  return 0;
+}
+
+int
+rm_lock_acquire(RM_CTX *ctx, rm_lock_fn fn)
+{
+  const RM_LockBackend *backend = get_backend(ctx);
+  char holder[HOST_NAME_MAX + 1];
+  int r;
+
+  if (backend == NULL)
+    return 1;
+
+  if (ctx->lock_call)
+    return -EBUSY;
+
+  r = get_holder(holder, sizeof(holder));
+  if (r < 0)
+    return r;
+
+  ctx->lock_fn = fn;
+  return backend->acquire(ctx, holder);
+}
+
+void
+rm_lock_release(RM_CTX *ctx)
+{
+  const RM_LockBackend *backend = get_backend(ctx);
+  char holder[HOST_NAME_MAX + 1];
+  int r;
+
+  /* The answer doesn't matter anymore, the Release covers it */
+  ctx->lock_call = sd_varlink_close_unref(ctx->lock_call);
+  ctx->lock_held = false;
+
+  if (backend == NULL)
+    return;
+
+  ctx->unlock_call = sd_varlink_close_unref(ctx->unlock_call);
+
+  r = get_holder(holder, sizeof(holder));
+  if (r >= 0)
+    r = backend->release(ctx, holder);
+  if (r < 0)
+    log_msg(LOG_WARNING, "Failed to release reboot lock: %s", strerror(-r));
+}
+
+void
+rm_lock_done(RM_CTX *ctx)
+{
+  ctx->lock_call = sd_varlink_close_unref(ctx->lock_call);
+  ctx->unlock_call = sd_varlink_flush_close_unref(ctx->unlock_call);
+}
@@ -0,0 +1,28 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "rebootmgr.h"
+
+/* A reboot lock limits how many machines of a group reboot at the
+   same time. Every backend hands out a fixed number of slots per
+   group. The calls don't block, acquire() and release() only send
+   the request and return 0 or a negative errno. */
+typedef struct RM_LockBackend {
+  const char *name;
+  int (*acquire)(RM_CTX *ctx, const char *holder);
+  int (*release)(RM_CTX *ctx, const char *holder);
+} RM_LockBackend;
+
+/* Called with 1 if the holder owns a slot now, 0 if all are taken,
+   or a negative errno */
+typedef void (*rm_lock_fn)(RM_CTX *ctx, int acquired);
+
+/* Without a configured lock server, acquiring always succeeds and
+   this returns 1. Else 0 is returned and fn gets the answer later,
+   or a negative errno if the request cannot be sent. */
+extern int rm_lock_acquire(RM_CTX *ctx, rm_lock_fn fn);
+/* Give the slot back, without waiting for the answer. A running
+   acquire is cancelled. */
+extern void rm_lock_release(RM_CTX *ctx);
+extern void rm_lock_done(RM_CTX *ctx);
@@ -0,0 +1,148 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Work which would otherwise be done while the machine goes down is
+   done some time before the reboot: writing dirty pages, flushing the
+   journal, loading the kexec kernel and stopping services via units
+   configured by the admin. Every step is a task in its own process,
+   so they run in parallel and don't block the event loop. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <mntent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-kexec.h"
+#include "reboot-prepare.h"
+#include "reboot-task.h"
+
+#define PREPARE_UNITS_MAX 64
+
+/* The step functions run in the child, they return the exit status */
+static int
+step_sync(const RM_CTX _unused_(*ctx), const char _unused_(*arg))
+{
+  struct mntent *m;
+  FILE *fp;
+  int ret = 0;
+
+  fp = setmntent("/proc/self/mounts", "re");
+  if (fp == NULL)
+    {
+      sync();
+      return 0;
+    }
+
+  while ((m = getmntent(fp)) != NULL)
+    {
+      int fd = open(m->mnt_dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NONBLOCK);
+      if (fd < 0)
+	continue;
+      if (syncfs(fd) < 0)
+	ret = 1;
+      close(fd);
+    }
+  endmntent(fp);
+
+  return ret;
+}
+
+static int
+step_journal(const RM_CTX _unused_(*ctx), const char _unused_(*arg))
+{
+  execl("/usr/bin/journalctl", "journalctl", "--flush", NULL);
+  return 1;
+}
+
+static int
+step_kexec(const RM_CTX *ctx, const char _unused_(*arg))
+{
+  return rm_kexec_load(ctx) < 0;
+}
+
+static int
+step_units(const RM_CTX *ctx, const char _unused_(*arg))
+{
+  char *argv[PREPARE_UNITS_MAX + 4];
+  char *units, *sp, *tok;
+  size_t n = 0;
+
+  units = strdup(ctx->prepare_units);
+  if (units == NULL)
+    return 1;
+
+  argv[n++] = "systemctl";
+  argv[n++] = "start";
+  argv[n++] = "--";
+  for (tok = strtok_r(units, " \t", &sp); tok && n < PREPARE_UNITS_MAX + 3;
+       tok = strtok_r(NULL, " \t", &sp))
+    argv[n++] = tok;
+  argv[n] = NULL;
+
+  execv("/usr/bin/systemctl", argv);
+  return 1;
+}
+
+int
+rm_prepare_start(RM_CTX *ctx, usec_t deadline)
+{
+  RM_TaskSet *set = &ctx->prepare;
+  int r, ret = 0;
+
+  /* Already done for this reboot */
+  if (set->n_tasks > 0)
+    return 0;
+
+  log_msg(LOG_INFO, "Preparing reboot");
+
+  r = rm_task_start(set, "sync", step_sync, NULL, deadline);
+  if (r < 0)
+    ret = r;
+  r = rm_task_start(set, "journal", step_journal, NULL, deadline);
+  if (r < 0)
+    ret = r;
+
+  /* Nothing of the system is changed in debug mode */
+  if (!debug_flag)
+    {
+      if (ctx->reboot_method == RM_REBOOTMETHOD_KEXEC)
+	{
+	  r = rm_task_start(set, "kexec", step_kexec, NULL, deadline);
+	  if (r < 0)
+	    ret = r;
+	}
+      if (ctx->prepare_units)
+	{
+	  r = rm_task_start(set, "units", step_units, NULL, deadline);
+	  if (r < 0)
+	    ret = r;
+	}
+    }
+
+  if (ret < 0)
+    log_msg(LOG_ERR, "Cannot start all prepare steps: %s", strerror(-ret));
+
+  return ret;
+}
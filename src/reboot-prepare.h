@@ -0,0 +1,10 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "rebootmgr.h"
+
+/* Start all steps of the prepare stage in parallel as tasks of
+   ctx->prepare, every step is killed if it is still running after
+   deadline */
+extern int rm_prepare_start(RM_CTX *ctx, usec_t deadline);
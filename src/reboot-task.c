@@ -0,0 +1,232 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Child processes supervised by the event loop: every task gets a
+   pidfd child source and a deadline, the result and the runtime are
+   recorded in its task set. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/pidfd.h>
+#include <sys/wait.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-task.h"
+
+static RM_Task *
+find_task(RM_TaskSet *set, sd_event_source *s)
+{
+  for (size_t i = 0; i < set->n_tasks; i++)
+    if (set->tasks[i].child == s || set->tasks[i].deadline == s)
+      return &set->tasks[i];
+
+  return NULL;
+}
+
+static void
+task_done(RM_TaskSet *set, RM_Task *task, int result)
+{
+  task->finished = now(CLOCK_MONOTONIC);
+  task->result = result;
+  task->deadline = sd_event_source_disable_unref(task->deadline);
+  set->n_running--;
+
+  log_msg(result == 0 ? LOG_INFO : LOG_WARNING,
+	  "%s '%s' %s after %" PRIu64 " ms", set->kind, task->name,
+	  rm_task_result_to_str(result),
+	  (task->finished - task->started) / USEC_PER_MSEC);
+
+  if (set->changed)
+    set->changed(set);
+}
+
+static int
+child_handler(sd_event_source *s, const siginfo_t *si, void *userdata)
+{
+  RM_TaskSet *set = userdata;
+  RM_Task *task = find_task(set, s);
+
+  if (task == NULL)
+    return 0;
+
+  task->child = sd_event_source_unref(task->child);
+
+  /* killed by the deadline, already accounted */
+  if (task->result != 1)
+    return 0;
+
+  task_done(set, task, (si->si_code == CLD_EXITED && si->si_status == 0) ?
+	    0 : -EPROTO);
+
+  return 0;
+}
+
+static int
+deadline_handler(sd_event_source *s, uint64_t _unused_(usec), void *userdata)
+{
+  RM_TaskSet *set = userdata;
+  RM_Task *task = find_task(set, s);
+
+  if (task == NULL || task->result != 1)
+    return 0;
+
+  if (task->child)
+    sd_event_source_send_child_signal(task->child, SIGKILL, NULL, 0);
+
+  task_done(set, task, -ETIME);
+
+  return 0;
+}
+
+int
+rm_task_start(RM_TaskSet *set, const char *name, rm_task_fn fn,
+	      const char *arg, usec_t timeout)
+{
+  RM_Task *task;
+  pid_t pid;
+  int pidfd, r;
+
+  task = reallocarray(set->tasks, set->n_tasks + 1, sizeof(RM_Task));
+  if (task == NULL)
+    return -ENOMEM;
+  set->tasks = task;
+
+  task = &set->tasks[set->n_tasks];
+  *task = (RM_Task) {strdup(name), NULL, NULL, now(CLOCK_MONOTONIC), 0, 1};
+  if (task->name == NULL)
+    return -ENOMEM;
+
+  pid = fork();
+  if (pid < 0)
+    {
+      r = -errno;
+      goto fail;
+    }
+  if (pid == 0)
+    _exit(fn(set->ctx, arg));
+
+  pidfd = pidfd_open(pid, 0);
+  if (pidfd < 0)
+    {
+      r = -errno;
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+      goto fail;
+    }
+
+  r = sd_event_add_child_pidfd(set->ctx->loop, &task->child, pidfd, WEXITED,
+			       child_handler, set);
+  if (r < 0)
+    {
+      close(pidfd);
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+      goto fail;
+    }
+  sd_event_source_set_child_pidfd_own(task->child, true);
+  /* kill the task if it is dropped, e.g. if rebootmgrd stops */
+  sd_event_source_set_child_process_own(task->child, true);
+
+  r = sd_event_add_time(set->ctx->loop, &task->deadline, CLOCK_MONOTONIC,
+			task->started + timeout, 0, deadline_handler, set);
+  if (r < 0)
+    log_msg(LOG_WARNING, "Cannot set deadline for %s '%s': %s",
+	    set->kind, name, strerror(-r));
+
+  set->n_tasks++;
+  set->n_running++;
+  return 0;
+
+ fail:
+  free(task->name);
+  return r;
+}
+
+void
+rm_task_set_reset(RM_TaskSet *set)
+{
+  for (size_t i = 0; i < set->n_tasks; i++)
+    {
+      /* owned processes are killed when the source goes away */
+      sd_event_source_unref(set->tasks[i].child);
+      sd_event_source_disable_unref(set->tasks[i].deadline);
+      free(set->tasks[i].name);
+    }
+  set->tasks = mfree(set->tasks);
+  set->n_tasks = 0;
+  set->n_running = 0;
+}
+
+int
+rm_task_set_result(const RM_TaskSet *set)
+{
+  for (size_t i = 0; i < set->n_tasks; i++)
+    if (set->tasks[i].result != 0)
+      return set->tasks[i].result > 0 ? -EBUSY : set->tasks[i].result;
+
+  return 0;
+}
+
+int
+rm_task_set_to_json(const RM_TaskSet *set, sd_json_variant **ret)
+{
+  _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+  int r;
+
+  r = sd_json_variant_new_array(&v, NULL, 0);
+  for (size_t i = 0; r >= 0 && i < set->n_tasks; i++)
+    {
+      const RM_Task *task = &set->tasks[i];
+
+      r = sd_json_variant_append_arrayb(&v,
+					SD_JSON_BUILD_OBJECT(
+					  SD_JSON_BUILD_PAIR_STRING("Name", task->name),
+					  SD_JSON_BUILD_PAIR_STRING("Result", rm_task_result_to_str(task->result)),
+					  SD_JSON_BUILD_PAIR_CONDITION(task->result != 1, "Duration",
+								       SD_JSON_BUILD_UNSIGNED(task->finished - task->started))));
+    }
+  if (r < 0)
+    return r;
+
+  *ret = v;
+  v = NULL;
+  return 0;
+}
+
+const char *
+rm_task_result_to_str(int result)
+{
+  switch (result)
+    {
+    case 1:
+      return "running";
+    case 0:
+      return "done";
+    case -ETIME:
+      return "timeout";
+    default:
+      return "failed";
+    }
+}
@@ -0,0 +1,19 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "rebootmgr.h"
+
+/* Runs in the child process, the return value is the exit status */
+typedef int (*rm_task_fn)(const RM_CTX *ctx, const char *arg);
+
+/* Start fn in a child process, which gets killed if it doesn't exit
+   within timeout */
+extern int rm_task_start(RM_TaskSet *set, const char *name,
+			 rm_task_fn fn, const char *arg, usec_t timeout);
+/* Kill all running tasks and forget the results */
+extern void rm_task_set_reset(RM_TaskSet *set);
+/* 0 if all tasks succeeded, else the error of the first failed one */
+extern int rm_task_set_result(const RM_TaskSet *set);
+extern int rm_task_set_to_json(const RM_TaskSet *set, sd_json_variant **ret);
+extern const char *rm_task_result_to_str(int result);
@@ -0,0 +1,109 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* A socket activated rebootmgrd exits if it has nothing to do. A
+   pending reboot is in the state file already, a transient timer
+   starts rebootmgr.service again in time to restore it. The timer is
+   named like the service, so it needs no Unit= property. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <systemd/sd-bus.h>
+
+#include "basics.h"
+#include "common.h"
+#include "reboot-exec.h"
+#include "reboot-wakeup.h"
+
+#define WAKEUP_UNIT "rebootmgr.timer"
+
+static int
+stop_wakeup(RM_CTX *ctx)
+{
+  sd_bus_error error = SD_BUS_ERROR_NULL;
+  int r;
+
+  r = sd_bus_call_method(ctx->bus, "org.freedesktop.systemd1",
+			 "/org/freedesktop/systemd1",
+			 "org.freedesktop.systemd1.Manager",
+			 "StopUnit", &error, NULL, "ss", WAKEUP_UNIT, "replace");
+  /* There is no timer, nothing to do */
+  if (r < 0 && sd_bus_error_has_name(&error, "org.freedesktop.systemd1.NoSuchUnit"))
+    r = 0;
+  sd_bus_error_free(&error);
+
+  return r;
+}
+
+int
+rm_wakeup_schedule(RM_CTX *ctx, usec_t when)
+{
+  sd_bus_error error = SD_BUS_ERROR_NULL;
+  sd_bus_message *m = NULL;
+  char buf[64];
+  struct tm tm;
+  time_t t;
+  int r;
+
+  r = rm_bus_connect(ctx);
+  if (r < 0)
+    return r;
+
+  /* The old timer would make creating the new one fail */
+  r = stop_wakeup(ctx);
+  if (r < 0 || when == 0)
+    return r;
+
+  t = when / USEC_PER_SEC;
+  if (gmtime_r(&t, &tm) == NULL ||
+      strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S UTC", &tm) == 0)
+    return -EINVAL;
+
+  r = sd_bus_message_new_method_call(ctx->bus, &m, "org.freedesktop.systemd1",
+				     "/org/freedesktop/systemd1",
+				     "org.freedesktop.systemd1.Manager",
+				     "StartTransientUnit");
+  if (r >= 0)
+    r = sd_bus_message_append(m, "ss", WAKEUP_UNIT, "replace");
+  if (r >= 0)
+    r = sd_bus_message_open_container(m, 'a', "(sv)");
+  if (r >= 0)
+    r = sd_bus_message_append(m, "(sv)(sv)(sv)(sv)",
+			      "Description", "s", "Restore the pending reboot of rebootmgr",
+			      "OnCalendar", "s", buf,
+			      "AccuracyUSec", "t", USEC_PER_SEC,
+			      "RemainAfterElapse", "b", 0);
+  if (r >= 0)
+    r = sd_bus_message_close_container(m);
+  /* no auxiliary units */
+  if (r >= 0)
+    r = sd_bus_message_append(m, "a(sa(sv))", 0);
+  if (r >= 0)
+    r = sd_bus_call(ctx->bus, m, 0, &error, NULL);
+  if (r < 0 && error.message)
+    log_msg(LOG_ERR, "Cannot create "WAKEUP_UNIT": %s", error.message);
+
+  sd_bus_error_free(&error);
+  sd_bus_message_unref(m);
+
+  return r;
+}
@@ -0,0 +1,8 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "rebootmgr.h"
+
+/* Let systemd start rebootmgr.service at when, 0 removes the timer */
+extern int rm_wakeup_schedule(RM_CTX *ctx, usec_t when);
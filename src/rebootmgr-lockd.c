@@ -0,0 +1,429 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+/* Copyright (c) 2026 Thorsten Kukuk
+   Author: Thorsten Kukuk <kukuk@suse.com>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, see <http://www.gnu.org/licenses/>. */
+
+/* Minimal reboot lock server: every group of machines gets a fixed
+   number of slots, a machine has to own one to reboot. The state is
+   only kept in memory. Without a lease a slot is only freed by Release,
+   so a machine which never comes back blocks it until a restart. */
+
+#include "config.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <systemd/sd-daemon.h>
+#include <systemd/sd-varlink.h>
+
+#include "basics.h"
+#include "common.h"
+#include "parse-duration.h"
+
+#include "varlink-org.openSUSE.rebootmgr.Lock.h"
+
+#define RM_LOCKD_SOCKET RM_VARLINK_SOCKET_DIR"/lockd.socket"
+#define RM_LOCKD_NAME_MAX 255
+
+typedef struct {
+  char *name;
+  usec_t expires;   /* CLOCK_MONOTONIC, 0 without a lease */
+} LockHolder;
+
+typedef struct {
+  char *name;
+  LockHolder *holders;
+  size_t n_holders;
+} LockGroup;
+
+typedef struct {
+  int slots;
+  usec_t lease;     /* 0 = slots are kept until released */
+  LockGroup *groups;
+  size_t n_groups;
+} LockCTX;
+
+static int verbose_flag = 0;
+
+static LockGroup *
+find_group(LockCTX *ctx, const char *name, bool create)
+{
+  for (size_t i = 0; i < ctx->n_groups; i++)
+    if (strcmp(ctx->groups[i].name, name) == 0)
+      return &ctx->groups[i];
+
+  if (!create)
+    return NULL;
+
+  LockGroup *g = reallocarray(ctx->groups, ctx->n_groups + 1, sizeof(LockGroup));
+  if (g == NULL)
+    return NULL;
+  ctx->groups = g;
+
+  g = &ctx->groups[ctx->n_groups];
+  *g = (LockGroup) {strdup(name), NULL, 0};
+  if (g->name == NULL)
+    return NULL;
+  ctx->n_groups++;
+
+  return g;
+}
+
+static ssize_t
+find_holder(const LockGroup *g, const char *holder)
+{
+  for (size_t i = 0; i < g->n_holders; i++)
+    if (strcmp(g->holders[i].name, holder) == 0)
+      return i;
+
+  return -1;
+}
+
+static void
+remove_holder(LockGroup *g, size_t i)
+{
+  free(g->holders[i].name);
+  g->holders[i] = g->holders[--g->n_holders];
+}
+
+/* Free the slots of machines which did not come back in time */
+static void
+expire_holders(const LockCTX *ctx, LockGroup *g)
+{
+  usec_t curr;
+
+  if (ctx->lease == 0)
+    return;
+
+  curr = now(CLOCK_MONOTONIC);
+  for (size_t i = g->n_holders; i > 0; i--)
+    if (g->holders[i - 1].expires <= curr)
+      {
+	log_msg(LOG_WARNING, "Lease of %s in group %s expired, freeing the slot",
+		g->holders[i - 1].name, g->name);
+	remove_holder(g, i - 1);
+      }
+}
+
+static usec_t
+lease_expires(const LockCTX *ctx)
+{
+  return ctx->lease > 0 ? now(CLOCK_MONOTONIC) + ctx->lease : 0;
+}
+
+struct lock_request {
+  char *group;
+  char *holder;
+};
+
+static void
+lock_request_free(struct lock_request *var)
+{
+  var->group = mfree(var->group);
+  var->holder = mfree(var->holder);
+}
+
+static int
+dispatch_lock_request(sd_varlink *link, sd_json_variant *parameters,
+		      struct lock_request *p)
+{
+  static const sd_json_dispatch_field dispatch_table[] = {
+    { "Group",  SD_JSON_VARIANT_STRING, sd_json_dispatch_string, offsetof(struct lock_request, group),  SD_JSON_MANDATORY },
+    { "Holder", SD_JSON_VARIANT_STRING, sd_json_dispatch_string, offsetof(struct lock_request, holder), SD_JSON_MANDATORY },
+    {}
+  };
+  int r;
+
+  r = sd_varlink_dispatch(link, parameters, dispatch_table, p);
+  if (r != 0)
+    return r;
+
+  if (strlen(p->group) == 0 || strlen(p->group) > RM_LOCKD_NAME_MAX)
+    return sd_varlink_error_invalid_parameter_name(link, "Group");
+  if (strlen(p->holder) == 0 || strlen(p->holder) > RM_LOCKD_NAME_MAX)
+    return sd_varlink_error_invalid_parameter_name(link, "Holder");
+
+  return 0;
+}
+
+static int
+vl_method_acquire(sd_varlink *link, sd_json_variant *parameters,
+		  sd_varlink_method_flags_t _unused_(flags),
+		  void *userdata)
+{
+  _cleanup_(lock_request_free) struct lock_request p = {};
+  LockCTX *ctx = userdata;
+  bool acquired = true;
+  LockGroup *g;
+  ssize_t i;
+  int r;
+
+  r = dispatch_lock_request(link, parameters, &p);
+  if (r != 0)
+    return r;
+
+  g = find_group(ctx, p.group, true);
+  if (g == NULL)
+    return -ENOMEM;
+
+  expire_holders(ctx, g);
+
+  /* Asking again is fine, e.g. after a restart of rebootmgrd,
+     and renews the lease */
+  i = find_holder(g, p.holder);
+  if (i >= 0)
+    g->holders[i].expires = lease_expires(ctx);
+  else if (g->n_holders < (size_t) ctx->slots)
+    {
+      LockHolder *h = reallocarray(g->holders, g->n_holders + 1, sizeof(LockHolder));
+      if (h == NULL)
+	return -ENOMEM;
+      g->holders = h;
+      g->holders[g->n_holders++] = (LockHolder) {TAKE_PTR(p.holder), lease_expires(ctx)};
+
+      if (verbose_flag)
+	log_msg(LOG_INFO, "%s acquired a slot of group %s (%zu/%i)",
+		g->holders[g->n_holders - 1].name, g->name, g->n_holders, ctx->slots);
+    }
+  else
+    acquired = false;
+
+  return sd_varlink_replybo(link,
+			    SD_JSON_BUILD_PAIR_BOOLEAN("Acquired", acquired),
+			    SD_JSON_BUILD_PAIR_INTEGER("Slots", ctx->slots),
+			    SD_JSON_BUILD_PAIR_INTEGER("Used", g->n_holders));
+}
+
+static int
+vl_method_release(sd_varlink *link, sd_json_variant *parameters,
+		  sd_varlink_method_flags_t _unused_(flags),
+		  void *userdata)
+{
+  _cleanup_(lock_request_free) struct lock_request p = {};
+  LockCTX *ctx = userdata;
+  LockGroup *g;
+  ssize_t i = -1;
+  int r;
+
+  r = dispatch_lock_request(link, parameters, &p);
+  if (r != 0)
+    return r;
+
+  g = find_group(ctx, p.group, false);
+  if (g)
+    {
+      expire_holders(ctx, g);
+      i = find_holder(g, p.holder);
+    }
+  if (i >= 0)
+    {
+      remove_holder(g, i);
+
+      if (verbose_flag)
+	log_msg(LOG_INFO, "%s released its slot of group %s (%zu/%i)",
+		p.holder, g->name, g->n_holders, ctx->slots);
+    }
+
+  return sd_varlink_replybo(link, SD_JSON_BUILD_PAIR_BOOLEAN("Released", i >= 0));
+}
+
+static int
+run_varlink(LockCTX *ctx, const char *socket_path)
+{
+  _cleanup_(sd_event_unrefp) sd_event *loop = NULL;
+  _cleanup_(sd_varlink_server_unrefp) sd_varlink_server *varlink_server = NULL;
+  int r;
+
+  r = sd_varlink_server_new(&varlink_server, SD_VARLINK_SERVER_ACCOUNT_UID|SD_VARLINK_SERVER_INHERIT_USERDATA);
+  if (r < 0)
+    {
+      log_msg(LOG_ERR, "Failed to allocate varlink server: %s", strerror(-r));
+      return r;
+    }
+
+  r = sd_varlink_server_set_description(varlink_server, "Rebootmgr lock server");
+  if (r < 0)
+    return r;
+
+  sd_varlink_server_set_userdata(varlink_server, ctx);
+
+  r = sd_varlink_server_add_interface(varlink_server, &vl_interface_org_openSUSE_rebootmgr_Lock);
+  if (r < 0)
+    {
+      log_msg(LOG_ERR, "Failed to add Varlink interface: %s", strerror(-r));
+      return r;
+    }
+
+  r = sd_varlink_server_bind_method_many(varlink_server,
+					 "org.openSUSE.rebootmgr.Lock.Acquire", vl_method_acquire,
+					 "org.openSUSE.rebootmgr.Lock.Release", vl_method_release);
+  if (r < 0)
+    {
+      log_msg(LOG_ERR, "Failed to bind Varlink methods: %s", strerror(-r));
+      return r;
+    }
+
+  r = sd_varlink_server_listen_address(varlink_server, socket_path, 0666);
+  if (r < 0)
+    {
+      log_msg(LOG_ERR, "Failed to bind to Varlink socket '%s': %s", socket_path, strerror(-r));
+      return r;
+    }
+
+  r = sd_event_new(&loop);
+  if (r < 0)
+    return r;
+
+  r = sd_varlink_server_attach_event(varlink_server, loop, SD_EVENT_PRIORITY_NORMAL);
+  if (r < 0)
+    return r;
+
+  r = sd_notify(0, "READY=1");
+  if (r < 0)
+    log_msg(LOG_ERR, "sd_notify(READY) failed: %s", strerror(-r));
+
+  return sd_event_loop(loop);
+}
+
+static void
+print_help(void)
+{
+  log_msg(LOG_INFO, "rebootmgr-lockd - limit the number of machines rebooting at once");
+
+  log_msg(LOG_INFO, "  -s,--socket PATH  Listen on PATH (default: " RM_LOCKD_SOCKET ")");
+  log_msg(LOG_INFO, "  -n,--slots N      Machines of a group allowed to reboot at once (default: 1)");
+  log_msg(LOG_INFO, "  -l,--lease TIME   Free a slot not released within TIME (default: never)");
+  log_msg(LOG_INFO, "  -v,--verbose      Verbose logging");
+  log_msg(LOG_INFO, "  -?, --help        Give this help list");
+  log_msg(LOG_INFO, "      --version     Print program version");
+}
+
+int
+main(int argc, char **argv)
+{
+  LockCTX ctx = {1, 0, NULL, 0};
+  const char *socket_path = RM_LOCKD_SOCKET;
+  int r;
+
+  log_init();
+
+  while (1)
+    {
+      int c;
+      int option_index = 0;
+      static struct option long_options[] =
+        {
+          {"socket", required_argument, NULL, 's'},
+          {"slots", required_argument, NULL, 'n'},
+          {"lease", required_argument, NULL, 'l'},
+          {"verbose", no_argument, NULL, 'v'},
+          {"version", no_argument, NULL, '\255'},
+          {"usage", no_argument, NULL, '?'},
+          {"help", no_argument, NULL, 'h'},
+          {NULL, 0, NULL, '\0'}
+        };
+
+      c = getopt_long(argc, argv, "s:n:l:vh?", long_options, &option_index);
+      if (c == (-1))
+        break;
+      switch (c)
+        {
+        case 's':
+          socket_path = optarg;
+          break;
+        case 'n':
+	  {
+	    char *ep;
+	    long l;
+
+	    errno = 0;
+	    l = strtol(optarg, &ep, 10);
+	    if (errno != 0 || *ep != '\0' || l < 1 || l > INT_MAX)
+	      {
+		log_msg(LOG_ERR, "Invalid number of slots: %s", optarg);
+		return 1;
+	      }
+	    ctx.slots = l;
+	  }
+          break;
+        case 'l':
+	  {
+	    time_t t = parse_duration(optarg);
+
+	    if (t == BAD_TIME)
+	      {
+		log_msg(LOG_ERR, "Invalid lease: %s", optarg);
+		return 1;
+	      }
+	    ctx.lease = t * USEC_PER_SEC;
+	  }
+          break;
+        case 'v':
+          verbose_flag = 1;
+          break;
+        case '?':
+        case 'h':
+          print_help();
+          return 0;
+        case '\255':
+          fprintf(stdout, "rebootmgr-lockd (%s) %s\n", PACKAGE, VERSION);
+          return 0;
+        default:
+          print_help();
+          return 1;
+        }
+    }
+
+  if (argc > optind)
+    {
+      fprintf(stderr, "Try `rebootmgr-lockd --help' for more information.\n");
+      return 1;
+    }
+
+  if (strcmp(socket_path, RM_LOCKD_SOCKET) == 0)
+    {
+      r = mkdir_p(RM_VARLINK_SOCKET_DIR, 0755);
+      if (r < 0)
+	{
+	  log_msg(LOG_ERR, "Failed to create directory '"RM_VARLINK_SOCKET_DIR"' for Varlink socket: %s",
+		  strerror(-r));
+	  return 1;
+	}
+    }
+
+  if (verbose_flag)
+    log_msg(LOG_INFO, "Starting rebootmgr-lockd (%s) %s with %i slot(s) per group...",
+	    PACKAGE, VERSION, ctx.slots);
+
+  r = run_varlink(&ctx, socket_path);
+  if (r < 0)
+    log_msg(LOG_ERR, "ERROR: varlink loop failed: %s", strerror(-r));
+
+  for (size_t i = 0; i < ctx.n_groups; i++)
+    {
+      for (size_t j = 0; j < ctx.groups[i].n_holders; j++)
+	free(ctx.groups[i].holders[j].name);
+      free(ctx.groups[i].holders);
+      free(ctx.groups[i].name);
+    }
+  free(ctx.groups);
+
+  return r < 0 ? -r : 0;
+}
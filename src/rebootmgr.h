@@ -16,16 +16,47 @@
 #pragma once
 
 #include <stdbool.h>
+#include <systemd/sd-bus.h>
 #include <systemd/sd-event.h>
+#include <systemd/sd-json.h>
+#include <systemd/sd-varlink.h>
 #include "calendarspec.h"
 
 #define RM_VARLINK_SOCKET_DIR   "/run/rebootmgr"
 #define RM_VARLINK_SOCKET       RM_VARLINK_SOCKET_DIR"/rebootmgrd.socket"
 
+/* Pending reboot requests survive a restart of rebootmgrd */
+#define RM_STATE_DIR            "/var/lib/rebootmgr"
+#define RM_STATE_FILE           RM_STATE_DIR"/state"
+
+/* Hooks run before every reboot, every one can veto it */
+#define RM_HOOKS_DIR            "/etc/rebootmgr/hooks.d"
+#define RM_HOOK_TIMEOUT_DEFAULT 300 /* seconds */
+
+/* Group of the reboot lock if none is configured */
+#define RM_LOCK_GROUP_DEFAULT   "default"
+/* How long to wait for the lock server, and before asking again if
+   all slots are taken */
+#define RM_LOCK_TIMEOUT_USEC    (10 * USEC_PER_SEC)
+#define RM_LOCK_RETRY_USEC      (60 * USEC_PER_SEC)
+
+/* Interval to check again if the system is still too busy */
+#define RM_LOAD_RETRY_USEC      (30 * USEC_PER_SEC)
+
+/* Interval to check if the clock is synchronized, if required */
+#define RM_TIME_SYNC_RETRY_USEC (60 * USEC_PER_SEC)
+
+/* A socket activated rebootmgrd exits after being idle this long */
+#define RM_IDLE_TIMEOUT_USEC    (30 * USEC_PER_SEC)
+
+/* Upper limit for the number of windows ListWindows returns */
+#define RM_LIST_WINDOWS_MAX     10000
+
 typedef enum RM_RebootMethod {
   RM_REBOOTMETHOD_UNKNOWN = 0,
   RM_REBOOTMETHOD_HARD, /* Normal hard/full reboot */
   RM_REBOOTMETHOD_SOFT, /* systemd soft-reboot, only userland */
+  RM_REBOOTMETHOD_KEXEC,/* kexec into the new kernel, skips firmware */
 } RM_RebootMethod;
 
 typedef enum RM_RebootStrategy {
@@ -37,21 +68,165 @@ typedef enum RM_RebootStrategy {
   RM_REBOOTSTRATEGY_ON           /* Re-enable old strategy after off */
 } RM_RebootStrategy;
 
+/* Where inside of the maintenance window a machine reboots */
+typedef enum RM_JitterMode {
+  RM_JITTER_UNKNOWN = 0,
+  RM_JITTER_RANDOM,     /* new random offset for every reboot */
+  RM_JITTER_MACHINE_ID, /* stable offset derived from /etc/machine-id */
+} RM_JitterMode;
+
+/* One of the maintenance windows, see windows.c */
+#define RM_WINDOW_DURATION_DEFAULT 3600 /* seconds */
+typedef struct RM_Window {
+  CalendarSpec *start;
+  time_t duration;  /* seconds */
+} RM_Window;
+
+typedef struct RM_Interval {
+  usec_t start;
+  usec_t end;
+} RM_Interval;
+
+/* Occurrences of all windows in [from, until), sorted and merged
+   where they overlap. next is the first occurrence at or after
+   until, USEC_INFINITY if there is none. */
+typedef struct RM_WindowIndex {
+  RM_Interval *intervals;
+  size_t n_intervals;
+  usec_t from;
+  usec_t until;
+  usec_t next;
+} RM_WindowIndex;
+
+/* Child process supervised by the event loop, see reboot-task.c */
+typedef struct RM_Task {
+  char *name;
+  sd_event_source *child;
+  sd_event_source *deadline;
+  usec_t started;   /* CLOCK_MONOTONIC */
+  usec_t finished;
+  int result;       /* 1 while running, 0 on success, <0 errno */
+} RM_Task;
+
+typedef struct RM_TaskSet {
+  const char *kind; /* for log messages */
+  struct RM_CTX *ctx;
+  RM_Task *tasks;
+  size_t n_tasks;
+  size_t n_running;
+  /* Called whenever a task finished */
+  void (*changed)(struct RM_TaskSet *set);
+} RM_TaskSet;
+
 typedef enum RM_RebootStatus {
   RM_REBOOTSTATUS_NOT_REQUESTED = 0,
   RM_REBOOTSTATUS_REQUESTED,
   RM_REBOOTSTATUS_WAITING_WINDOW,
 } RM_RebootStatus;
 
-typedef struct {
+typedef struct RM_CTX {
   RM_RebootStatus reboot_status;
   RM_RebootMethod reboot_method;
   RM_RebootStrategy reboot_strategy;
-  CalendarSpec *maint_window_start;
-  time_t maint_window_duration;
+  RM_Window *windows;
+  size_t n_windows;
   bool temp_off;
   sd_event *loop;
   sd_event_source *timer;
   usec_t reboot_time;
+  /* Requested with Force or the instantly strategy: the reboot is
+     neither deferred inside of a window nor moved to another one */
+  bool reboot_forced;
+  /* Derived from the maintenance windows, see window_changed() */
+  char *maint_window_str;
+  RM_WindowIndex window_index;
+  /* No reboots during the periods of blackout= and blackout-file=,
+     the parsed form depends on the time zone */
+  char *blackout;
+  char *blackout_file;
+  RM_Interval *blackouts;
+  size_t n_blackouts;
+  /* Bumped on every change of the state, the cached replies are
+     only valid for the version they were built for */
+  uint64_t version;
+  sd_json_variant *status_reply;
+  uint64_t status_version;
+  sd_json_variant *fullstatus_reply;
+  uint64_t fullstatus_version;
+  /* Connections waiting for status changes */
+  sd_varlink **subscribers;
+  size_t n_subscribers;
+  sd_event_source *notify_event;
+  /* Reboot request as written to RM_STATE_FILE */
+  RM_RebootStatus saved_status;
+  RM_RebootMethod saved_method;
+  usec_t saved_reboot_time;
+  bool saved_forced;
+  bool saved_lock_held;
+  sd_event_source *save_event;
+  /* Reboot lock, no lock is taken if lock_server is NULL. The calls
+     to the lock server run in the event loop, see reboot-lock.c.
+     lock_held is saved, so that the lock is only given back after a
+     reboot if it was taken before. */
+  char *lock_server;
+  char *lock_group;
+  sd_varlink *lock_call;
+  sd_varlink *unlock_call;
+  void (*lock_fn)(struct RM_CTX *ctx, int acquired);
+  bool lock_held;
+  RM_JitterMode jitter;
+  /* The window is split in domain_size slots, one per member of the
+     failure domain. domain_index is -1 if not configured. */
+  char *failure_domain;
+  unsigned domain_size;
+  int domain_index;
+  /* Running reboot, see reboot-exec.c. exec_result is 1 while
+     running, 0 on success and a negative errno on failure,
+     exec_fn is called with it once it is known. */
+  sd_bus *bus;
+  sd_bus_slot *exec_slot;
+  sd_event_source *exec_child;
+  RM_RebootMethod exec_method;
+  int exec_result;
+  void (*exec_fn)(struct RM_CTX *ctx, int result);
+  /* Kernel for kexec reboots, NULL means the default */
+  char *kexec_kernel;
+  char *kexec_initrd;
+  char *kexec_cmdline;
+  /* Prepare stage, runs prepare_lead seconds before the reboot,
+     see reboot-prepare.c */
+  time_t prepare_lead;
+  char *prepare_units;
+  sd_event_source *prepare_timer;
+  RM_TaskSet prepare;
+  /* Executables in RM_HOOKS_DIR, run before the reboot. If one of
+     them fails, the reboot is postponed. */
+  time_t hook_timeout;
+  RM_TaskSet hooks;
+  /* A reboot in a maintenance window is deferred while the pressure
+     (percent) or the load average per CPU is higher, both are in
+     hundredths and 0 means no limit. */
+  unsigned max_pressure;
+  unsigned max_load;
+  /* Waiting for logind inhibitors, see reboot-inhibit.c */
+  sd_bus_slot *inhibit_call;
+  sd_bus_slot *inhibit_match;
+  void (*inhibit_fn)(struct RM_CTX *ctx, int blocked);
+  bool inhibit_logged;
+  /* End of the window, a reboot waiting for the window is not
+     deferred beyond it because of load or inhibitors */
+  usec_t defer_deadline;
+  /* Changes of the clock and time zone, see reboot-clock.c. With
+     require_time_sync no window is calculated before the clock is
+     synchronized, time_unsynced is set while waiting for it. */
+  sd_event_source *clock_event;
+  sd_event_source *localtime_event;
+  void (*clock_fn)(struct RM_CTX *ctx);
+  bool require_time_sync;
+  bool time_unsynced;
+  /* Only if socket activated: rebootmgrd exits if it has nothing to
+     do for RM_IDLE_TIMEOUT_USEC, see reboot-wakeup.c */
+  sd_varlink_server *varlink_server;
+  sd_event_source *idle_event;
 } RM_CTX;
 
@@ -18,6 +18,9 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -35,19 +38,6 @@
 #define _(String) gettext(String)
 #endif
 
-/* Takes inspiration from Rust's Option::take() method: reads and returns a pointer, but at the same time
- * resets it to NULL. See: https://doc.rust-lang.org/std/option/enum.Option.html#method.take */
-#define TAKE_GENERIC(var, type, nullvalue)                       \
-        ({                                                       \
-                type *_pvar_ = &(var);                           \
-                type _var_ = *_pvar_;                            \
-                type _nullvalue_ = nullvalue;                    \
-                *_pvar_ = _nullvalue_;                           \
-                _var_;                                           \
-        })
-#define TAKE_PTR_TYPE(ptr, type) TAKE_GENERIC(ptr, type, NULL)
-#define TAKE_PTR(ptr) TAKE_PTR_TYPE(ptr, typeof(ptr))
-
 static int
 connect_to_rebootmgr(sd_varlink **ret)
 {
@@ -277,8 +267,20 @@ set_window(const char *start, const char *duration)
   _cleanup_(sd_varlink_unrefp) sd_varlink *link = NULL;
   _cleanup_(sd_json_variant_unrefp) sd_json_variant *params = NULL;
   sd_json_variant *result;
+  RM_Window *windows;
+  size_t n_windows;
   int r;
 
+  /* rebootmgrd would only say that the value is invalid */
+  r = rm_windows_from_string(start, &windows, &n_windows);
+  if (r == -ERANGE)
+    {
+      fprintf(stderr, _("Maintenance window '%s' never matches\n"), start);
+      return -1;
+    }
+  if (r >= 0)
+    rm_windows_free(windows, n_windows);
+
   r = connect_to_rebootmgr(&link);
   if (r < 0)
     return r;
@@ -391,36 +393,120 @@ get_status(RM_RebootStatus *status, RM_RebootMethod *method, char **reboot_time,
   return 0;
 }
 
+static int
+list_windows(int count)
+{
+  struct window {
+    uint64_t start;
+    uint64_t end;
+  };
+  static const sd_json_dispatch_field dispatch_table[] = {
+    { "Start", SD_JSON_VARIANT_UNSIGNED, sd_json_dispatch_uint64, offsetof(struct window, start), SD_JSON_MANDATORY },
+    { "End",   SD_JSON_VARIANT_UNSIGNED, sd_json_dispatch_uint64, offsetof(struct window, end),   SD_JSON_MANDATORY },
+    {}
+  };
+  _cleanup_(sd_varlink_unrefp) sd_varlink *link = NULL;
+  _cleanup_(sd_json_variant_unrefp) sd_json_variant *params = NULL;
+  sd_json_variant *result, *windows;
+  int r;
+
+  r = connect_to_rebootmgr(&link);
+  if (r < 0)
+    return r;
+
+  r = sd_json_buildo(&params,
+		     SD_JSON_BUILD_PAIR("Count", SD_JSON_BUILD_INTEGER(count)));
+  if (r < 0)
+    {
+      fprintf(stderr, "Failed to build JSON data: %s\n", strerror(-r));
+      return r;
+    }
+
+  const char *error_id;
+  r = sd_varlink_call(link, "org.openSUSE.rebootmgr.ListWindows", params, &result, &error_id);
+  if (r < 0)
+    {
+      fprintf(stderr, "Failed to call ListWindows method: %s\n", strerror(-r));
+      return r;
+    }
+  if (error_id && strlen(error_id) > 0)
+    {
+      if (strcmp(error_id, SD_VARLINK_ERROR_INVALID_PARAMETER) == 0)
+	printf(_("Number of windows got rejected as invalid (maximum is %i)\n"),
+	       RM_LIST_WINDOWS_MAX);
+      else
+	fprintf(stderr, _("Calling rebootmgrd failed: %s\n"), error_id);
+      return -1;
+    }
+
+  windows = sd_json_variant_by_key(result, "Windows");
+  if (windows == NULL || sd_json_variant_elements(windows) == 0)
+    {
+      printf(_("No maintenance window scheduled\n"));
+      return 0;
+    }
+
+  for (size_t i = 0; i < sd_json_variant_elements(windows); i++)
+    {
+      struct window w = {};
+      char start_buf[FORMAT_TIMESTAMP_MAX], end_buf[FORMAT_TIMESTAMP_MAX];
+
+      r = sd_json_dispatch(sd_json_variant_by_index(windows, i), dispatch_table,
+			   SD_JSON_ALLOW_EXTENSIONS, &w);
+      if (r < 0)
+	{
+	  fprintf(stderr, _("Failed to parse JSON answer: %s\n"), strerror(-r));
+	  return r;
+	}
+
+      printf("%s - %s\n", format_timestamp(start_buf, sizeof(start_buf), w.start),
+	     format_timestamp(end_buf, sizeof(end_buf), w.end));
+    }
+
+  return 0;
+}
+
 struct status {
   RM_RebootStatus status;
   RM_RebootMethod method;
   RM_RebootStrategy strategy;
   char *maint_window_start;
   time_t maint_window_duration;
+  sd_json_variant *windows;
   char *reboot_time;
   bool temp_off;
+  sd_json_variant *prepare;
+  sd_json_variant *hooks;
 };
 
 static void
 struct_status_free(struct status *p)
 {
   p->maint_window_start = mfree(p->maint_window_start);
+  p->windows = sd_json_variant_unref(p->windows);
   p->reboot_time = mfree(p->reboot_time);
+  p->prepare = sd_json_variant_unref(p->prepare);
+  p->hooks = sd_json_variant_unref(p->hooks);
 }
 
+/* Reply of FullStatus and Subscribe */
+static const sd_json_dispatch_field full_status_dispatch_table[] = {
+  { "RebootStatus",              SD_JSON_VARIANT_INTEGER, sd_json_dispatch_int,     offsetof(struct status, status),                SD_JSON_MANDATORY },
+  { "RequestedMethod",           SD_JSON_VARIANT_INTEGER, sd_json_dispatch_int,     offsetof(struct status, method),                0                 },
+  { "RebootTime",                SD_JSON_VARIANT_STRING,  sd_json_dispatch_string,  offsetof(struct status, reboot_time),           0                 },
+  { "RebootStrategy",            SD_JSON_VARIANT_INTEGER, sd_json_dispatch_int,     offsetof(struct status, strategy),              SD_JSON_MANDATORY },
+  { "MaintenanceWindowStart",    SD_JSON_VARIANT_STRING,  sd_json_dispatch_string,  offsetof(struct status, maint_window_start),    0                 },
+  { "MaintenanceWindowDuration", SD_JSON_VARIANT_INTEGER, sd_json_dispatch_int64,   offsetof(struct status, maint_window_duration), 0                 },
+  { "MaintenanceWindows",        SD_JSON_VARIANT_ARRAY,   sd_json_dispatch_variant, offsetof(struct status, windows),               0                 },
+  { "RebootDisabled",            SD_JSON_VARIANT_BOOLEAN, sd_json_dispatch_stdbool, offsetof(struct status, temp_off),              0                 },
+  { "Prepare",                   SD_JSON_VARIANT_ARRAY,   sd_json_dispatch_variant, offsetof(struct status, prepare),               0                 },
+  { "Hooks",                     SD_JSON_VARIANT_ARRAY,   sd_json_dispatch_variant, offsetof(struct status, hooks),                 0                 },
+  {}
+};
+
 static int
 get_full_status(struct status *p)
 {
-  static const sd_json_dispatch_field dispatch_table[] = {
-    { "RebootStatus",              SD_JSON_VARIANT_INTEGER, sd_json_dispatch_int,     offsetof(struct status, status),                SD_JSON_MANDATORY },
-    { "RequestedMethod",           SD_JSON_VARIANT_INTEGER, sd_json_dispatch_int,     offsetof(struct status, method),                0                 },
-    { "RebootTime",                SD_JSON_VARIANT_STRING,  sd_json_dispatch_string,  offsetof(struct status, reboot_time),           0                 },
-    { "RebootStrategy",            SD_JSON_VARIANT_INTEGER, sd_json_dispatch_int,     offsetof(struct status, strategy),              SD_JSON_MANDATORY },
-    { "MaintenanceWindowStart",    SD_JSON_VARIANT_STRING,  sd_json_dispatch_string,  offsetof(struct status, maint_window_start),    0                 },
-    { "MaintenanceWindowDuration", SD_JSON_VARIANT_INTEGER, sd_json_dispatch_int64,   offsetof(struct status, maint_window_duration), 0                 },
-    { "RebootDisabled",            SD_JSON_VARIANT_BOOLEAN, sd_json_dispatch_stdbool, offsetof(struct status, temp_off),              0                 },
-    {}
-  };
   _cleanup_(sd_varlink_unrefp) sd_varlink *link = NULL;
   sd_json_variant *result;
   int r;
@@ -442,7 +528,7 @@ get_full_status(struct status *p)
       return -1;
     }
 
-  r = sd_json_dispatch(result, dispatch_table, SD_JSON_ALLOW_EXTENSIONS, p);
+  r = sd_json_dispatch(result, full_status_dispatch_table, SD_JSON_ALLOW_EXTENSIONS, p);
   if (r < 0)
     {
       fprintf(stderr, _("Failed to parse JSON answer: %s\n"), strerror(-r));
@@ -452,25 +538,55 @@ get_full_status(struct status *p)
   return 0;
 }
 
+static void
+print_tasks(const char *kind, sd_json_variant *tasks)
+{
+  for (size_t i = 0; tasks && i < sd_json_variant_elements(tasks); i++)
+    {
+      sd_json_variant *task = sd_json_variant_by_index(tasks, i);
+      sd_json_variant *duration = sd_json_variant_by_key(task, "Duration");
+
+      printf("%s %s: %s", kind, sd_json_variant_string(sd_json_variant_by_key(task, "Name")),
+	     sd_json_variant_string(sd_json_variant_by_key(task, "Result")));
+      if (duration)
+	printf(" (%" PRIu64 " ms)", sd_json_variant_unsigned(duration) / USEC_PER_MSEC);
+      printf("\n");
+    }
+}
+
+/* One line per window, fmt gets the start and the duration */
 static int
-print_full_status(void)
+print_windows(const struct status *status, const char *fmt)
+{
+  for (size_t i = 0; i < sd_json_variant_elements(status->windows); i++)
+    {
+      sd_json_variant *window = sd_json_variant_by_index(status->windows, i);
+      _cleanup_(freep) const char *duration_str = NULL;
+      int r;
+
+      r = rm_duration_to_string(sd_json_variant_integer(sd_json_variant_by_key(window, "Duration")),
+				&duration_str);
+      if (r < 0)
+	{
+	  fprintf(stderr, _("Error converting duration to string: %s\n"),
+		  strerror(-r));
+	  return r;
+	}
+
+      printf(fmt, sd_json_variant_string(sd_json_variant_by_key(window, "Start")),
+	     duration_str);
+    }
+
+  return 0;
+}
+
+static int
+print_status(const struct status *status)
 {
-  _cleanup_(struct_status_free) struct status status = {
-    .status = RM_REBOOTSTATUS_NOT_REQUESTED,
-    .method = RM_REBOOTMETHOD_UNKNOWN,
-    .strategy = RM_REBOOTSTRATEGY_UNKNOWN,
-    .maint_window_start = NULL,
-    .maint_window_duration = 0,
-    .reboot_time = NULL
-  };
   const char *str = NULL;
   int r;
 
-  r = get_full_status(&status);
-  if (r < 0)
-    return r;
-
-  r = rm_status_to_str(status.status, status.method, &str);
+  r = rm_status_to_str(status->status, status->method, &str);
   if (r < 0)
     {
       fprintf(stderr, "Converting status to string failed: %s\n", strerror(-r));
@@ -478,16 +594,16 @@ print_full_status(void)
     }
   else
     {
-      if (status.temp_off)
+      if (status->temp_off)
 	printf("Status: %s (reboots temporarily disabled)\n", str);
       else
 	printf("Status: %s\n", str);
     }
 
-  if (status.reboot_time && strlen(status.reboot_time) > 0)
-    printf("Reboot at: %s\n", status.reboot_time);
+  if (status->reboot_time && strlen(status->reboot_time) > 0)
+    printf("Reboot at: %s\n", status->reboot_time);
 
-  r = rm_strategy_to_str(status.strategy, &str);
+  r = rm_strategy_to_str(status->strategy, &str);
   if (r < 0)
     {
       fprintf(stderr, "Converting strategy to string failed: %s\n", strerror(-r));
@@ -496,11 +612,17 @@ print_full_status(void)
   else
     printf("Strategy: %s\n", str);
 
-  if (status.maint_window_start)
+  if (sd_json_variant_elements(status->windows) > 1)
+    {
+      r = print_windows(status, "Maintenance window: %s, lasting %s\n");
+      if (r < 0)
+	return r;
+    }
+  else if (status->maint_window_start)
     {
       _cleanup_(freep) const char *duration_str;
 
-      r = rm_duration_to_string(status.maint_window_duration, &duration_str);
+      r = rm_duration_to_string(status->maint_window_duration, &duration_str);
       if (r < 0)
 	{
 	  fprintf(stderr, _("Error converting duration to string: %s\n"),
@@ -508,27 +630,160 @@ print_full_status(void)
 	  return r;
 	}
 
-      printf("Start of maintenance window: %s\n", status.maint_window_start);
+      printf("Start of maintenance window: %s\n", status->maint_window_start);
       printf("Duration of maintenance window: %s\n", duration_str);
     }
   else
     printf("Maintenance window: not set\n");
 
+  print_tasks("Prepare step", status->prepare);
+  print_tasks("Hook", status->hooks);
+
+  return 0;
+}
+
+static int
+print_full_status(void)
+{
+  _cleanup_(struct_status_free) struct status status = {
+    .status = RM_REBOOTSTATUS_NOT_REQUESTED,
+    .method = RM_REBOOTMETHOD_UNKNOWN,
+    .strategy = RM_REBOOTSTRATEGY_UNKNOWN,
+    .maint_window_start = NULL,
+    .maint_window_duration = 0,
+    .reboot_time = NULL
+  };
+  int r;
+
+  r = get_full_status(&status);
+  if (r < 0)
+    return r;
+
+  return print_status(&status);
+}
+
+static int
+follow_status_reply(sd_varlink _unused_(*link), sd_json_variant *parameters,
+		    const char *error_id, sd_varlink_reply_flags_t _unused_(flags),
+		    void *userdata)
+{
+  _cleanup_(struct_status_free) struct status status = {
+    .status = RM_REBOOTSTATUS_NOT_REQUESTED,
+    .method = RM_REBOOTMETHOD_UNKNOWN,
+    .strategy = RM_REBOOTSTRATEGY_UNKNOWN,
+    .maint_window_start = NULL,
+    .maint_window_duration = 0,
+    .reboot_time = NULL
+  };
+  int *ret = userdata;
+  int r;
+
+  if (error_id && strlen(error_id) > 0)
+    {
+      if (strcmp(error_id, SD_VARLINK_ERROR_DISCONNECTED) == 0)
+	fprintf(stderr, _("Connection to rebootmgrd closed\n"));
+      else
+	fprintf(stderr, _("Calling rebootmgrd failed: %s\n"), error_id);
+      *ret = -1;
+      return 0;
+    }
+
+  r = sd_json_dispatch(parameters, full_status_dispatch_table, SD_JSON_ALLOW_EXTENSIONS, &status);
+  if (r < 0)
+    {
+      fprintf(stderr, _("Failed to parse JSON answer: %s\n"), strerror(-r));
+      *ret = r;
+      return 0;
+    }
+
+  r = print_status(&status);
+  if (r < 0)
+    *ret = r;
+  printf("\n");
+  fflush(stdout);
+
   return 0;
 }
 
+/* Print the full status and again after every change, until
+   rebootmgrd goes away */
+static int
+follow_status(void)
+{
+  _cleanup_(sd_varlink_unrefp) sd_varlink *link = NULL;
+  int r, ret = 0;
+
+  r = connect_to_rebootmgr(&link);
+  if (r < 0)
+    return r;
+
+  sd_varlink_set_userdata(link, &ret);
+  r = sd_varlink_bind_reply(link, follow_status_reply);
+  if (r < 0)
+    {
+      fprintf(stderr, "Failed to bind reply callback: %s\n", strerror(-r));
+      return r;
+    }
+
+  r = sd_varlink_observe(link, "org.openSUSE.rebootmgr.Subscribe", NULL);
+  if (r < 0)
+    {
+      fprintf(stderr, "Failed to call Subscribe method: %s\n", strerror(-r));
+      return r;
+    }
+
+  while (ret == 0)
+    {
+      r = sd_varlink_is_idle(link);
+      if (r != 0)
+	break;
+
+      r = sd_varlink_process(link);
+      if (r < 0)
+	return r;
+      if (r > 0)
+	continue;
+
+      r = sd_varlink_wait(link, UINT64_MAX);
+      if (r < 0)
+	{
+	  fprintf(stderr, "Waiting for rebootmgrd failed: %s\n", strerror(-r));
+	  return r;
+	}
+    }
+
+  return ret;
+}
+
 static int
 dump_config(void)
 {
   _cleanup_(freep) char *start_str = NULL;
-  _cleanup_(freep) const char *duration_str = NULL;
+  _cleanup_(freep) char *duration_str = NULL;
   const char *strategy_str = NULL;
   RM_CTX ctx;
   int r;
 
   ctx.reboot_strategy = RM_REBOOTSTRATEGY_UNKNOWN;
-  ctx.maint_window_duration = BAD_TIME;
-  ctx.maint_window_start = NULL;
+  ctx.windows = NULL;
+  ctx.n_windows = 0;
+  ctx.blackout = NULL;
+  ctx.blackout_file = NULL;
+  ctx.lock_server = NULL;
+  ctx.lock_group = NULL;
+  ctx.jitter = RM_JITTER_UNKNOWN;
+  ctx.failure_domain = NULL;
+  ctx.domain_size = 0;
+  ctx.domain_index = -1;
+  ctx.kexec_kernel = NULL;
+  ctx.kexec_initrd = NULL;
+  ctx.kexec_cmdline = NULL;
+  ctx.prepare_lead = BAD_TIME;
+  ctx.prepare_units = NULL;
+  ctx.hook_timeout = BAD_TIME;
+  ctx.max_pressure = 0;
+  ctx.max_load = 0;
+  ctx.require_time_sync = false;
 
   log_init();
 
@@ -548,9 +803,9 @@ dump_config(void)
   else
     strategy_str = _("Not set");
 
-  if (ctx.maint_window_start != NULL)
+  if (ctx.n_windows > 0)
     {
-      r = calendar_spec_to_string(ctx.maint_window_start, &start_str);
+      r = rm_windows_to_string(ctx.windows, ctx.n_windows, &start_str, &duration_str);
       if (r < 0)
 	{
 	  fprintf(stderr, _("Converting calendar entry to string failed: %s\n"), strerror(-r));
@@ -558,25 +813,76 @@ dump_config(void)
 	}
     }
   else
-    start_str = strdup(_("Not set"));
-
-  if (ctx.maint_window_duration != BAD_TIME)
     {
-      r = rm_duration_to_string(ctx.maint_window_duration, &duration_str);
-      if (r < 0)
-	{
-	  fprintf(stderr, _("Error converting duration to string: %s\n"), strerror(-r));
-	  return -1;
-	}
+      start_str = strdup(_("Not set"));
+      duration_str = strdup(_("Not set"));
     }
-  else
-    duration_str = strdup(_("Not set"));
 
   printf ("strategy: %s\n", strategy_str);
   printf ("window-start: %s\n", start_str);
   printf ("window-duration: %s\n", duration_str);
+  if (ctx.blackout)
+    printf ("blackout: %s\n", ctx.blackout);
+  if (ctx.blackout_file)
+    printf ("blackout-file: %s\n", ctx.blackout_file);
+  if (ctx.jitter != RM_JITTER_UNKNOWN)
+    {
+      const char *jitter_str;
 
-  calendar_spec_free (ctx.maint_window_start);
+      rm_jitter_to_str (ctx.jitter, &jitter_str);
+      printf ("jitter: %s\n", jitter_str);
+    }
+  if (ctx.domain_size > 0)
+    {
+      printf ("failure-domain: %s\n", ctx.failure_domain ? ctx.failure_domain : "");
+      printf ("domain-size: %u\n", ctx.domain_size);
+      if (ctx.domain_index >= 0)
+	printf ("domain-index: %i\n", ctx.domain_index);
+    }
+  if (ctx.prepare_lead != BAD_TIME)
+    {
+      _cleanup_(freep) const char *lead_str = NULL;
+
+      if (rm_duration_to_string(ctx.prepare_lead, &lead_str) >= 0)
+	printf ("prepare-lead: %s\n", lead_str);
+    }
+  if (ctx.prepare_units)
+    printf ("prepare-units: %s\n", ctx.prepare_units);
+  if (ctx.max_pressure > 0)
+    printf ("max-pressure: %u.%02u\n", ctx.max_pressure / 100, ctx.max_pressure % 100);
+  if (ctx.max_load > 0)
+    printf ("max-load: %u.%02u\n", ctx.max_load / 100, ctx.max_load % 100);
+  if (ctx.require_time_sync)
+    printf ("require-time-sync: %s\n", bool_to_str (ctx.require_time_sync));
+  if (ctx.hook_timeout != BAD_TIME)
+    {
+      _cleanup_(freep) const char *timeout_str = NULL;
+
+      if (rm_duration_to_string(ctx.hook_timeout, &timeout_str) >= 0)
+	printf ("hook-timeout: %s\n", timeout_str);
+    }
+  if (ctx.kexec_kernel)
+    printf ("kexec-kernel: %s\n", ctx.kexec_kernel);
+  if (ctx.kexec_initrd)
+    printf ("kexec-initrd: %s\n", ctx.kexec_initrd);
+  if (ctx.kexec_cmdline)
+    printf ("kexec-cmdline: %s\n", ctx.kexec_cmdline);
+  if (ctx.lock_server)
+    {
+      printf ("lock-server: %s\n", ctx.lock_server);
+      printf ("lock-group: %s\n", ctx.lock_group ? ctx.lock_group : RM_LOCK_GROUP_DEFAULT);
+    }
+
+  rm_windows_free (ctx.windows, ctx.n_windows);
+  free (ctx.blackout);
+  free (ctx.blackout_file);
+  free (ctx.lock_server);
+  free (ctx.lock_group);
+  free (ctx.failure_domain);
+  free (ctx.kexec_kernel);
+  free (ctx.kexec_initrd);
+  free (ctx.kexec_cmdline);
+  free (ctx.prepare_units);
 
   return 0;
 }
@@ -715,12 +1021,14 @@ usage(int exit_code)
   printf(_("\trebootmgrctl is-active [--quiet]\n"));
   printf(_("\trebootmgrctl reboot [now]\n"));
   printf(_("\trebootmgrctl soft-reboot [now]\n"));
+  printf(_("\trebootmgrctl kexec-reboot [now]\n"));
   printf(_("\trebootmgrctl cancel\n"));
-  printf(_("\trebootmgrctl status [--full|--quiet]\n"));
+  printf(_("\trebootmgrctl status [--full|--follow|--quiet]\n"));
   printf(_("\trebootmgrctl set-strategy best-effort|maint-window|instantly|off|on\n"));
   printf(_("\trebootmgrctl get-strategy\n"));
   printf(_("\trebootmgrctl set-window <time> <duration>\n"));
   printf(_("\trebootmgrctl get-window\n"));
+  printf(_("\trebootmgrctl windows [--next N]\n"));
   printf(_("\trebootmgrctl dump-config\n"));
   exit(exit_code);
 }
@@ -769,6 +1077,20 @@ main(int argc, char **argv)
       RM_RebootMethod method = RM_REBOOTMETHOD_SOFT;
       bool force = false;
 
+      if (argc > 2)
+	{
+	  if (strcasecmp("now", argv[2]) == 0)
+	    force = true;
+	  else
+	    usage(1);
+	}
+      retval = trigger_reboot(method, force);
+    }
+  else if (strcasecmp("kexec-reboot", argv[1]) == 0)
+    {
+      RM_RebootMethod method = RM_REBOOTMETHOD_KEXEC;
+      bool force = false;
+
       if (argc > 2)
 	{
 	  if (strcasecmp("now", argv[2]) == 0)
@@ -782,6 +1104,7 @@ main(int argc, char **argv)
     {
       int quiet = 0;
       int full = 0;
+      int follow = 0;
       RM_RebootStatus r_status = 0;
       RM_RebootMethod r_method = 0;
       _cleanup_(freep) char *r_time = NULL;
@@ -795,11 +1118,19 @@ main(int argc, char **argv)
 	  if (strcasecmp("-f", argv[2]) == 0 ||
 	      strcasecmp("--full", argv[2]) == 0)
 	    full = 1;
+	  if (strcasecmp("--follow", argv[2]) == 0)
+	    follow = 1;
 	}
       else if (argc > 3)
 	usage(1);
 
-      if (full)
+      if (follow)
+	{
+	  int r = follow_status();
+	  if (r < 0)
+	    retval = 1;
+	}
+      else if (full)
 	{
 	  int r = print_full_status();
 	  if (r < 0)
@@ -909,7 +1240,7 @@ main(int argc, char **argv)
     }
   else if (strcasecmp("get-window", argv[1]) == 0)
     {
-      struct status status = {
+      _cleanup_(struct_status_free) struct status status = {
 	.maint_window_start = NULL,
 	.maint_window_duration = 0,
       };
@@ -918,6 +1249,11 @@ main(int argc, char **argv)
       r = get_full_status(&status);
       if (r < 0)
 	retval = 1;
+      else if (sd_json_variant_elements(status.windows) > 1)
+	{
+	  if (print_windows(&status, _("Maintenance window is set to '%s', lasting %s.\n")) < 0)
+	    retval = 1;
+	}
       else
 	{
 	  _cleanup_(freep) const char *duration_str = NULL;
@@ -933,6 +1269,26 @@ main(int argc, char **argv)
 		   status.maint_window_start, duration_str);
 	}
     }
+  else if (strcasecmp("windows", argv[1]) == 0)
+    {
+      int count = 1;
+
+      if (argc == 4 && strcasecmp("--next", argv[2]) == 0)
+	{
+	  char *ep;
+	  long l;
+
+	  errno = 0;
+	  l = strtol(argv[3], &ep, 10);
+	  if (errno != 0 || ep == argv[3] || *ep != '\0' || l < 1 || l > INT_MAX)
+	    usage(1);
+	  count = l;
+	}
+      else if (argc != 2)
+	usage(1);
+
+      retval = list_windows(count);
+    }
   else if (strcasecmp("set-window", argv[1]) == 0)
     {
       if (argc == 4)
@@ -22,12 +22,22 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <libintl.h>
+#include <unistd.h>
 #include <systemd/sd-daemon.h>
 #include <systemd/sd-varlink.h>
 
 #include "basics.h"
 #include "common.h"
 #include "parse-duration.h"
+#include "reboot-clock.h"
+#include "reboot-exec.h"
+#include "reboot-hooks.h"
+#include "reboot-inhibit.h"
+#include "reboot-kexec.h"
+#include "reboot-lock.h"
+#include "reboot-prepare.h"
+#include "reboot-task.h"
+#include "reboot-wakeup.h"
 
 #include "varlink-org.openSUSE.rebootmgr.h"
 
@@ -146,6 +156,122 @@ vl_method_get_environment(sd_varlink *link, sd_json_variant *parameters,
 #endif
 }
 
+/* Must be called after every change of the daemon state, so that
+   cached replies get rebuilt, subscribers are informed and the
+   reboot request gets saved. Several changes in one event loop
+   iteration result in one notification and one write. */
+static void
+state_changed (RM_CTX *ctx)
+{
+  int r;
+
+  ctx->version++;
+
+  if (ctx->n_subscribers > 0 && ctx->notify_event)
+    {
+      r = sd_event_source_set_enabled (ctx->notify_event, SD_EVENT_ONESHOT);
+      if (r < 0)
+	log_msg (LOG_ERR, "Cannot enable subscriber notification: %s",
+		 strerror (-r));
+    }
+
+  if (ctx->save_event)
+    {
+      r = sd_event_source_set_enabled (ctx->save_event, SD_EVENT_ONESHOT);
+      if (r < 0)
+	log_msg (LOG_ERR, "Cannot enable saving of the state: %s",
+		 strerror (-r));
+    }
+}
+
+static int
+save_state_handler (sd_event_source _unused_(*s), void *userdata)
+{
+  RM_CTX *ctx = userdata;
+  int r;
+
+  /* Most changes don't affect the reboot request */
+  if (ctx->reboot_status == ctx->saved_status &&
+      ctx->reboot_method == ctx->saved_method &&
+      ctx->reboot_time == ctx->saved_reboot_time &&
+      ctx->reboot_forced == ctx->saved_forced &&
+      ctx->lock_held == ctx->saved_lock_held)
+    return 0;
+
+  r = mkdir_p (RM_STATE_DIR, 0755);
+  if (r >= 0)
+    r = save_state (RM_STATE_FILE, ctx->reboot_status, ctx->reboot_method,
+		    ctx->reboot_time, ctx->reboot_forced, ctx->lock_held);
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Cannot write '"RM_STATE_FILE"': %s", strerror (-r));
+      return 0;
+    }
+
+  ctx->saved_status = ctx->reboot_status;
+  ctx->saved_method = ctx->reboot_method;
+  ctx->saved_reboot_time = ctx->reboot_time;
+  ctx->saved_forced = ctx->reboot_forced;
+  ctx->saved_lock_held = ctx->lock_held;
+
+  return 0;
+}
+
+/* The maintenance window configuration changed: recreate everything
+   derived from it, so that status queries don't need to. */
+static void
+window_changed (RM_CTX *ctx)
+{
+  int r;
+
+  state_changed (ctx);
+  ctx->maint_window_str = mfree (ctx->maint_window_str);
+  rm_window_index_reset (&ctx->window_index);
+
+  /* Keep the old blackouts if the file is broken now, rather than
+     rebooting during a change freeze */
+  RM_Interval *blackouts;
+  size_t n_blackouts;
+  r = rm_blackouts_from_string (ctx->blackout, ctx->blackout_file,
+				&blackouts, &n_blackouts);
+  if (r < 0)
+    log_msg (LOG_ERR, "Cannot parse blackouts, keeping the old ones: %s",
+	     strerror (-r));
+  else
+    {
+      free (ctx->blackouts);
+      ctx->blackouts = blackouts;
+      ctx->n_blackouts = n_blackouts;
+    }
+
+  if (ctx->n_windows == 0)
+    return;
+
+  for (size_t i = 0; i < ctx->n_windows; i++)
+    {
+      r = calendar_spec_compile (ctx->windows[i].start);
+      if (r < 0)
+	log_msg (LOG_WARNING, "Cannot compile maintenance window, using slow path: %s",
+		 strerror (-r));
+    }
+
+  r = rm_windows_to_string (ctx->windows, ctx->n_windows,
+			    &ctx->maint_window_str, NULL);
+  if (r < 0)
+    log_msg (LOG_ERR, "Cannot convert maintenance window to string: %s",
+	     strerror (-r));
+}
+
+/* Current or next maintenance window. The index stays valid for some
+   days, or until the clock is set back. */
+static int
+get_window (RM_CTX *ctx, usec_t curr, usec_t *ret_start, usec_t *ret_end)
+{
+  return rm_window_find (&ctx->window_index, ctx->windows, ctx->n_windows,
+			 ctx->blackouts, ctx->n_blackouts, curr,
+			 ret_start, ret_end);
+}
+
 static int
 vl_method_status (sd_varlink *link, sd_json_variant *parameters,
 		  sd_varlink_method_flags_t _unused_(flags),
@@ -165,146 +291,926 @@ vl_method_status (sd_varlink *link, sd_json_variant *parameters,
   if (r != 0)
     return r;
 
+  if (ctx->status_reply && ctx->status_version == ctx->version)
+    return sd_varlink_reply (link, ctx->status_reply);
+
   _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
 
-  r = sd_json_buildo(&v,
-		     SD_JSON_BUILD_PAIR("RebootStatus", SD_JSON_BUILD_INTEGER(ctx->reboot_status)),
-		     SD_JSON_BUILD_PAIR("RebootDisabled", SD_JSON_BUILD_BOOLEAN(ctx->temp_off)));
-  if (r == 0 && ctx->reboot_method != RM_REBOOTMETHOD_UNKNOWN)
+  r = sd_json_buildo(&v,
+		     SD_JSON_BUILD_PAIR("RebootStatus", SD_JSON_BUILD_INTEGER(ctx->reboot_status)),
+		     SD_JSON_BUILD_PAIR("RebootDisabled", SD_JSON_BUILD_BOOLEAN(ctx->temp_off)));
+  if (r == 0 && ctx->reboot_method != RM_REBOOTMETHOD_UNKNOWN)
+    {
+      r = sd_json_variant_merge_objectbo(&v,
+		SD_JSON_BUILD_PAIR("RequestedMethod", SD_JSON_BUILD_INTEGER(ctx->reboot_method)),
+		SD_JSON_BUILD_PAIR("RebootTime", SD_JSON_BUILD_STRING(format_timestamp(buf, sizeof(buf), ctx->reboot_time))));
+    }
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Failed to build JSON data: %s", strerror (-r));
+      return r;
+    }
+
+  /* Reused until the state changes */
+  sd_json_variant_unref (ctx->status_reply);
+  ctx->status_reply = v;
+  ctx->status_version = ctx->version;
+  v = NULL;
+
+  return sd_varlink_reply (link, ctx->status_reply);
+}
+
+/* Every configured window with its own start and duration */
+static int
+windows_to_json (RM_CTX *ctx, sd_json_variant **ret)
+{
+  _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+  int r;
+
+  r = sd_json_variant_new_array (&v, NULL, 0);
+  for (size_t i = 0; r >= 0 && i < ctx->n_windows; i++)
+    {
+      _cleanup_(freep) char *start_str = NULL;
+
+      r = calendar_spec_to_string (ctx->windows[i].start, &start_str);
+      if (r >= 0)
+	r = sd_json_variant_append_arrayb (&v,
+					   SD_JSON_BUILD_OBJECT(
+					     SD_JSON_BUILD_PAIR_STRING("Start", start_str),
+					     SD_JSON_BUILD_PAIR_INTEGER("Duration", ctx->windows[i].duration)));
+    }
+  if (r < 0)
+    return r;
+
+  *ret = TAKE_PTR(v);
+  return 0;
+}
+
+/* The FullStatus reply for the current state, owned by ctx */
+static int
+build_fullstatus (RM_CTX *ctx, sd_json_variant **ret)
+{
+  _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+  int r;
+
+  if (ctx->fullstatus_reply && ctx->fullstatus_version == ctx->version)
+    {
+      *ret = ctx->fullstatus_reply;
+      return 0;
+    }
+
+  r = sd_json_buildo (&v,
+		      SD_JSON_BUILD_PAIR("RebootStatus", SD_JSON_BUILD_INTEGER(ctx->reboot_status)),
+		      SD_JSON_BUILD_PAIR("RebootStrategy", SD_JSON_BUILD_INTEGER(ctx->reboot_strategy)),
+		      SD_JSON_BUILD_PAIR("RebootDisabled", SD_JSON_BUILD_BOOLEAN(ctx->temp_off)));
+
+  if (r >= 0 && ctx->reboot_method != RM_REBOOTMETHOD_UNKNOWN)
+    r = sd_json_variant_merge_objectbo(&v, SD_JSON_BUILD_PAIR("RequestedMethod", SD_JSON_BUILD_INTEGER(ctx->reboot_method)));
+  if (r >= 0 && ctx->maint_window_str)
+    r = sd_json_variant_merge_objectbo(&v, SD_JSON_BUILD_PAIR("MaintenanceWindowStart", SD_JSON_BUILD_STRING(ctx->maint_window_str)));
+  if (r >= 0 && ctx->n_windows > 0)
+    r = sd_json_variant_merge_objectbo(&v, SD_JSON_BUILD_PAIR("MaintenanceWindowDuration", SD_JSON_BUILD_INTEGER(ctx->windows[0].duration)));
+  if (r >= 0 && ctx->n_windows > 0)
+    {
+      _cleanup_(sd_json_variant_unrefp) sd_json_variant *windows = NULL;
+
+      r = windows_to_json (ctx, &windows);
+      if (r >= 0)
+	r = sd_json_variant_merge_objectbo (&v, SD_JSON_BUILD_PAIR_VARIANT("MaintenanceWindows", windows));
+    }
+  if (r >= 0 && ctx->reboot_time)
+    {
+      char buf[FORMAT_TIMESTAMP_MAX];
+      r = sd_json_variant_merge_objectbo(&v, SD_JSON_BUILD_PAIR("RebootTime", SD_JSON_BUILD_STRING(format_timestamp(buf, sizeof(buf), ctx->reboot_time))));
+    }
+
+  if (r >= 0 && ctx->prepare.n_tasks > 0)
+    {
+      _cleanup_(sd_json_variant_unrefp) sd_json_variant *tasks = NULL;
+
+      r = rm_task_set_to_json (&ctx->prepare, &tasks);
+      if (r >= 0)
+	r = sd_json_variant_merge_objectbo (&v, SD_JSON_BUILD_PAIR_VARIANT("Prepare", tasks));
+    }
+  if (r >= 0 && ctx->hooks.n_tasks > 0)
+    {
+      _cleanup_(sd_json_variant_unrefp) sd_json_variant *tasks = NULL;
+
+      r = rm_task_set_to_json (&ctx->hooks, &tasks);
+      if (r >= 0)
+	r = sd_json_variant_merge_objectbo (&v, SD_JSON_BUILD_PAIR_VARIANT("Hooks", tasks));
+    }
+
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Failed to build JSON data: %s", strerror (-r));
+      return r;
+    }
+
+  sd_json_variant_unref (ctx->fullstatus_reply);
+  ctx->fullstatus_reply = v;
+  ctx->fullstatus_version = ctx->version;
+  v = NULL;
+
+  *ret = ctx->fullstatus_reply;
+  return 0;
+}
+
+static int
+vl_method_fullstatus (sd_varlink *link, sd_json_variant *parameters,
+		      sd_varlink_method_flags_t _unused_(flags),
+		      void *userdata)
+{
+  static const sd_json_dispatch_field dispatch_table[] = {
+    {}
+  };
+  sd_json_variant *v;
+  RM_CTX *ctx = userdata;
+  int r;
+
+  if (verbose_flag)
+    log_msg (LOG_INFO, "Varlink method \"FullStatus\" called...");
+
+  r = sd_varlink_dispatch (link, parameters, dispatch_table, /* userdata= */ NULL);
+  if (r != 0)
+    return r;
+
+  r = build_fullstatus (ctx, &v);
+  if (r < 0)
+    return r;
+
+  return sd_varlink_reply (link, v);
+}
+
+static int
+vl_method_subscribe (sd_varlink *link, sd_json_variant *parameters,
+		     sd_varlink_method_flags_t flags,
+		     void *userdata)
+{
+  static const sd_json_dispatch_field dispatch_table[] = {
+    {}
+  };
+  sd_json_variant *v;
+  RM_CTX *ctx = userdata;
+  int r;
+
+  if (verbose_flag)
+    log_msg (LOG_INFO, "Varlink method \"Subscribe\" called...");
+
+  r = sd_varlink_dispatch (link, parameters, dispatch_table, /* userdata= */ NULL);
+  if (r != 0)
+    return r;
+
+  if (!(flags & SD_VARLINK_METHOD_MORE))
+    return sd_varlink_error (link, SD_VARLINK_ERROR_EXPECTED_MORE, NULL);
+
+  r = build_fullstatus (ctx, &v);
+  if (r < 0)
+    return r;
+
+  sd_varlink **s = reallocarray (ctx->subscribers, ctx->n_subscribers + 1,
+				 sizeof (sd_varlink *));
+  if (s == NULL)
+    return -ENOMEM;
+  ctx->subscribers = s;
+  ctx->subscribers[ctx->n_subscribers++] = sd_varlink_ref (link);
+
+  /* The current state first, every change follows */
+  return sd_varlink_notify (link, v);
+}
+
+static int
+notify_subscribers (sd_event_source _unused_(*s), void *userdata)
+{
+  sd_json_variant *v;
+  RM_CTX *ctx = userdata;
+  int r;
+
+  r = build_fullstatus (ctx, &v);
+  if (r < 0)
+    return 0;
+
+  for (size_t i = 0; i < ctx->n_subscribers; i++)
+    {
+      r = sd_varlink_notify (ctx->subscribers[i], v);
+      if (r < 0)
+	log_msg (LOG_WARNING, "Cannot send status to subscriber: %s",
+		 strerror (-r));
+    }
+
+  return 0;
+}
+
+static void
+vl_disconnect (sd_varlink_server _unused_(*server), sd_varlink *link,
+	       void *userdata)
+{
+  RM_CTX *ctx = userdata;
+
+  for (size_t i = 0; i < ctx->n_subscribers; i++)
+    if (ctx->subscribers[i] == link)
+      {
+	sd_varlink_unref (link);
+	ctx->subscribers[i] = ctx->subscribers[--ctx->n_subscribers];
+	break;
+      }
+
+  /* Count the idle time from the last connection on */
+  if (ctx->idle_event)
+    {
+      sd_event_source_set_time_relative (ctx->idle_event, RM_IDLE_TIMEOUT_USEC);
+      sd_event_source_set_enabled (ctx->idle_event, SD_EVENT_ONESHOT);
+    }
+}
+
+static int
+vl_method_list_windows (sd_varlink *link, sd_json_variant *parameters,
+			sd_varlink_method_flags_t _unused_(flags),
+			void *userdata)
+{
+  struct p {
+    int count;
+    uint64_t after;
+  } p = {
+    .count = 1,
+    .after = 0
+  };
+  static const sd_json_dispatch_field dispatch_table[] = {
+    { "Count", SD_JSON_VARIANT_INTEGER,  sd_json_dispatch_int,    offsetof(struct p, count), 0 },
+    { "After", SD_JSON_VARIANT_UNSIGNED, sd_json_dispatch_uint64, offsetof(struct p, after), 0 },
+    {}
+  };
+  _cleanup_(sd_json_variant_unrefp) sd_json_variant *windows = NULL;
+  _cleanup_(freep) RM_Interval *list = NULL;
+  size_t n_list;
+  RM_CTX *ctx = userdata;
+  int r;
+
+  if (verbose_flag)
+    log_msg (LOG_INFO, "Varlink method \"ListWindows\" called...");
+
+  r = sd_varlink_dispatch (link, parameters, dispatch_table, &p);
+  if (r != 0)
+    {
+      log_msg (LOG_ERR, "ListWindows request: varlink dispatch failed: %s", strerror (-r));
+      return r;
+    }
+
+  if (p.count < 1 || p.count > RM_LIST_WINDOWS_MAX)
+    return sd_varlink_error_invalid_parameter_name(link, "Count");
+
+  if (p.after == 0)
+    p.after = now (CLOCK_REALTIME);
+
+  r = rm_windows_list (ctx->windows, ctx->n_windows, ctx->blackouts,
+		       ctx->n_blackouts, p.after, p.count, &list, &n_list);
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Cannot calculate maintenance windows: %s", strerror (-r));
+      return sd_varlink_error (link, "org.openSUSE.rebootmgr.InternalError", NULL);
+    }
+
+  r = sd_json_variant_new_array (&windows, NULL, 0);
+  for (size_t i = 0; r >= 0 && i < n_list; i++)
+    r = sd_json_variant_append_arrayb (&windows,
+				       SD_JSON_BUILD_OBJECT(
+					 SD_JSON_BUILD_PAIR_UNSIGNED("Start", list[i].start),
+					 SD_JSON_BUILD_PAIR_UNSIGNED("End", list[i].end)));
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Failed to build JSON data: %s", strerror (-r));
+      return r;
+    }
+
+  return sd_varlink_replybo (link, SD_JSON_BUILD_PAIR_VARIANT("Windows", windows));
+}
+
+static int
+vl_method_in_window (sd_varlink *link, sd_json_variant *parameters,
+		     sd_varlink_method_flags_t _unused_(flags),
+		     void *userdata)
+{
+  struct p {
+    uint64_t time;
+  } p = {
+    .time = 0
+  };
+  static const sd_json_dispatch_field dispatch_table[] = {
+    { "Time", SD_JSON_VARIANT_UNSIGNED, sd_json_dispatch_uint64, offsetof(struct p, time), 0 },
+    {}
+  };
+  RM_CTX *ctx = userdata;
+  usec_t start, end;
+  int r;
+
+  if (verbose_flag)
+    log_msg (LOG_INFO, "Varlink method \"InWindow\" called...");
+
+  r = sd_varlink_dispatch (link, parameters, dispatch_table, &p);
+  if (r != 0)
+    {
+      log_msg (LOG_ERR, "InWindow request: varlink dispatch failed: %s", strerror (-r));
+      return r;
+    }
+
+  if (p.time == 0)
+    {
+      /* The common case, answered from the index of ctx */
+      p.time = now (CLOCK_REALTIME);
+      r = get_window (ctx, p.time, &start, &end);
+    }
+  else
+    {
+      _cleanup_(rm_window_index_reset) RM_WindowIndex idx = {};
+
+      r = rm_window_find (&idx, ctx->windows, ctx->n_windows,
+			  ctx->blackouts, ctx->n_blackouts, p.time,
+			  &start, &end);
+    }
+  if (r >= 0)
+    r = start <= p.time && p.time < end;
+  else if (r == -ENOENT)
+    r = 0;
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Cannot calculate maintenance window: %s", strerror (-r));
+      return sd_varlink_error (link, "org.openSUSE.rebootmgr.InternalError", NULL);
+    }
+  if (r == 0)
+    return sd_varlink_replybo (link, SD_JSON_BUILD_PAIR_BOOLEAN("Inside", false));
+
+  return sd_varlink_replybo (link,
+			     SD_JSON_BUILD_PAIR_BOOLEAN("Inside", true),
+			     SD_JSON_BUILD_PAIR_UNSIGNED("Start", start),
+			     SD_JSON_BUILD_PAIR_UNSIGNED("End", end));
+}
+
+/* Our slot of the failure domain in the window from start to end */
+static int
+domain_slot (RM_CTX *ctx, usec_t start, usec_t end,
+	     usec_t *ret_offset, usec_t *ret_width)
+{
+  int r;
+
+  r = rm_domain_slot (ctx->failure_domain, ctx->domain_size, ctx->domain_index,
+		      NULL, end - start, ret_offset, ret_width);
+  if (r < 0)
+    log_msg (LOG_ERR, "ERROR: Cannot calculate slot in failure domain: %s",
+	     strerror (-r));
+
+  return r;
+}
+
+/* Earliest time from curr on inside of our slot of the failure
+   domain: curr itself while the slot is open, else the begin of the
+   slot in the current or the next window */
+static int
+slot_time (RM_CTX *ctx, usec_t curr, usec_t *ret)
+{
+  usec_t start, end, offset, width;
+  int r;
+
+  r = get_window (ctx, curr, &start, &end);
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "ERROR: Internal error converting the timer: %s",
+               strerror (-r));
+      return r;
+    }
+
+  r = domain_slot (ctx, start, end, &offset, &width);
+  if (r < 0)
+    return r;
+
+  /* Only reboot inside of our own slot, if it is already over,
+     wait for the next window */
+  if (curr >= start + offset + width)
+    {
+      r = get_window (ctx, end, &start, &end);
+      if (r < 0)
+	{
+	  log_msg (LOG_ERR, "ERROR: Internal error converting the timer: %s",
+		   strerror (-r));
+	  return r;
+	}
+      /* Windows can differ in length, so do the slots */
+      r = domain_slot (ctx, start, end, &offset, &width);
+      if (r < 0)
+	return r;
+    }
+
+  if (curr > start + offset)
+    *ret = curr;
+  else
+    *ret = start + offset;
+
+  return 0;
+}
+
+static int
+calc_reboot_time (RM_CTX *ctx, usec_t *ret)
+{
+  usec_t next;
+  usec_t curr = now (CLOCK_REALTIME);
+
+  if (ctx->n_windows == 0)
+    {
+      /* best-efford and maint-window mean, boot immediately if there is no
+	 maintenance window defined, but not during a blackout */
+      if (ctx->reboot_strategy == RM_REBOOTSTRATEGY_BEST_EFFORT ||
+	  ctx->reboot_strategy == RM_REBOOTSTRATEGY_MAINT_WINDOW)
+	{
+	  *ret = rm_blackout_end (ctx->blackouts, ctx->n_blackouts, curr);
+	  return 0;
+	}
+      return -EINVAL;
+    }
+
+  /* A wrong clock would give a wrong window, check again later */
+  ctx->time_unsynced = ctx->require_time_sync && !ntp_synced ();
+  if (ctx->time_unsynced)
+    {
+      log_msg (LOG_NOTICE, "System clock is not synchronized, postponing the calculation of the reboot time");
+      *ret = curr + RM_TIME_SYNC_RETRY_USEC;
+      return 0;
+    }
+
+  usec_t start, end;
+  int r = get_window (ctx, curr, &start, &end);
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "ERROR: Internal error converting the timer: %s",
+               strerror (-r));
+      return r;
+    }
+
+  if (ctx->domain_size > 1)
+    {
+      r = slot_time (ctx, curr, &next);
+      if (r < 0)
+	return r;
+    }
+  /* Check, if we are inside the maintenance window. If yes, reboot now. */
+  else if (start < curr && curr < end)
+    next = curr;
+  else
+    {
+      /* Add a delay between 0 and duration to not reboot
+	 everything at the beginning of the maintenance window */
+      usec_t offset;
+
+      r = rm_jitter_offset (ctx->jitter, NULL, end - start, &offset);
+      if (r < 0 && ctx->jitter != RM_JITTER_RANDOM)
+	{
+	  log_msg (LOG_WARNING, "Cannot calculate reboot offset from machine-id, using a random one: %s",
+		   strerror (-r));
+	  r = rm_jitter_offset (RM_JITTER_RANDOM, NULL, end - start, &offset);
+	}
+      if (r < 0)
+	{
+	  log_msg (LOG_ERR, "ERROR: Cannot calculate reboot offset: %s", strerror (-r));
+	  offset = 0;
+	}
+      next = start + offset;
+    }
+
+  if (debug_flag || verbose_flag)
+    {
+      char buf[FORMAT_TIMESTAMP_MAX];
+      int64_t in_secs = (next - curr) / USEC_PER_SEC;
+
+      log_msg (LOG_NOTICE, "Reboot in %i seconds at %s", in_secs,
+               format_timestamp(buf, sizeof(buf), next));
+    }
+
+  *ret = next;
+
+  return 0;
+}
+
+static void
+reset_timer(RM_CTX *ctx)
+{
+  ctx->reboot_status = RM_REBOOTSTATUS_NOT_REQUESTED;
+  ctx->reboot_method = RM_REBOOTMETHOD_UNKNOWN;
+  ctx->reboot_forced = false;
+  ctx->timer = sd_event_source_unref (ctx->timer);
+  rm_inhibit_reset (ctx);
+  ctx->defer_deadline = 0;
+  ctx->time_unsynced = false;
+  ctx->prepare_timer = sd_event_source_disable_unref (ctx->prepare_timer);
+  rm_task_set_reset (&ctx->prepare);
+  rm_task_set_reset (&ctx->hooks);
+  state_changed (ctx);
+}
+
+static int
+prepare_handler (sd_event_source _unused_(*s), uint64_t _unused_(usec), void *userdata)
+{
+  RM_CTX *ctx = userdata;
+  usec_t curr = now (CLOCK_REALTIME);
+
+  if (ctx->temp_off || ctx->reboot_status == RM_REBOOTSTATUS_NOT_REQUESTED)
+    return 0;
+
+  /* All steps have to be done at the reboot time */
+  rm_prepare_start (ctx, ctx->reboot_time > curr ? ctx->reboot_time - curr : 0);
+  return 0;
+}
+
+/* Start the prepare stage prepare_lead seconds before the reboot, or
+   right now if the reboot is closer than that */
+static void
+arm_prepare (RM_CTX *ctx)
+{
+  usec_t lead = ctx->prepare_lead * USEC_PER_SEC;
+  usec_t curr = now (CLOCK_REALTIME);
+  usec_t at;
+  int r;
+
+  if (lead == 0 || ctx->reboot_time <= curr)
+    return;
+
+  at = ctx->reboot_time - lead;
+  if (at < curr)
+    at = curr;
+
+  if (ctx->prepare_timer == NULL)
+    r = sd_event_add_time (ctx->loop, &ctx->prepare_timer, CLOCK_REALTIME,
+			   at, 0, prepare_handler, ctx);
+  else
+    {
+      r = sd_event_source_set_time (ctx->prepare_timer, at);
+      if (r >= 0)
+	r = sd_event_source_set_enabled (ctx->prepare_timer, SD_EVENT_ONESHOT);
+    }
+  if (r < 0)
+    log_msg (LOG_ERR, "Cannot add prepare timer to event loop: %s", strerror (-r));
+}
+
+/* Move the pending reboot to next */
+static void
+postpone_reboot (RM_CTX *ctx, usec_t next)
+{
+  int r;
+
+  r = sd_event_source_set_time (ctx->timer, next);
+  if (r >= 0)
+    r = sd_event_source_set_enabled (ctx->timer, SD_EVENT_ONESHOT);
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Failed to reset timer: %s", strerror (-r));
+      reset_timer (ctx);
+      return;
+    }
+
+  ctx->reboot_time = next;
+  arm_prepare (ctx);
+  state_changed (ctx);
+}
+
+/* Somebody else holds the reboot lock, try again later but stay inside
+   of the maintenance window, or of our slot of the failure domain,
+   unless the reboot is forced */
+static void
+retry_reboot(RM_CTX *ctx)
+{
+  usec_t next = now (CLOCK_REALTIME) + RM_LOCK_RETRY_USEC;
+  int r;
+
+  if (ctx->n_windows > 0 && !ctx->reboot_forced &&
+      ctx->reboot_strategy != RM_REBOOTSTRATEGY_INSTANTLY)
+    {
+      usec_t start, end;
+
+      if (ctx->domain_size > 1)
+	{
+	  /* start is next while our slot is open, else its begin */
+	  r = slot_time (ctx, next, &start);
+	  if (r < 0)
+	    {
+	      reset_timer (ctx);
+	      return;
+	    }
+	  if (start != next)
+	    {
+	      next = start;
+	      /* The next slot has its own deadline */
+	      ctx->defer_deadline = 0;
+	    }
+	}
+      else
+	{
+	  r = get_window (ctx, next, &start, &end);
+	  if (r < 0)
+	    {
+	      log_msg (LOG_ERR, "ERROR: Internal error converting the timer: %s",
+		       strerror (-r));
+	      reset_timer (ctx);
+	      return;
+	    }
+	  if (next <= start || next >= end)
+	    {
+	      next = start;
+	      /* The next window has its own deadline */
+	      ctx->defer_deadline = 0;
+	    }
+	}
+    }
+
+  postpone_reboot (ctx, next);
+}
+
+/* Wait in short steps while the machine is busy, but not longer
+   than until the end of the maintenance window. Returns true if
+   the reboot was deferred. */
+static bool
+defer_for_load (RM_CTX *ctx)
+{
+  usec_t curr = now (CLOCK_REALTIME);
+  usec_t deadline;
+  unsigned pressure, load;
+  long ncpus;
+  int r;
+
+  if (ctx->max_pressure == 0 && ctx->max_load == 0)
+    return false;
+
+  deadline = rm_defer_deadline (ctx, curr);
+  if (deadline == 0)
+    return false;
+  if (curr + RM_LOAD_RETRY_USEC >= deadline)
+    {
+      log_msg (LOG_INFO, "End of the maintenance window reached, ignoring the load");
+      return false;
+    }
+
+  r = rm_pressure_read (RM_PROC_ROOT, &pressure, &load);
+  if (r < 0)
+    {
+      log_msg (LOG_WARNING, "Cannot read the load of the system: %s", strerror (-r));
+      return false;
+    }
+
+  ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1)
+    ncpus = 1;
+
+  if ((ctx->max_pressure == 0 || pressure <= ctx->max_pressure) &&
+      (ctx->max_load == 0 || load <= (unsigned long) ctx->max_load * ncpus))
+    return false;
+
+  log_msg (LOG_NOTICE, "System is busy (pressure %u.%02u%%, load %u.%02u), deferring reboot",
+	   pressure / 100, pressure % 100, load / 100, load % 100);
+  postpone_reboot (ctx, curr + RM_LOAD_RETRY_USEC);
+
+  return true;
+}
+
+/* logind or systemctl answered, the request is kept until the reboot
+   was accepted */
+static void
+reboot_finished (RM_CTX *ctx, int result)
+{
+  /* Cancelled in the meantime */
+  if (ctx->reboot_status == RM_REBOOTSTATUS_NOT_REQUESTED)
+    return;
+
+  if (result < 0)
     {
-      r = sd_json_variant_merge_objectbo(&v,
-		SD_JSON_BUILD_PAIR("RequestedMethod", SD_JSON_BUILD_INTEGER(ctx->reboot_method)),
-		SD_JSON_BUILD_PAIR("RebootTime", SD_JSON_BUILD_STRING(format_timestamp(buf, sizeof(buf), ctx->reboot_time))));
+      log_msg (LOG_ERR, "Reboot failed, retrying later: %s", strerror (-result));
+      retry_reboot (ctx);
+      return;
     }
-  if (r < 0)
+
+  reset_timer (ctx);
+}
+
+/* Everything is checked, do the reboot */
+static void
+reboot_now (RM_CTX *ctx)
+{
+  if (debug_flag)
     {
-      log_msg (LOG_ERR, "Failed to build JSON data: %s", strerror (-r));
-      return r;
+      switch (ctx->reboot_method)
+	{
+	case RM_REBOOTMETHOD_HARD:
+	  log_msg (LOG_DEBUG, "systemctl reboot called!");
+	  break;
+	case RM_REBOOTMETHOD_SOFT:
+	  log_msg (LOG_DEBUG, "systemctl soft-reboot called!");
+	  break;
+	case RM_REBOOTMETHOD_KEXEC:
+	  log_msg (LOG_DEBUG, "systemctl kexec called!");
+	  break;
+	default:
+	  /* cannot happen */
+	  break;
+	}
+      /* We don't go down, so don't block the other machines */
+      rm_lock_release (ctx);
+      reset_timer (ctx);
     }
+  else
+    {
+      RM_RebootMethod method = ctx->reboot_method;
+      int r;
 
-  return sd_varlink_reply (link, v);
+      /* The kernel is normally loaded already, if it is lost or
+	 cannot be loaded, a normal reboot is better than none */
+      if (method == RM_REBOOTMETHOD_KEXEC && !rm_kexec_loaded () &&
+	  rm_kexec_load (ctx) < 0)
+	{
+	  log_msg (LOG_WARNING, "No kernel loaded for kexec, doing a normal reboot");
+	  method = RM_REBOOTMETHOD_HARD;
+	}
+      r = rm_exec_reboot (ctx, method, reboot_finished);
+      if (r == -EBUSY)
+	log_msg (LOG_ERR, "A reboot is already running");
+    }
 }
 
-static int
-vl_method_fullstatus (sd_varlink *link, sd_json_variant *parameters,
-		      sd_varlink_method_flags_t _unused_(flags),
-		      void *userdata)
+/* The hooks decide if the reboot can happen now */
+static void
+hooks_changed (RM_TaskSet *set)
 {
-  static const sd_json_dispatch_field dispatch_table[] = {
-    {}
-  };
-  RM_CTX *ctx = userdata;
+  RM_CTX *ctx = set->ctx;
   int r;
 
-  if (verbose_flag)
-    log_msg (LOG_INFO, "Varlink method \"FullStatus\" called...");
+  state_changed (ctx);
 
-  r = sd_varlink_dispatch (link, parameters, dispatch_table, /* userdata= */ NULL);
-  if (r != 0)
-    return r;
+  if (set->n_running > 0)
+    return;
 
-  _cleanup_(sd_json_variant_unrefp) sd_json_variant *v = NULL;
+  r = rm_task_set_result (set);
+  if (r < 0)
+    {
+      log_msg (LOG_NOTICE, "Reboot vetoed by a hook, retrying later");
+      rm_lock_release (ctx);
+      retry_reboot (ctx);
+      return;
+    }
 
-  r = sd_json_buildo (&v,
-		      SD_JSON_BUILD_PAIR("RebootStatus", SD_JSON_BUILD_INTEGER(ctx->reboot_status)),
-		      SD_JSON_BUILD_PAIR("RebootStrategy", SD_JSON_BUILD_INTEGER(ctx->reboot_strategy)),
-		      SD_JSON_BUILD_PAIR("RebootDisabled", SD_JSON_BUILD_BOOLEAN(ctx->temp_off)));
+  reboot_now (ctx);
+}
 
-  if (r >= 0 && ctx->reboot_method != RM_REBOOTMETHOD_UNKNOWN)
-    r = sd_json_variant_merge_objectbo(&v, SD_JSON_BUILD_PAIR("RequestedMethod", SD_JSON_BUILD_INTEGER(ctx->reboot_method)));
-  if (r >= 0 && ctx->maint_window_start)
-    {
-      _cleanup_(freep) char *str = NULL;
+static void
+prepare_changed (RM_TaskSet *set)
+{
+  state_changed (set->ctx);
+}
+
+/* The lock server answered, run the hooks, the reboot happens when
+   the last hook finished */
+static void
+lock_acquired (RM_CTX *ctx, int r)
+{
+  /* lock_held changed */
+  state_changed (ctx);
 
-      calendar_spec_to_string(ctx->maint_window_start, &str);
-      r = sd_json_variant_merge_objectbo(&v, SD_JSON_BUILD_PAIR("MaintenanceWindowStart", SD_JSON_BUILD_STRING(str)));
+  /* Cancelled in the meantime */
+  if (ctx->reboot_status == RM_REBOOTSTATUS_NOT_REQUESTED)
+    {
+      if (r > 0)
+	rm_lock_release (ctx);
+      return;
     }
-  if (r >= 0 && ctx->maint_window_duration != BAD_TIME)
-    r = sd_json_variant_merge_objectbo(&v, SD_JSON_BUILD_PAIR("MaintenanceWindowDuration", SD_JSON_BUILD_INTEGER(ctx->maint_window_duration)));
-  if (r >= 0 && ctx->reboot_time)
+
+  if (r <= 0)
     {
-      char buf[FORMAT_TIMESTAMP_MAX];
-      r = sd_json_variant_merge_objectbo(&v, SD_JSON_BUILD_PAIR("RebootTime", SD_JSON_BUILD_STRING(format_timestamp(buf, sizeof(buf), ctx->reboot_time))));
+      if (r == 0)
+	log_msg (LOG_NOTICE, "Reboot lock of group %s is busy, retrying later",
+		 ctx->lock_group ? ctx->lock_group : RM_LOCK_GROUP_DEFAULT);
+      else
+	log_msg (LOG_ERR, "Failed to acquire reboot lock, retrying later: %s",
+		 strerror (-r));
+      retry_reboot (ctx);
+      return;
     }
 
+  r = rm_hooks_start (ctx);
+  if (r > 0)
+    return;
   if (r < 0)
     {
-      log_msg (LOG_ERR, "Failed to build JSON data: %s", strerror (-r));
-      return r;
+      log_msg (LOG_ERR, "Cannot run hooks, retrying later: %s", strerror (-r));
+      rm_lock_release (ctx);
+      retry_reboot (ctx);
+      return;
     }
 
-  return sd_varlink_reply (link, v);
+  reboot_now (ctx);
 }
 
-static int
-calc_reboot_time (RM_CTX *ctx, usec_t *ret)
+/* Take the reboot lock, lock_acquired() continues with the answer
+   of the lock server */
+static void
+start_reboot (RM_CTX *ctx)
 {
-  usec_t next;
-  usec_t curr = now (CLOCK_REALTIME);
-  usec_t duration = ctx->maint_window_duration * USEC_PER_SEC;
+  int r;
+
+  r = rm_lock_acquire (ctx, lock_acquired);
+  if (r != 0)
+    lock_acquired (ctx, r);
+}
 
-  if (ctx->maint_window_start == NULL)
+static void
+inhibitors_changed (RM_CTX *ctx, int blocked)
+{
+  if (blocked > 0)
     {
-      /* best-efford and maint-window mean, boot immediately if there is no
-	 maintenance window defined */
-      if (ctx->reboot_strategy == RM_REBOOTSTRATEGY_BEST_EFFORT ||
-	  ctx->reboot_strategy == RM_REBOOTSTRATEGY_MAINT_WINDOW)
+      /* Reboot at the end of the window, if they are not released
+	 before */
+      if (ctx->reboot_time != ctx->defer_deadline)
 	{
-	  *ret = curr;
-	  return 0;
+	  log_msg (LOG_NOTICE, "Waiting for %i inhibitor(s) of logind", blocked);
+	  postpone_reboot (ctx, ctx->defer_deadline);
 	}
-      return -EINVAL;
+      return;
     }
 
-  /* Check, if we are inside the maintenance window. If yes, reboot now. */
-  int r = calendar_spec_next_usec (ctx->maint_window_start, curr - duration, &next);
-  if (r < 0)
+  if (blocked < 0)
+    log_msg (LOG_WARNING, "Cannot get the inhibitors of logind, ignoring them: %s",
+	     strerror (-blocked));
+
+  sd_event_source_set_enabled (ctx->timer, SD_EVENT_OFF);
+  start_reboot (ctx);
+}
+
+/* Returns true if the reboot waits for the inhibitors of logind,
+   inhibitors_changed() continues it */
+static bool
+wait_for_inhibitors (RM_CTX *ctx)
+{
+  usec_t curr = now (CLOCK_REALTIME);
+  usec_t deadline;
+  int r;
+
+  rm_inhibit_reset (ctx);
+
+  deadline = rm_defer_deadline (ctx, curr);
+  if (deadline == 0)
+    return false;
+  if (curr >= deadline)
     {
-      log_msg (LOG_ERR, "ERROR: Internal error converting the timer: %s",
-               strerror (-r));
-      return r;
+      if (ctx->reboot_time == deadline)
+	log_msg (LOG_NOTICE, "End of the maintenance window reached, ignoring inhibitors");
+      return false;
     }
-  if (curr > next && curr < next + duration)
+
+  r = rm_inhibit_watch (ctx, inhibitors_changed);
+  if (r < 0)
     {
-      /* We are inside the maintenance window. */
-      next = curr;
+      log_msg (LOG_WARNING, "Cannot get the inhibitors of logind, ignoring them: %s",
+	       strerror (-r));
+      return false;
     }
-  else
-    {
-      /* we are not inside a maintenance window, set timer for next one */
-      r = calendar_spec_next_usec (ctx->maint_window_start, curr, &next);
-      if (r < 0)
-	{
-	  log_msg (LOG_ERR, "ERROR: Internal error converting the timer: %s",
-		   strerror (-r));
-	  return r;
-	}
 
-      /* Add a random delay between 0 and duration to not reboot
-	 everything at the beginning of the maintenance window */
-      next = next + ((usec_t)rand() * USEC_PER_SEC) % duration;
+  return true;
+}
+
+/* Calculate the time of a reboot waiting for its window again, the
+   old one is based on an outdated clock or time zone */
+static void
+reschedule (RM_CTX *ctx)
+{
+  usec_t next;
+  int r;
+
+  /* Too late, the reboot is already running. Forced and instant
+     reboots don't depend on the window at all. */
+  if (ctx->reboot_status != RM_REBOOTSTATUS_WAITING_WINDOW ||
+      ctx->reboot_forced || ctx->lock_call ||
+      ctx->hooks.n_running > 0 || ctx->exec_result > 0)
+    return;
+
+  rm_inhibit_reset (ctx);
+  ctx->defer_deadline = 0;
+
+  r = calc_reboot_time (ctx, &next);
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Cannot calculate reboot timer: %s", strerror (-r));
+      reset_timer (ctx);
+      return;
     }
 
-  if (debug_flag || verbose_flag)
+  if (!ctx->time_unsynced && next != ctx->reboot_time)
     {
       char buf[FORMAT_TIMESTAMP_MAX];
-      int64_t in_secs = (next - curr) / USEC_PER_SEC;
 
-      log_msg (LOG_NOTICE, "Reboot in %i seconds at %s", in_secs,
-               format_timestamp(buf, sizeof(buf), next));
+      log_msg (LOG_INFO, "Reboot rescheduled for %s",
+	       format_timestamp (buf, sizeof (buf), next));
     }
-
-  *ret = next;
-
-  return 0;
+  postpone_reboot (ctx, next);
 }
 
 static void
-reset_timer(RM_CTX *ctx)
+clock_changed (RM_CTX *ctx)
 {
-  ctx->reboot_status = RM_REBOOTSTATUS_NOT_REQUESTED;
-  ctx->reboot_method = RM_REBOOTMETHOD_UNKNOWN;
-  ctx->timer = sd_event_source_unref (ctx->timer);
+  /* The compiled calendar spec depends on the time zone */
+  window_changed (ctx);
+  reschedule (ctx);
 }
 
 static int
@@ -321,6 +1227,13 @@ time_handler (sd_event_source _unused_(*s), uint64_t _unused_(usec), void *userd
       return 0;
     }
 
+  /* No reboot time was calculated yet */
+  if (ctx->time_unsynced)
+    {
+      reschedule (ctx);
+      return 0;
+    }
+
   if (ctx->reboot_status > 0)
     {
       switch (ctx->reboot_method)
@@ -331,68 +1244,22 @@ time_handler (sd_event_source _unused_(*s), uint64_t _unused_(usec), void *userd
 	case RM_REBOOTMETHOD_SOFT:
 	  log_msg (LOG_INFO, "rebootmgr: soft-reboot triggered now!");
 	  break;
+	case RM_REBOOTMETHOD_KEXEC:
+	  log_msg (LOG_INFO, "rebootmgr: kexec reboot triggered now!");
+	  break;
 	default:
 	  log_msg (LOG_ERR, "rebootmgr: internal error, reboot method is invalid: %i",
 		   ctx->reboot_method);
 	  return -EINVAL;
 	}
 
-      if (debug_flag)
-	{
-	  switch (ctx->reboot_method)
-	    {
-	    case RM_REBOOTMETHOD_HARD:
-	      log_msg (LOG_DEBUG, "systemctl reboot called!");
-	      break;
-	    case RM_REBOOTMETHOD_SOFT:
-	      log_msg (LOG_DEBUG, "systemctl soft-reboot called!");
-	      break;
-	    default:
-	      /* cannot happen */
-	      break;
-	    }
-	}
-      else
-        {
-          pid_t pid = fork();
-
-          if (pid < 0)
-            {
-              log_msg (LOG_ERR, "Calling /usr/bin/systemctl failed: %m");
-            }
-          else if (pid == 0)
-            {
-	      int r;
-
-	      switch (ctx->reboot_method)
-		{
-		case RM_REBOOTMETHOD_HARD:
-                  char envar1[] = "SYSTEMCTL_SKIP_AUTO_SOFT_REBOOT=1";
-                  char *env[] = {envar1, NULL};
-
-                  r = execle ("/usr/bin/systemctl", "systemctl", "reboot",
-			      NULL, env);
-
-		  break;
-		case RM_REBOOTMETHOD_SOFT:
-                  r = execl ("/usr/bin/systemctl", "systemctl", "soft-reboot",
-                             NULL);
-		  break;
-		default:
-		  /* cannot happen */
-		  break;
-		}
-	      if (r < 0)
-		{
-		  log_msg (LOG_ERR, "Calling /usr/bin/systemctl %s failed: %m",
-			   (ctx->reboot_method == RM_REBOOTMETHOD_HARD)?"reboot":"soft-reboot");
-		  exit (1);
-                }
-              exit (0);
-            }
-        }
+      if (defer_for_load (ctx))
+	return 0;
 
-      reset_timer(ctx);
+      if (wait_for_inhibitors (ctx))
+	return 0;
+
+      start_reboot (ctx);
     }
 
   return 0;
@@ -451,7 +1318,8 @@ vl_method_reboot(sd_varlink *link, sd_json_variant *parameters,
     }
 
   if (p.reboot_method != RM_REBOOTMETHOD_HARD &&
-      p.reboot_method != RM_REBOOTMETHOD_SOFT)
+      p.reboot_method != RM_REBOOTMETHOD_SOFT &&
+      p.reboot_method != RM_REBOOTMETHOD_KEXEC)
     return sd_varlink_error_invalid_parameter_name(link, "reboot");
 
   if (ctx->reboot_status != RM_REBOOTSTATUS_NOT_REQUESTED)
@@ -461,9 +1329,10 @@ vl_method_reboot(sd_varlink *link, sd_json_variant *parameters,
 
   ctx->reboot_method = p.reboot_method;
   ctx->reboot_status = RM_REBOOTSTATUS_REQUESTED;
+  ctx->reboot_forced = p.force || ctx->reboot_strategy == RM_REBOOTSTRATEGY_INSTANTLY;
 
   usec_t reboot_time;
-  if (p.force || ctx->reboot_strategy == RM_REBOOTSTRATEGY_INSTANTLY)
+  if (ctx->reboot_forced)
       reboot_time = now(CLOCK_REALTIME);
   else
     {
@@ -472,6 +1341,7 @@ vl_method_reboot(sd_varlink *link, sd_json_variant *parameters,
 	{
 	  ctx->reboot_method = RM_REBOOTMETHOD_UNKNOWN;
 	  ctx->reboot_status = RM_REBOOTSTATUS_NOT_REQUESTED;
+	  ctx->reboot_forced = false;
 	  log_msg(LOG_ERR, "Cannot calculate reboot timer: %s", strerror(-r));
 	  return sd_varlink_error(link,"org.openSUSE.rebootmgr.InternalError", NULL);
 	}
@@ -483,11 +1353,20 @@ vl_method_reboot(sd_varlink *link, sd_json_variant *parameters,
     {
       ctx->reboot_method = RM_REBOOTMETHOD_UNKNOWN;
       ctx->reboot_status = RM_REBOOTSTATUS_NOT_REQUESTED;
+      ctx->reboot_forced = false;
       log_msg(LOG_ERR, "Cannot add reboot timer to event loop: %s", strerror(-r));
       return sd_varlink_errorbo(link, "org.openSUSE.rebootmgr.InternalError", NULL);
     }
   ctx->reboot_status = RM_REBOOTSTATUS_WAITING_WINDOW;
   ctx->reboot_time = reboot_time;
+  arm_prepare (ctx);
+  state_changed (ctx);
+
+  /* Load the kernel now, so that the reboot itself is fast. With a
+     prepare stage, this is one of its steps. */
+  if (ctx->reboot_method == RM_REBOOTMETHOD_KEXEC && !debug_flag &&
+      ctx->prepare_lead == 0 && rm_kexec_load (ctx) < 0)
+    log_msg (LOG_WARNING, "Cannot load kernel for kexec, will try again at reboot time");
 
   return sd_varlink_replybo(link,
 			    SD_JSON_BUILD_PAIR_INTEGER("Method", ctx->reboot_method),
@@ -577,6 +1456,8 @@ vl_method_set_strategy (sd_varlink *link, sd_json_variant *parameters,
       log_msg(LOG_INFO, "Reboot strategy changed to '%s'", str);
     }
 
+  state_changed (ctx);
+
   return sd_varlink_replybo(link, SD_JSON_BUILD_PAIR_BOOLEAN("Success", true));
 }
 
@@ -633,21 +1514,28 @@ vl_method_set_window (sd_varlink *link, sd_json_variant *parameters,
       return sd_varlink_error(link, SD_VARLINK_ERROR_PERMISSION_DENIED, parameters);
     }
 
-  CalendarSpec *new_start = NULL;
-  if (p.start == NULL || strlen (p.start) == 0 ||
-      calendar_spec_from_string (p.start, &new_start) < 0)
+  RM_Window *new_windows = NULL;
+  size_t n_new_windows = 0;
+  r = p.start ? rm_windows_from_string (p.start, &new_windows, &n_new_windows) : -EINVAL;
+  if (r < 0 || n_new_windows == 0)
     {
-      log_msg(LOG_ERR, "Reboot strategy not changed, invalid value for window start (%s)", p.start);
+      if (r == -ERANGE)
+	log_msg(LOG_ERR, "Maintenance window not changed, window start (%s) never matches", p.start);
+      else
+	log_msg(LOG_ERR, "Reboot strategy not changed, invalid value for window start (%s)", p.start);
       return sd_varlink_errorbo(link, "org.openSUSE.rebootmgr.InvalidParameter",
 				SD_JSON_BUILD_PAIR_STRING("Variable", "start time"),
 				SD_JSON_BUILD_PAIR_BOOLEAN("Success", false));
     }
 
-  time_t new_duration;
-  if (p.duration == NULL || strlen(p.duration) == 0 ||
-      (new_duration = parse_duration(p.duration)) == BAD_TIME)
+  _cleanup_(freep) time_t *new_durations = NULL;
+  size_t n_new_durations = 0;
+  if (p.duration == NULL ||
+      rm_durations_from_string (p.duration, &new_durations, &n_new_durations) < 0 ||
+      rm_windows_set_durations (new_windows, n_new_windows,
+				new_durations, n_new_durations) < 0)
     {
-      calendar_spec_free(new_start);
+      rm_windows_free(new_windows, n_new_windows);
 
       log_msg(LOG_ERR, "Reboot strategy not changed, invalid value for duration (%s)", p.duration);
       return sd_varlink_errorbo(link, "org.openSUSE.rebootmgr.InvalidParameter",
@@ -655,24 +1543,24 @@ vl_method_set_window (sd_varlink *link, sd_json_variant *parameters,
 				SD_JSON_BUILD_PAIR_BOOLEAN("Success", false));
     }
 
-  r = save_config(RM_REBOOTSTRATEGY_UNKNOWN, new_start, new_duration);
+  r = save_config(RM_REBOOTSTRATEGY_UNKNOWN, new_windows, n_new_windows);
   if (r < 0)
     {
-      calendar_spec_free(new_start);
+      rm_windows_free(new_windows, n_new_windows);
       log_msg(LOG_ERR, "Maintenance window not changed, saving failed");
       return sd_varlink_errorbo(link, "org.openSUSE.rebootmgr.ErrorWritingConfig",
 				SD_JSON_BUILD_PAIR_BOOLEAN("Success", false));
     }
 
-  calendar_spec_free(ctx->maint_window_start);
-  ctx->maint_window_start = new_start;
-  ctx->maint_window_duration = new_duration;
+  rm_windows_free(ctx->windows, ctx->n_windows);
+  ctx->windows = new_windows;
+  ctx->n_windows = n_new_windows;
+  window_changed (ctx);
 
   /* Informal log message */
+  _cleanup_(freep) char *duration_str = NULL;
   _cleanup_(freep) char *start_str = NULL;
-  _cleanup_(freep) const char *duration_str = NULL;
-  calendar_spec_to_string (ctx->maint_window_start, &start_str);
-  r = rm_duration_to_string (ctx->maint_window_duration, &duration_str);
+  r = rm_windows_to_string (ctx->windows, ctx->n_windows, &start_str, &duration_str);
   if (r >= 0)
     log_msg (LOG_INFO, "Maintenance window changed to '%s', lasting %s",
 	     start_str, duration_str);
@@ -724,6 +1612,18 @@ vl_method_cancel (sd_varlink *link, sd_json_variant *parameters,
       return r;
     }
 
+  /* The lock was acquired for the hooks, or is about to be, nobody
+     else needs to wait */
+  if (ctx->hooks.n_running > 0 || ctx->lock_call)
+    rm_lock_release (ctx);
+
+  if (ctx->reboot_method == RM_REBOOTMETHOD_KEXEC && !debug_flag)
+    {
+      r = rm_kexec_unload ();
+      if (r < 0)
+	log_msg (LOG_WARNING, "Cannot unload kexec kernel: %s", strerror (-r));
+    }
+
   reset_timer(ctx);
 
   return sd_varlink_replybo (link, SD_JSON_BUILD_PAIR_BOOLEAN("Success", true));
@@ -781,6 +1681,10 @@ vl_method_quit (sd_varlink *link, sd_json_variant *parameters,
   ctx->timer = sd_event_source_unref (ctx->timer);
   ctx->reboot_status = RM_REBOOTSTATUS_NOT_REQUESTED;
   ctx->reboot_method = RM_REBOOTMETHOD_UNKNOWN;
+  ctx->reboot_forced = false;
+  state_changed (ctx);
+  /* A pending reboot is restored after the next start */
+  sd_event_source_set_enabled (ctx->save_event, SD_EVENT_OFF);
 
   return sd_varlink_replybo (link, SD_JSON_BUILD_PAIR_BOOLEAN("Success", true));
 }
@@ -805,6 +1709,157 @@ announce_stopping (void)
     log_msg (LOG_ERR, "sd_notify(STOPPING) failed: %s", strerror(-r));
 }
 
+/* rebootmgrd can exit if nobody is connected, nothing is running and
+   the state file is up to date. ret_wakeup is the time the next
+   instance has to be started, 0 if there is no pending reboot. */
+static bool
+daemon_idle (RM_CTX *ctx, usec_t *ret_wakeup)
+{
+  /* temp_off is not saved anywhere */
+  if (sd_varlink_server_current_connections (ctx->varlink_server) > 0 ||
+      ctx->temp_off || ctx->time_unsynced ||
+      ctx->prepare.n_running > 0 || ctx->hooks.n_running > 0 ||
+      ctx->exec_result > 0 || ctx->inhibit_call || ctx->inhibit_match ||
+      ctx->lock_call || ctx->unlock_call ||
+      ctx->saved_status != ctx->reboot_status ||
+      ctx->saved_method != ctx->reboot_method ||
+      ctx->saved_reboot_time != ctx->reboot_time ||
+      ctx->saved_forced != ctx->reboot_forced ||
+      ctx->saved_lock_held != ctx->lock_held)
+    return false;
+
+  *ret_wakeup = 0;
+  if (ctx->reboot_status != RM_REBOOTSTATUS_NOT_REQUESTED)
+    {
+      usec_t lead = ctx->prepare_lead * USEC_PER_SEC;
+      usec_t wakeup = ctx->reboot_time > lead ? ctx->reboot_time - lead : 0;
+
+      /* Not worth to exit */
+      if (wakeup < now (CLOCK_REALTIME) + 2 * RM_IDLE_TIMEOUT_USEC)
+	return false;
+      *ret_wakeup = wakeup;
+    }
+
+  return true;
+}
+
+static int
+idle_handler (sd_event_source *s, uint64_t _unused_(usec), void *userdata)
+{
+  RM_CTX *ctx = userdata;
+  usec_t wakeup;
+  int r;
+
+  if (daemon_idle (ctx, &wakeup))
+    {
+      r = rm_wakeup_schedule (ctx, wakeup);
+      if (r >= 0)
+	{
+	  if (verbose_flag)
+	    log_msg (LOG_INFO, "Nothing to do, exiting");
+	  return sd_event_exit (ctx->loop, 0);
+	}
+      log_msg (LOG_WARNING, "Cannot schedule the restart of rebootmgrd, not exiting: %s",
+	       strerror (-r));
+    }
+
+  r = sd_event_source_set_time_relative (s, RM_IDLE_TIMEOUT_USEC);
+  if (r >= 0)
+    r = sd_event_source_set_enabled (s, SD_EVENT_ONESHOT);
+
+  return r;
+}
+
+/* Re-arm the timer of a reboot requested before rebootmgrd got
+   restarted */
+static int
+restore_state (RM_CTX *ctx)
+{
+  RM_RebootStatus status;
+  RM_RebootMethod method;
+  usec_t reboot_time;
+  bool forced, lock_held;
+  const char *str;
+  char buf[FORMAT_TIMESTAMP_MAX];
+  int r;
+
+  r = load_state (RM_STATE_FILE, &status, &method, &reboot_time, &forced,
+		  &lock_held);
+  if (r == -ENOENT)
+    return 0;
+  if (r < 0)
+    {
+      log_msg (LOG_WARNING, "Ignoring '"RM_STATE_FILE"': %s", strerror (-r));
+      return 0;
+    }
+
+  ctx->saved_status = status;
+  ctx->saved_method = method;
+  ctx->saved_reboot_time = reboot_time;
+  ctx->saved_forced = forced;
+  ctx->saved_lock_held = lock_held;
+
+  /* A lock held by us is from before the last reboot, give it back */
+  if (lock_held)
+    {
+      ctx->lock_held = true;
+      rm_lock_release (ctx);
+      state_changed (ctx);
+    }
+
+  if (status == RM_REBOOTSTATUS_NOT_REQUESTED ||
+      method == RM_REBOOTMETHOD_UNKNOWN)
+    return 0;
+
+  ctx->reboot_method = method;
+  ctx->reboot_status = RM_REBOOTSTATUS_REQUESTED;
+  ctx->reboot_forced = forced;
+
+  /* The reboot time passed while rebootmgrd was not running, or a
+     blackout was configured meanwhile: schedule it again according to
+     the current strategy. A forced reboot is overdue, it happens now. */
+  if (forced)
+    {
+      if (reboot_time < now (CLOCK_REALTIME))
+	reboot_time = now (CLOCK_REALTIME);
+    }
+  else if (reboot_time < now (CLOCK_REALTIME) ||
+	   rm_blackout_end (ctx->blackouts, ctx->n_blackouts, reboot_time) != reboot_time)
+    {
+      if (ctx->reboot_strategy == RM_REBOOTSTRATEGY_INSTANTLY)
+	reboot_time = now (CLOCK_REALTIME);
+      else
+	{
+	  r = calc_reboot_time (ctx, &reboot_time);
+	  if (r < 0)
+	    {
+	      log_msg (LOG_ERR, "Cannot calculate reboot timer: %s", strerror (-r));
+	      reset_timer (ctx);
+	      return 0;
+	    }
+	}
+    }
+
+  r = sd_event_add_time (ctx->loop, &ctx->timer, CLOCK_REALTIME,
+			 reboot_time, 0, time_handler, ctx);
+  if (r < 0)
+    {
+      log_msg (LOG_ERR, "Cannot add reboot timer to event loop: %s", strerror (-r));
+      reset_timer (ctx);
+      return r;
+    }
+  ctx->reboot_status = RM_REBOOTSTATUS_WAITING_WINDOW;
+  ctx->reboot_time = reboot_time;
+  arm_prepare (ctx);
+  state_changed (ctx);
+
+  rm_method_to_str (ctx->reboot_method, &str);
+  log_msg (LOG_INFO, "Restored %s scheduled for %s", str,
+	   format_timestamp (buf, sizeof (buf), ctx->reboot_time));
+
+  return 0;
+}
+
 static int
 varlink_server_loop(sd_varlink_server *server, RM_CTX *ctx)
 {
@@ -816,6 +1871,30 @@ varlink_server_loop(sd_varlink_server *server, RM_CTX *ctx)
   if (r < 0)
     return r;
 
+  /* Enabled by state_changed() if somebody subscribed */
+  r = sd_event_add_defer(ctx->loop, &ctx->notify_event, notify_subscribers, ctx);
+  if (r < 0)
+    return r;
+  r = sd_event_source_set_enabled(ctx->notify_event, SD_EVENT_OFF);
+  if (r < 0)
+    return r;
+
+  r = sd_event_add_defer(ctx->loop, &ctx->save_event, save_state_handler, ctx);
+  if (r < 0)
+    return r;
+  r = sd_event_source_set_enabled(ctx->save_event, SD_EVENT_OFF);
+  if (r < 0)
+    return r;
+
+  r = rm_clock_watch(ctx, clock_changed);
+  if (r < 0)
+    log_msg(LOG_WARNING, "Cannot watch for changes of the system clock: %s",
+	    strerror(-r));
+
+  r = restore_state(ctx);
+  if (r < 0)
+    return r;
+
   r = sd_varlink_server_set_exit_on_idle(server, false);
   if (r < 0)
     return r;
@@ -828,6 +1907,16 @@ varlink_server_loop(sd_varlink_server *server, RM_CTX *ctx)
   if (r < 0)
     return r;
 
+  /* Started by rebootmgr.socket, systemd starts us again on demand */
+  if (r > 0)
+    {
+      ctx->varlink_server = server;
+      r = sd_event_add_time_relative(ctx->loop, &ctx->idle_event, CLOCK_MONOTONIC,
+				     RM_IDLE_TIMEOUT_USEC, 0, idle_handler, ctx);
+      if (r < 0)
+	return r;
+    }
+
   announce_ready();
   r = sd_event_loop (ctx->loop);
   announce_stopping();
@@ -878,13 +1967,16 @@ run_varlink (RM_CTX *ctx)
 					 "org.openSUSE.rebootmgr.Cancel",         vl_method_cancel,
 					 "org.openSUSE.rebootmgr.FullStatus",     vl_method_fullstatus,
 					 "org.openSUSE.rebootmgr.GetEnvironment", vl_method_get_environment,
+					 "org.openSUSE.rebootmgr.InWindow",       vl_method_in_window,
+					 "org.openSUSE.rebootmgr.ListWindows",    vl_method_list_windows,
 					 "org.openSUSE.rebootmgr.Ping",           vl_method_ping,
 					 "org.openSUSE.rebootmgr.Quit",           vl_method_quit,
 					 "org.openSUSE.rebootmgr.Reboot",         vl_method_reboot,
 					 "org.openSUSE.rebootmgr.SetLogLevel",    vl_method_set_log_level,
 					 "org.openSUSE.rebootmgr.SetStrategy",    vl_method_set_strategy,
 					 "org.openSUSE.rebootmgr.SetWindow",      vl_method_set_window,
-					 "org.openSUSE.rebootmgr.Status",         vl_method_status);
+					 "org.openSUSE.rebootmgr.Status",         vl_method_status,
+					 "org.openSUSE.rebootmgr.Subscribe",      vl_method_subscribe);
   if (r < 0)
     {
       log_msg(LOG_ERR, "Failed to bind Varlink methods: %s",
@@ -892,18 +1984,30 @@ run_varlink (RM_CTX *ctx)
       return r;
     }
 
-  r = mkdir_p(RM_VARLINK_SOCKET_DIR, 0755);
+  r = sd_varlink_server_bind_disconnect(varlink_server, vl_disconnect);
   if (r < 0)
     {
-      log_msg(LOG_ERR, "Failed to create directory '"RM_VARLINK_SOCKET_DIR"' for Varlink socket: %s",
+      log_msg(LOG_ERR, "Failed to bind Varlink disconnect handler: %s",
 	      strerror(-r));
       return r;
     }
-  r = sd_varlink_server_listen_address(varlink_server, RM_VARLINK_SOCKET, 0666);
-  if (r < 0)
+
+  /* The socket is passed by systemd if started by rebootmgr.socket */
+  if (sd_listen_fds (0) <= 0)
     {
-      log_msg(LOG_ERR, "Failed to bind to Varlink socket: %s", strerror (-r));
-      return r;
+      r = mkdir_p(RM_VARLINK_SOCKET_DIR, 0755);
+      if (r < 0)
+	{
+	  log_msg(LOG_ERR, "Failed to create directory '"RM_VARLINK_SOCKET_DIR"' for Varlink socket: %s",
+		  strerror(-r));
+	  return r;
+	}
+      r = sd_varlink_server_listen_address(varlink_server, RM_VARLINK_SOCKET, 0666);
+      if (r < 0)
+	{
+	  log_msg(LOG_ERR, "Failed to bind to Varlink socket: %s", strerror (-r));
+	  return r;
+	}
     }
 
   r = varlink_server_loop(varlink_server, ctx);
@@ -931,16 +2035,49 @@ create_context (RM_CTX **ctx)
    * RM_RebootStatus
    * RM_RebootMethod
    * RM_RebootStrategy
-   * CalendarSpec
-   * Maintenance Window Duration
+   * maintenance windows
    * temporary off
+   * event loop, reboot timer and forced request
+   * maintenance window string and index
+   * blackouts
+   * state version and cached replies
+   * subscribers
+   * reboot request in the state file
+   * lock server and lock group
+   * jitter mode
+   * failure domain
+   * reboot executor
+   * kexec kernel, initrd and command line
+   * prepare stage
+   * hooks
+   * load limits
+   * logind inhibitors
+   * clock watch
+   * idle exit
    */
   **ctx = (RM_CTX) {RM_REBOOTSTATUS_NOT_REQUESTED,
 		   RM_REBOOTMETHOD_UNKNOWN,
 		   RM_REBOOTSTRATEGY_BEST_EFFORT,
-		   NULL, 3600, 0,
-		   NULL, NULL, 0};
-  calendar_spec_from_string("03:30", &(*ctx)->maint_window_start);
+		   NULL, 0, 0,
+		   NULL, NULL, 0, false,
+		   NULL, {},
+		   NULL, NULL, NULL, 0,
+		   0, NULL, 0, NULL, 0,
+		   NULL, 0, NULL,
+		   RM_REBOOTSTATUS_NOT_REQUESTED, RM_REBOOTMETHOD_UNKNOWN, 0, false, false, NULL,
+		   NULL, NULL, NULL, NULL, NULL, false, RM_JITTER_RANDOM,
+		   NULL, 0, -1,
+		   NULL, NULL, NULL, RM_REBOOTMETHOD_UNKNOWN, 0, NULL,
+		   NULL, NULL, NULL,
+		   0, NULL, NULL, {},
+		   RM_HOOK_TIMEOUT_DEFAULT, {},
+		   0, 0,
+		   NULL, NULL, NULL, false, 0,
+		   NULL, NULL, NULL, false, false,
+		   NULL, NULL};
+  (*ctx)->prepare = (RM_TaskSet) {"Prepare step", *ctx, NULL, 0, 0, prepare_changed};
+  (*ctx)->hooks = (RM_TaskSet) {"Hook", *ctx, NULL, 0, 0, hooks_changed};
+  rm_windows_from_string ("03:30", &(*ctx)->windows, &(*ctx)->n_windows);
 
   return 0;
 }
@@ -951,7 +2088,34 @@ destroy_context (RM_CTX *ctx)
   if (ctx == NULL)
     return -EBADF;
 
-  calendar_spec_free (ctx->maint_window_start);
+  rm_windows_free (ctx->windows, ctx->n_windows);
+  free (ctx->maint_window_str);
+  rm_window_index_reset (&ctx->window_index);
+  free (ctx->blackout);
+  free (ctx->blackout_file);
+  free (ctx->blackouts);
+  rm_lock_done (ctx);
+  free (ctx->lock_server);
+  free (ctx->lock_group);
+  free (ctx->failure_domain);
+  free (ctx->kexec_kernel);
+  free (ctx->kexec_initrd);
+  free (ctx->kexec_cmdline);
+  free (ctx->prepare_units);
+  rm_task_set_reset (&ctx->prepare);
+  rm_task_set_reset (&ctx->hooks);
+  sd_event_source_unref (ctx->prepare_timer);
+  sd_json_variant_unref (ctx->status_reply);
+  sd_json_variant_unref (ctx->fullstatus_reply);
+  for (size_t i = 0; i < ctx->n_subscribers; i++)
+    sd_varlink_unref (ctx->subscribers[i]);
+  free (ctx->subscribers);
+  sd_event_source_unref (ctx->notify_event);
+  sd_event_source_unref (ctx->save_event);
+  rm_inhibit_reset (ctx);
+  rm_exec_done (ctx);
+  rm_clock_done (ctx);
+  sd_event_source_unref (ctx->idle_event);
   sd_event_unrefp(&(ctx->loop));
   free (ctx);
 
@@ -1042,6 +2206,8 @@ main (int argc, char **argv)
       return -r;
     }
 
+  window_changed (ctx);
+
   if (verbose_flag)
     log_msg (LOG_INFO, "Starting rebootmgrd (%s) %s...", PACKAGE, VERSION);
 
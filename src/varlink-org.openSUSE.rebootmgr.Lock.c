@@ -0,0 +1,30 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "varlink-org.openSUSE.rebootmgr.Lock.h"
+
+static SD_VARLINK_DEFINE_METHOD(
+		Acquire,
+		SD_VARLINK_FIELD_COMMENT("Name of the group of machines sharing the slots"),
+		SD_VARLINK_DEFINE_INPUT(Group, SD_VARLINK_STRING, 0),
+		SD_VARLINK_FIELD_COMMENT("Unique name of the machine, e.g. the hostname"),
+		SD_VARLINK_DEFINE_INPUT(Holder, SD_VARLINK_STRING, 0),
+		SD_VARLINK_FIELD_COMMENT("True if the holder owns a slot now"),
+		SD_VARLINK_DEFINE_OUTPUT(Acquired, SD_VARLINK_BOOL, 0),
+		SD_VARLINK_DEFINE_OUTPUT(Slots, SD_VARLINK_INT, 0),
+		SD_VARLINK_DEFINE_OUTPUT(Used, SD_VARLINK_INT, 0));
+
+static SD_VARLINK_DEFINE_METHOD(
+		Release,
+		SD_VARLINK_DEFINE_INPUT(Group, SD_VARLINK_STRING, 0),
+		SD_VARLINK_DEFINE_INPUT(Holder, SD_VARLINK_STRING, 0),
+		SD_VARLINK_FIELD_COMMENT("False if the holder did not own a slot"),
+		SD_VARLINK_DEFINE_OUTPUT(Released, SD_VARLINK_BOOL, 0));
+
+SD_VARLINK_DEFINE_INTERFACE(
+                org_openSUSE_rebootmgr_Lock,
+                "org.openSUSE.rebootmgr.Lock",
+		SD_VARLINK_INTERFACE_COMMENT("Limit the number of machines rebooting at the same time"),
+		SD_VARLINK_SYMBOL_COMMENT("Take one of the reboot slots of a group"),
+                &vl_method_Acquire,
+		SD_VARLINK_SYMBOL_COMMENT("Give the reboot slot back"),
+                &vl_method_Release);
@@ -0,0 +1,7 @@
+//SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <systemd/sd-varlink-idl.h>
+
+extern const sd_varlink_interface vl_interface_org_openSUSE_rebootmgr_Lock;
@@ -26,7 +26,9 @@ static SD_VARLINK_DEFINE_METHOD(
 static SD_VARLINK_DEFINE_METHOD(
 		SetWindow,
 		SD_VARLINK_FIELD_COMMENT("Set new maintenance window"),
+		SD_VARLINK_FIELD_COMMENT("Calendar events, several windows are separated by ';'"),
 		SD_VARLINK_DEFINE_INPUT(Start, SD_VARLINK_STRING, 0),
+		SD_VARLINK_FIELD_COMMENT("One duration for all windows or one per window"),
 		SD_VARLINK_DEFINE_INPUT(Duration, SD_VARLINK_STRING, 0),
 		SD_VARLINK_DEFINE_OUTPUT(Variable, SD_VARLINK_STRING, SD_VARLINK_NULLABLE),
 		SD_VARLINK_DEFINE_OUTPUT(Success, SD_VARLINK_BOOL, 0));
@@ -39,6 +41,22 @@ static SD_VARLINK_DEFINE_METHOD(
 		SD_VARLINK_DEFINE_OUTPUT(RebootTime, SD_VARLINK_STRING, SD_VARLINK_NULLABLE),
 		SD_VARLINK_DEFINE_OUTPUT(RebootDisabled, SD_VARLINK_BOOL, SD_VARLINK_NULLABLE));
 
+static SD_VARLINK_DEFINE_STRUCT_TYPE(
+		Task,
+		SD_VARLINK_FIELD_COMMENT("Name of the prepare step or hook"),
+		SD_VARLINK_DEFINE_FIELD(Name, SD_VARLINK_STRING, 0),
+		SD_VARLINK_FIELD_COMMENT("running, done, failed or timeout"),
+		SD_VARLINK_DEFINE_FIELD(Result, SD_VARLINK_STRING, 0),
+		SD_VARLINK_FIELD_COMMENT("Runtime of a finished task in microseconds"),
+		SD_VARLINK_DEFINE_FIELD(Duration, SD_VARLINK_INT, SD_VARLINK_NULLABLE));
+
+static SD_VARLINK_DEFINE_STRUCT_TYPE(
+		WindowSpec,
+		SD_VARLINK_FIELD_COMMENT("Calendar event the window begins at"),
+		SD_VARLINK_DEFINE_FIELD(Start, SD_VARLINK_STRING, 0),
+		SD_VARLINK_FIELD_COMMENT("Length of the window in seconds"),
+		SD_VARLINK_DEFINE_FIELD(Duration, SD_VARLINK_INT, 0));
+
 static SD_VARLINK_DEFINE_METHOD(
 		FullStatus,
 		SD_VARLINK_FIELD_COMMENT("Provide full status of rebootmgr"),
@@ -47,8 +65,54 @@ static SD_VARLINK_DEFINE_METHOD(
 		SD_VARLINK_DEFINE_OUTPUT(RequestedMethod, SD_VARLINK_INT, SD_VARLINK_NULLABLE),
 		SD_VARLINK_DEFINE_OUTPUT(RebootTime, SD_VARLINK_STRING, SD_VARLINK_NULLABLE),
 		SD_VARLINK_DEFINE_OUTPUT(RebootDisabled, SD_VARLINK_BOOL, SD_VARLINK_NULLABLE),
+		SD_VARLINK_FIELD_COMMENT("Start of all maintenance windows, separated by ';'"),
+		SD_VARLINK_DEFINE_OUTPUT(MaintenanceWindowStart, SD_VARLINK_STRING, SD_VARLINK_NULLABLE),
+		SD_VARLINK_FIELD_COMMENT("Duration of the first maintenance window"),
+		SD_VARLINK_DEFINE_OUTPUT(MaintenanceWindowDuration, SD_VARLINK_INT, SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT_BY_TYPE(MaintenanceWindows, WindowSpec, SD_VARLINK_ARRAY|SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT_BY_TYPE(Prepare, Task, SD_VARLINK_ARRAY|SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT_BY_TYPE(Hooks, Task, SD_VARLINK_ARRAY|SD_VARLINK_NULLABLE));
+
+static SD_VARLINK_DEFINE_METHOD_FULL(
+		Subscribe,
+		SD_VARLINK_REQUIRES_MORE,
+		SD_VARLINK_FIELD_COMMENT("Full status of rebootmgr, sent again after every change"),
+		SD_VARLINK_DEFINE_OUTPUT(RebootStatus, SD_VARLINK_INT, 0),
+		SD_VARLINK_DEFINE_OUTPUT(RebootStrategy, SD_VARLINK_INT, 0),
+		SD_VARLINK_DEFINE_OUTPUT(RequestedMethod, SD_VARLINK_INT, SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT(RebootTime, SD_VARLINK_STRING, SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT(RebootDisabled, SD_VARLINK_BOOL, SD_VARLINK_NULLABLE),
+		SD_VARLINK_FIELD_COMMENT("Start of all maintenance windows, separated by ';'"),
 		SD_VARLINK_DEFINE_OUTPUT(MaintenanceWindowStart, SD_VARLINK_STRING, SD_VARLINK_NULLABLE),
-		SD_VARLINK_DEFINE_OUTPUT(MaintenanceWindowDuration, SD_VARLINK_INT, SD_VARLINK_NULLABLE));
+		SD_VARLINK_FIELD_COMMENT("Duration of the first maintenance window"),
+		SD_VARLINK_DEFINE_OUTPUT(MaintenanceWindowDuration, SD_VARLINK_INT, SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT_BY_TYPE(MaintenanceWindows, WindowSpec, SD_VARLINK_ARRAY|SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT_BY_TYPE(Prepare, Task, SD_VARLINK_ARRAY|SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT_BY_TYPE(Hooks, Task, SD_VARLINK_ARRAY|SD_VARLINK_NULLABLE));
+
+static SD_VARLINK_DEFINE_STRUCT_TYPE(
+		Window,
+		SD_VARLINK_FIELD_COMMENT("Begin of the maintenance window in microseconds since the epoch"),
+		SD_VARLINK_DEFINE_FIELD(Start, SD_VARLINK_INT, 0),
+		SD_VARLINK_FIELD_COMMENT("End of the maintenance window in microseconds since the epoch"),
+		SD_VARLINK_DEFINE_FIELD(End, SD_VARLINK_INT, 0));
+
+static SD_VARLINK_DEFINE_METHOD(
+		ListWindows,
+		SD_VARLINK_FIELD_COMMENT("List the next maintenance windows"),
+		SD_VARLINK_DEFINE_INPUT(Count, SD_VARLINK_INT, SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_INPUT(After, SD_VARLINK_INT, SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT_BY_TYPE(Windows, Window, SD_VARLINK_ARRAY));
+
+static SD_VARLINK_DEFINE_METHOD(
+		InWindow,
+		SD_VARLINK_FIELD_COMMENT("Check if a point in time is inside a maintenance window"),
+		SD_VARLINK_DEFINE_INPUT(Time, SD_VARLINK_INT, SD_VARLINK_NULLABLE),
+		SD_VARLINK_DEFINE_OUTPUT(Inside, SD_VARLINK_BOOL, 0),
+		SD_VARLINK_FIELD_COMMENT("Begin of the open window in microseconds since the epoch"),
+		SD_VARLINK_DEFINE_OUTPUT(Start, SD_VARLINK_INT, SD_VARLINK_NULLABLE),
+		SD_VARLINK_FIELD_COMMENT("End of the open window in microseconds since the epoch"),
+		SD_VARLINK_DEFINE_OUTPUT(End, SD_VARLINK_INT, SD_VARLINK_NULLABLE));
 
 static SD_VARLINK_DEFINE_METHOD(
 		Quit,
@@ -93,6 +157,18 @@ SD_VARLINK_DEFINE_INTERFACE(
                 &vl_method_Status,
 		SD_VARLINK_SYMBOL_COMMENT("Current status and configuration"),
                 &vl_method_FullStatus,
+		SD_VARLINK_SYMBOL_COMMENT("Step of the preparation of a reboot"),
+                &vl_type_Task,
+		SD_VARLINK_SYMBOL_COMMENT("One configured maintenance window"),
+                &vl_type_WindowSpec,
+		SD_VARLINK_SYMBOL_COMMENT("Follow status and configuration changes"),
+                &vl_method_Subscribe,
+		SD_VARLINK_SYMBOL_COMMENT("Next occurrences of the maintenance window"),
+                &vl_method_ListWindows,
+		SD_VARLINK_SYMBOL_COMMENT("Begin and end of one maintenance window"),
+                &vl_type_Window,
+		SD_VARLINK_SYMBOL_COMMENT("Is the maintenance window open"),
+                &vl_method_InWindow,
 		SD_VARLINK_SYMBOL_COMMENT("Stop the daemon"),
                 &vl_method_Quit,
 		&vl_method_Ping,
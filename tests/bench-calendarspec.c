@@ -0,0 +1,268 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* Micro benchmark for the calendarspec and parse-duration code.
+
+   Every operation is run on a corpus of specs in several time zones,
+   the result is printed as one JSON object with ns/op, allocations/op
+   and percentiles, so that releases can be compared:
+
+     meson test -C build --benchmark
+     build/tests/bench-calendarspec [ITERATIONS] > result.json */
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "basics.h"
+#include "calendarspec.h"
+#include "parse-duration.h"
+#include "time-util.h"
+
+#define assert_se assert
+
+#define DEFAULT_ITERATIONS 1000
+
+#ifdef __GLIBC__
+/* Count allocations by interposing the allocator. glibc routes its own
+   calls through these too, so the allocations of mktime() and
+   open_memstream() are part of the result. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static unsigned long n_allocs;
+
+void *malloc(size_t size) {
+        n_allocs++;
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+        n_allocs++;
+        return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+        n_allocs++;
+        return __libc_realloc(p, size);
+}
+
+#define HAVE_ALLOC_COUNT 1
+#else
+static unsigned long n_allocs;
+#define HAVE_ALLOC_COUNT 0
+#endif
+
+static const char *const specs[] = {
+        /* Typical maintenance windows */
+        "03:30",
+        "Mon,Wed,Fri *-*-* 04:00",
+        "Sat *-*-1,2,3,4,5,6,7 02:00",
+        "hourly",
+        "quarterly",
+        "*-*-* 00:00:00 UTC",
+        /* Inside the DST gap of Europe */
+        "*-*-* 02:30",
+        /* Leap days, the second one only matches every 28 years */
+        "*-02-29 03:30",
+        "Mon *-02-29 03:30",
+        /* Sparse years */
+        "2030,2040,2050-01-01 00:00",
+        "2026/7-06-15 12:00",
+        /* Repetitions in every field */
+        "*-1/2-1/3 0/4:0/15:0/20",
+        /* Many-comma lists */
+        "*-*-1,3,5,7,9,11,13,15,17,19,21,23,25,27,29,31 "
+        "0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23:"
+        "0,5,10,15,20,25,30,35,40,45,50,55:0,10,20,30,40,50",
+        "*:*:*",
+};
+
+static const char *const durations[] = {
+        "1h",
+        "1h30m",
+        "01:30:00",
+        "90m",
+        "2h 15m 30s",
+        "013000",
+        "1:00",
+};
+
+static const char *const zones[] = {
+        "UTC",
+        "Europe/Berlin",
+        "America/New_York",
+        "Australia/Lord_Howe",
+};
+
+static unsigned iterations = DEFAULT_ITERATIONS;
+static usec_t base;
+static bool first_result = true;
+
+typedef void (*bench_fn)(const char *input, CalendarSpec *spec, unsigned i);
+
+static uint64_t now_ns(void) {
+        struct timespec ts;
+
+        assert_se(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+
+        return (uint64_t) ts.tv_sec * UINT64_C(1000000000) + (uint64_t) ts.tv_nsec;
+}
+
+static int uint64_compare(const void *_a, const void *_b) {
+        const uint64_t *a = _a, *b = _b;
+
+        return *a < *b ? -1 : *a > *b;
+}
+
+static void print_json_string(const char *s) {
+        putchar('"');
+
+        for (; *s; s++) {
+                if (*s == '"' || *s == '\\')
+                        printf("\\%c", *s);
+                else if ((unsigned char) *s < ' ')
+                        printf("\\u%04x", (unsigned char) *s);
+                else
+                        putchar(*s);
+        }
+
+        putchar('"');
+}
+
+static void measure(const char *op, const char *input, const char *tz,
+                    bench_fn fn, CalendarSpec *spec, unsigned n) {
+        uint64_t *samples, total = 0;
+        unsigned long allocs;
+        unsigned i;
+
+        samples = calloc(n, sizeof(uint64_t));
+        assert_se(samples);
+
+        /* Warm up caches and the time zone state of glibc */
+        for (i = 0; i < n / 10 + 1; i++)
+                fn(input, spec, i);
+
+        allocs = n_allocs;
+        for (i = 0; i < n; i++) {
+                uint64_t t = now_ns();
+
+                fn(input, spec, i);
+                samples[i] = now_ns() - t;
+                total += samples[i];
+        }
+        allocs = n_allocs - allocs;
+
+        qsort(samples, n, sizeof(uint64_t), uint64_compare);
+
+        printf("%s\n    {\"op\": ", first_result ? "" : ",");
+        first_result = false;
+        print_json_string(op);
+        printf(", \"input\": ");
+        print_json_string(input);
+        printf(", \"tz\": ");
+        if (tz)
+                print_json_string(tz);
+        else
+                printf("null");
+        printf(", \"iterations\": %u, \"ns_per_op\": %.1f, \"allocs_per_op\": ", n, (double) total / n);
+        if (HAVE_ALLOC_COUNT)
+                printf("%.2f", (double) allocs / n);
+        else
+                printf("null");
+        printf(", \"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 "}",
+               samples[n / 2], samples[n * 9 / 10], samples[n * 99 / 100], samples[n - 1]);
+
+        free(samples);
+}
+
+static void bench_from_string(const char *input, CalendarSpec _unused_(*spec), unsigned _unused_(i)) {
+        CalendarSpec *c;
+
+        assert_se(calendar_spec_from_string(input, &c) >= 0);
+        calendar_spec_free(c);
+}
+
+static void bench_to_string(const char _unused_(*input), CalendarSpec *spec, unsigned _unused_(i)) {
+        char *p;
+
+        assert_se(calendar_spec_to_string(spec, &p) >= 0);
+        free(p);
+}
+
+/* Start times are spread over a year, so that every month and both
+   sides of DST changes are covered */
+static void bench_next_usec(const char _unused_(*input), CalendarSpec *spec, unsigned i) {
+        usec_t u;
+        int r;
+
+        r = calendar_spec_next_usec(spec, base + (usec_t) (i * 7919 % 31536000) * USEC_PER_SEC, &u);
+        assert_se(r >= 0 || r == -ENOENT);
+}
+
+static void bench_compile(const char _unused_(*input), CalendarSpec *spec, unsigned _unused_(i)) {
+        assert_se(calendar_spec_compile(spec) >= 0);
+}
+
+static void bench_parse_duration(const char *input, CalendarSpec _unused_(*spec), unsigned _unused_(i)) {
+        assert_se(parse_duration(input) != BAD_TIME);
+}
+
+static void bench_spec(const char *input, const char *tz) {
+        CalendarSpec *spec;
+
+        assert_se(calendar_spec_from_string(input, &spec) >= 0);
+
+        measure("from_string", input, tz, bench_from_string, NULL, iterations);
+        measure("to_string", input, tz, bench_to_string, spec, iterations);
+        measure("next_usec", input, tz, bench_next_usec, spec, iterations);
+
+        /* Probing the time zone is expensive, fewer rounds are enough */
+        measure("compile", input, tz, bench_compile, spec, iterations / 100 + 1);
+        measure("next_usec_compiled", input, tz, bench_next_usec, spec, iterations);
+
+        calendar_spec_free(spec);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned i, j;
+
+        if (argc > 1) {
+                char *e;
+
+                errno = 0;
+                iterations = strtoul(argv[1], &e, 10);
+                if (errno != 0 || *e != 0 || iterations == 0) {
+                        fprintf(stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        /* Start of the current day, inside the range the compiled
+           form covers */
+        base = now(CLOCK_REALTIME) / USEC_PER_DAY * USEC_PER_DAY;
+
+        printf("{\n  \"iterations\": %u,\n  \"results\": [", iterations);
+
+        for (i = 0; i < ELEMENTSOF(zones); i++) {
+                assert_se(setenv("TZ", zones[i], 1) >= 0);
+                tzset();
+
+                for (j = 0; j < ELEMENTSOF(specs); j++)
+                        bench_spec(specs[j], zones[i]);
+        }
+
+        for (j = 0; j < ELEMENTSOF(durations); j++)
+                measure("parse_duration", durations[j], NULL, bench_parse_duration, NULL, iterations);
+
+        printf("\n  ]\n}\n");
+
+        return 0;
+}
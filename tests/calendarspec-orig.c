@@ -0,0 +1,18 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* Build lib/calendarspec/orig/calendarspec.c as it is, as the reference
+   for test-calendarspec-compile. Its functions are renamed, so that
+   they don't clash with lib/calendarspec, and the headers of systemd
+   it includes are taken from tests/orig. */
+
+#define CalendarSpec OrigCalendarSpec
+#define calendar_spec_free orig_calendar_spec_free
+#define calendar_spec_normalize orig_calendar_spec_normalize
+#define calendar_spec_valid orig_calendar_spec_valid
+#define calendar_spec_to_string orig_calendar_spec_to_string
+#define calendar_spec_from_string orig_calendar_spec_from_string
+#define calendar_spec_next_usec orig_calendar_spec_next_usec
+
+#include "../lib/calendarspec/orig/calendarspec.c"
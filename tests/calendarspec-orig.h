@@ -0,0 +1,17 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* The unmodified calendarspec.c of lib/calendarspec/orig, built under
+   other names, see calendarspec-orig.c. It has no time zones, only
+   UTC or the local time. */
+
+#pragma once
+
+#include "time-util.h"
+
+typedef struct OrigCalendarSpec OrigCalendarSpec;
+
+int orig_calendar_spec_from_string(const char *p, OrigCalendarSpec **spec);
+int orig_calendar_spec_next_usec(const OrigCalendarSpec *spec, usec_t usec, usec_t *next);
+void orig_calendar_spec_free(OrigCalendarSpec *spec);
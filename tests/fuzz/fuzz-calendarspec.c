@@ -0,0 +1,68 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* Parse the input as calendar spec, check that it survives a round trip
+   through calendar_spec_to_string() and evaluate it the ways rebootmgrd
+   does, uncompiled and compiled. */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calendarspec.h"
+#include "fuzz.h"
+
+#define assert_se assert
+
+/* 2027-01-01 00:00:00 UTC, fixed so that a slow input stays slow */
+#define FUZZ_START_USEC ((usec_t) 1798761600 * USEC_PER_SEC)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+        static bool initialized = false;
+        CalendarSpec *c = NULL, *d = NULL;
+        char *p, *s = NULL, *t = NULL;
+        usec_t start, next, ws, we, n[16];
+
+        if (size > FUZZ_INPUT_MAX)
+                return 0;
+
+        /* A zone with clock changes, specs without one use it */
+        if (!initialized) {
+                assert_se(setenv("TZ", "Europe/Berlin", 1) >= 0);
+                tzset();
+                initialized = true;
+        }
+
+        p = strndup((const char *) data, size);
+        assert_se(p);
+
+        start = now(CLOCK_MONOTONIC);
+
+        if (calendar_spec_from_string(p, &c) < 0)
+                goto finish;
+
+        assert_se(calendar_spec_to_string(c, &s) >= 0);
+        assert_se(calendar_spec_from_string(s, &d) >= 0);
+        assert_se(calendar_spec_to_string(d, &t) >= 0);
+        assert_se(strcmp(s, t) == 0);
+
+        (void) calendar_spec_next_usec(c, FUZZ_START_USEC, &next);
+        (void) calendar_spec_window_contains(c, USEC_PER_HOUR, FUZZ_START_USEC, &ws, &we);
+
+        assert_se(calendar_spec_compile(c) >= 0);
+        (void) calendar_spec_next_n_usec(c, FUZZ_START_USEC, ELEMENTSOF(n), n);
+        (void) calendar_spec_window_contains(c, USEC_PER_HOUR, FUZZ_START_USEC, &ws, &we);
+
+finish:
+        fuzz_check_budget("calendar_spec", start, data, size);
+
+        calendar_spec_free(c);
+        calendar_spec_free(d);
+        free(p);
+        free(s);
+        free(t);
+
+        return 0;
+}
@@ -0,0 +1,139 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* Driver for the harnesses if they are not linked with libFuzzer:
+
+     fuzz-calendarspec [FILE|DIRECTORY...]
+
+   runs every file given, or every file in a given directory, and prints
+   how long each one took and which one was the slowest. Without
+   arguments one input is read from stdin, which is how AFL runs it. */
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+
+#define assert_se assert
+
+static usec_t slowest = 0;
+static char *slowest_path = NULL;
+static unsigned n_inputs = 0;
+
+static int read_input(FILE *f, uint8_t **ret, size_t *ret_size) {
+        uint8_t *buf = NULL;
+        size_t size = 0, n;
+
+        do {
+                uint8_t *b = realloc(buf, size + 4096);
+                if (!b) {
+                        free(buf);
+                        return -ENOMEM;
+                }
+                buf = b;
+                n = fread(buf + size, 1, 4096, f);
+                size += n;
+        } while (n > 0);
+
+        if (ferror(f)) {
+                free(buf);
+                return -EIO;
+        }
+
+        *ret = buf;
+        *ret_size = size;
+        return 0;
+}
+
+static int run_file(const char *path) {
+        uint8_t *data;
+        size_t size;
+        usec_t start, t;
+        FILE *f;
+        int r;
+
+        f = fopen(path, "re");
+        if (!f)
+                return -errno;
+        r = read_input(f, &data, &size);
+        fclose(f);
+        if (r < 0)
+                return r;
+
+        start = now(CLOCK_MONOTONIC);
+        (void) LLVMFuzzerTestOneInput(data, size);
+        t = now(CLOCK_MONOTONIC) - start;
+        free(data);
+
+        printf("%s: " USEC_FMT " us\n", path, t);
+        n_inputs++;
+        if (t >= slowest) {
+                slowest = t;
+                free(slowest_path);
+                slowest_path = strdup(path);
+        }
+
+        return 0;
+}
+
+static int run_path(const char *path) {
+        struct dirent *de;
+        DIR *d;
+        int r = 0;
+
+        d = opendir(path);
+        if (!d)
+                return errno == ENOTDIR ? run_file(path) : -errno;
+
+        while ((de = readdir(d))) {
+                char *p;
+
+                if (de->d_name[0] == '.')
+                        continue;
+
+                if (asprintf(&p, "%s/%s", path, de->d_name) < 0) {
+                        r = -ENOMEM;
+                        break;
+                }
+                r = run_file(p);
+                free(p);
+                if (r < 0)
+                        break;
+        }
+
+        closedir(d);
+        return r;
+}
+
+int main(int argc, char **argv) {
+        uint8_t *data;
+        size_t size;
+        int i, r;
+
+        if (argc <= 1) {
+                assert_se(read_input(stdin, &data, &size) >= 0);
+                (void) LLVMFuzzerTestOneInput(data, size);
+                free(data);
+                return 0;
+        }
+
+        for (i = 1; i < argc; i++) {
+                r = run_path(argv[i]);
+                if (r < 0) {
+                        fprintf(stderr, "%s: %s\n", argv[i], strerror(-r));
+                        return 1;
+                }
+        }
+
+        if (slowest_path)
+                printf("%u inputs, slowest %s with " USEC_FMT " us\n",
+                       n_inputs, slowest_path, slowest);
+        free(slowest_path);
+
+        return 0;
+}
@@ -0,0 +1,33 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* Parse the input as duration, like window-duration= and blackout= */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+#include "parse-duration.h"
+
+#define assert_se assert
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+        usec_t start;
+        char *p;
+
+        if (size > FUZZ_INPUT_MAX)
+                return 0;
+
+        p = strndup((const char *) data, size);
+        assert_se(p);
+
+        start = now(CLOCK_MONOTONIC);
+        (void) parse_duration(p);
+        fuzz_check_budget("parse_duration", start, data, size);
+
+        free(p);
+
+        return 0;
+}
@@ -0,0 +1,48 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+/* Shared by the fuzzing harnesses. Besides crashes they look for inputs
+ * which are slow to process: an input taking longer than the budget
+ * aborts, so that libFuzzer and AFL keep it like any other crash. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "time-util.h"
+
+/* A spec or a duration is one line of a config file or one parameter
+ * of a method call, longer inputs only cost fuzzing time */
+#define FUZZ_INPUT_MAX 1024
+
+/* Time one input may take, FUZZ_BUDGET_MSEC overrides it */
+#define FUZZ_BUDGET_MSEC_DEFAULT 500
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static inline usec_t fuzz_budget(void) {
+        static usec_t budget = 0;
+        const char *e;
+
+        if (budget == 0) {
+                e = getenv("FUZZ_BUDGET_MSEC");
+                budget = (e && atoi(e) > 0 ? (usec_t) atoi(e) : FUZZ_BUDGET_MSEC_DEFAULT) * USEC_PER_MSEC;
+        }
+
+        return budget;
+}
+
+static inline void fuzz_check_budget(const char *what, usec_t start, const uint8_t *data, size_t size) {
+        usec_t t = now(CLOCK_MONOTONIC) - start;
+
+        if (t <= fuzz_budget())
+                return;
+
+        fprintf(stderr, "%s: input of %zu bytes took " USEC_FMT " ms, budget is " USEC_FMT " ms: \"%.*s\"\n",
+                what, size, t / USEC_PER_MSEC, fuzz_budget() / USEC_PER_MSEC, (int) size, (const char *) data);
+        abort();
+}
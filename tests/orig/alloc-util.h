@@ -0,0 +1,10 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include <stdlib.h>
+
+/* from basic/alloc-util.h */
+#define new0(t, n) ((t*) calloc((n), sizeof(t)))
@@ -0,0 +1,19 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include <errno.h>
+#include <stdio.h>
+
+/* from basic/fileio.c */
+static inline int fflush_and_check(FILE *f) {
+        errno = 0;
+        fflush(f);
+
+        if (ferror(f))
+                return errno ? -errno : -EIO;
+
+        return 0;
+}
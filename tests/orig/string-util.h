@@ -0,0 +1,45 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+
+/* from basic/string-util.h */
+#define strcaseeq(a,b) (strcasecmp((a),(b)) == 0)
+
+static inline bool isempty(const char *p) {
+        return !p || !p[0];
+}
+
+static inline const char *startswith_no_case(const char *s, const char *prefix) {
+        size_t l;
+
+        l = strlen(prefix);
+        if (strncasecmp(s, prefix, l) == 0)
+                return (const char*) s + l;
+
+        return NULL;
+}
+
+/* from basic/string-util.c */
+static inline const char *endswith_no_case(const char *s, const char *postfix) {
+        size_t sl, pl;
+
+        sl = strlen(s);
+        pl = strlen(postfix);
+
+        if (pl == 0)
+                return (const char*) s + sl;
+
+        if (sl < pl)
+                return NULL;
+
+        if (strcasecmp(s + sl - pl, postfix) != 0)
+                return NULL;
+
+        return (const char*) s + sl - pl;
+}
@@ -0,0 +1,21 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* The parts of systemd's basic/ which lib/calendarspec/orig needs, so
+   that the unmodified calendarspec.c can be built as the reference of
+   test-calendarspec-compile. */
+
+#pragma once
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "time-util.h"
+
+#define assert_se assert
@@ -0,0 +1,210 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* Differential test: the compiled evaluator has to return exactly the
+   same results as the mktime() based find_next(), and both the same as
+   the unmodified implementation in lib/calendarspec/orig wherever that
+   understands the spec. */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calendarspec.h"
+#include "calendarspec-orig.h"
+#include "time-util.h"
+
+#define assert_se assert
+
+static const char *const specs[] = {
+        "03:30",
+        "Mon *-02-29 03:30",
+        "Sat,Thu,Mon-Wed,Sat-Sun",
+        "Mon,Sun 12-*-* 2,1:23",
+        "Wed *-1",
+        "Wed-Sat,Tue 12-10-16 1:2:3",
+        "*-*-7 0:0:0",
+        "10-15",
+        "monday *-12-* 17:00",
+        "Mon,Fri *-*-3,1,2 *:30:45",
+        "12,14,13,12:20,10,30",
+        "mon,fri *-1/2-1,3 *:30:45",
+        "*-*-31 02:30",
+        "*-*-* 02:30",
+        "*-*-* 02,03:*:15",
+        "Sun *-03,10-25/1 01,02,03:00/20",
+        "*-*-* *:2/3",
+        "*:*:17",
+        "hourly",
+        "daily",
+        "weekly",
+        "monthly",
+        "quarterly",
+        "semi-annually",
+        "annually",
+        "2016-03-27 03:17:00",
+        "2020/4-*-* 04:00",
+        "2030-01-01",
+        "Fri *-*-13 13:13:13",
+        "*-02-28,29 23:59:59",
+        "*-*-* 00:00:00 UTC",
+};
+
+static const char *const zones[] = {
+        "UTC",
+        "CET",
+        "EET",
+        "Europe/Berlin",
+        "Europe/Dublin",
+        "America/New_York",
+        "America/Sao_Paulo",
+        "Australia/Lord_Howe",
+        "Asia/Kolkata",
+        "Africa/Casablanca",
+};
+
+/* UTC times of DST changes in Europe and North America */
+static const usec_t transitions[] = {
+        1806195600ULL * USEC_PER_SEC,      /* 2027-03-28 01:00 */
+        1824944400ULL * USEC_PER_SEC,      /* 2027-10-31 01:00 */
+        1805007600ULL * USEC_PER_SEC,      /* 2027-03-14 07:00 */
+        1825567200ULL * USEC_PER_SEC,      /* 2027-11-07 06:00 */
+};
+
+static unsigned long long seed = 0x2545F4914F6CDD1DULL;
+
+static usec_t random_usec(usec_t from, usec_t to) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+
+        return from + seed % (to - from);
+}
+
+static unsigned n_fast, n_total, n_orig;
+static unsigned n_window_fast, n_window_total;
+
+/* calendar_spec_window_contains() searches backwards on a compiled spec
+   and forwards otherwise, both have to agree */
+static void test_window(const char *input, CalendarSpec *legacy, CalendarSpec *compiled,
+                        usec_t usec, usec_t duration) {
+        usec_t sa = 0, ea = 0, sb = 0, eb = 0, p;
+        int ra, rb, rc;
+
+        ra = calendar_spec_window_contains(legacy, duration, usec, &sa, &ea);
+        rb = calendar_spec_window_contains(compiled, duration, usec, &sb, &eb);
+
+        if (ra != rb || (ra > 0 && (sa != sb || ea != eb))) {
+                char buf[FORMAT_TIMESTAMP_MAX];
+
+                printf("WINDOW MISMATCH TZ=%s \"%s\" at %s (" USEC_FMT "), duration " USEC_FMT ": ",
+                       getenv("TZ"), input, format_timestamp(buf, sizeof(buf), usec), usec, duration);
+                printf("forward %i/" USEC_FMT "-" USEC_FMT ", backward %i/" USEC_FMT "-" USEC_FMT "\n",
+                       ra, sa, ea, rb, sb, eb);
+                abort();
+        }
+
+        rc = calendar_compiled_prev_usec(compiled, usec, usec > duration ? usec - duration : 0, &p);
+        n_window_total++;
+        if (rc != -EAGAIN)
+                n_window_fast++;
+}
+
+static void test_spec(const char *input, usec_t from, usec_t to, unsigned n) {
+        CalendarSpec *legacy, *compiled;
+        OrigCalendarSpec *orig;
+        unsigned i;
+
+        assert_se(calendar_spec_from_string(input, &legacy) >= 0);
+        assert_se(calendar_spec_from_string(input, &compiled) >= 0);
+        assert_se(calendar_spec_compile(compiled) >= 0);
+        /* Newer syntax is only compared between the two paths above */
+        if (orig_calendar_spec_from_string(input, &orig) < 0)
+                orig = NULL;
+
+        for (i = 0; i < n; i++) {
+                usec_t after, a = 0, b = 0, c = 0, o = 0;
+                int ra, rb, rc, ro = 0;
+
+                after = random_usec(from, to);
+
+                ra = calendar_spec_next_usec(legacy, after, &a);
+                rb = calendar_spec_next_usec(compiled, after, &b);
+                rc = calendar_compiled_next_usec(compiled, after, &c);
+                if (orig)
+                        ro = orig_calendar_spec_next_usec(orig, after, &o);
+
+                if (ra != rb || (ra >= 0 && a != b) ||
+                    (rc != -EAGAIN && (rc != ra || (ra >= 0 && a != c))) ||
+                    (orig && (ro != ra || (ra >= 0 && a != o)))) {
+                        char buf[FORMAT_TIMESTAMP_MAX];
+
+                        printf("MISMATCH TZ=%s \"%s\" after %s (" USEC_FMT "): ",
+                               getenv("TZ"), input,
+                               format_timestamp(buf, sizeof(buf), after), after);
+                        printf("orig %i/" USEC_FMT ", legacy %i/" USEC_FMT ", next %i/" USEC_FMT ", compiled %i/" USEC_FMT "\n",
+                               ro, o, ra, a, rb, b, rc, c);
+                        abort();
+                }
+
+                n_total++;
+                if (orig)
+                        n_orig++;
+                if (rc != -EAGAIN)
+                        n_fast++;
+
+                /* The legacy side needs dozens of mktime() based
+                   searches per check, a sample is enough */
+                if (i % 8 != 0)
+                        continue;
+
+                test_window(input, legacy, compiled, after, USEC_PER_HOUR);
+                test_window(input, legacy, compiled, after, 3 * USEC_PER_DAY);
+                /* Right at the begin of a window */
+                if (ra >= 0)
+                        test_window(input, legacy, compiled, a + USEC_PER_SEC, USEC_PER_HOUR);
+        }
+
+        calendar_spec_free(legacy);
+        calendar_spec_free(compiled);
+        if (orig)
+                orig_calendar_spec_free(orig);
+}
+
+int main(void) {
+        usec_t n = now(CLOCK_REALTIME);
+        unsigned i, j, k;
+
+        for (i = 0; i < ELEMENTSOF(zones); i++) {
+                assert_se(setenv("TZ", zones[i], 1) >= 0);
+                tzset();
+
+                for (j = 0; j < ELEMENTSOF(specs); j++) {
+                        /* Around now, where the transition table is */
+                        test_spec(specs[j], n - USEC_PER_YEAR, n + 10 * USEC_PER_YEAR, 200);
+                        /* Far outside of it, falls back to find_next() */
+                        test_spec(specs[j], 0, 40 * USEC_PER_YEAR, 5);
+
+                        /* Close to DST changes */
+                        for (k = 0; k < ELEMENTSOF(transitions); k++)
+                                test_spec(specs[j], transitions[k] - 2 * USEC_PER_DAY,
+                                          transitions[k] + 2 * USEC_PER_DAY, 50);
+                }
+        }
+
+        printf("%u of %u lookups answered by the compiled evaluator\n", n_fast, n_total);
+        printf("%u of %u lookups checked against lib/calendarspec/orig\n", n_orig, n_total);
+        printf("%u of %u window checks answered by the backward search\n", n_window_fast, n_window_total);
+
+        /* DST changes are rare, nearly everything has to be decided
+           without falling back */
+        assert_se(n_fast * 10 >= n_total * 8);
+        assert_se(n_window_fast * 10 >= n_window_total * 8);
+        /* Most specs are known to the original as well */
+        assert_se(n_orig * 2 >= n_total);
+
+        return 0;
+}
@@ -0,0 +1,176 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+//SPDX-License-Identifier: LGPL-2.1-or-later
+
+/* Differential test: the TZif reader has to agree with localtime_r(),
+   and a spec naming a zone with the same spec in the local time zone,
+   except where the C library resolves a clock change differently. TZ
+   is only set for the reference side. */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calendarspec.h"
+#include "time-util.h"
+#include "tzfile.h"
+
+#define assert_se assert
+
+static const char *const zones[] = {
+        "UTC",
+        "CET",
+        "EST5EDT",
+        "Europe/Berlin",
+        "Europe/Dublin",
+        "Europe/Moscow",
+        "America/New_York",
+        "America/Sao_Paulo",
+        "America/St_Johns",
+        "Australia/Lord_Howe",
+        "Asia/Kolkata",
+        "Pacific/Chatham",
+        "Africa/Casablanca",
+};
+
+static const char *const specs[] = {
+        "03:30",
+        "*-*-* 02:30",
+        "Mon-Fri *-*-* 01:00",
+        "Sun *-03,10-25/1 01,02,03:00/20",
+        "*-*-31 23:59:59",
+        "weekly",
+        "quarterly",
+        "*:0/5",
+};
+
+static unsigned long long seed = 0x2545F4914F6CDD1DULL;
+
+static int64_t random_range(int64_t from, int64_t to) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+
+        return from + (int64_t) (seed % (uint64_t) (to - from));
+}
+
+static void test_offsets(const TzInfo *tz, const char *zone) {
+        /* 1902 to 2100, beyond the transitions in the files */
+        int64_t from = -2143000000LL, to = 4102444800LL;
+        unsigned i;
+
+        for (i = 0; i < 200000; i++) {
+                int64_t t = random_range(from, to);
+                time_t tt = (time_t) t;
+                struct tm tm, own;
+
+                assert_se(localtime_r(&tt, &tm));
+                assert_se(tz_localtime_r(tz, tt, &own));
+
+                if (tm.tm_gmtoff != own.tm_gmtoff || tm.tm_hour != own.tm_hour ||
+                    tm.tm_mday != own.tm_mday || tm.tm_wday != own.tm_wday) {
+                        printf("OFFSET MISMATCH %s at %lli: %li, own %li\n",
+                               zone, (long long) t, tm.tm_gmtoff, own.tm_gmtoff);
+                        abort();
+                }
+        }
+}
+
+/* Whether the offset stays the same from a day before from until a day
+   after to, sampled hourly as no zone changes it for less than that */
+static bool stable(const TzInfo *tz, usec_t from, usec_t to) {
+        int64_t t, end = (int64_t) (to / USEC_PER_SEC) + 24*60*60;
+        int32_t offset;
+
+        t = (int64_t) (from / USEC_PER_SEC) - 24*60*60;
+        offset = tz_info_offset(tz, t);
+        for (; t <= end; t += 60*60)
+                if (tz_info_offset(tz, t) != offset)
+                        return false;
+
+        return tz_info_offset(tz, end) == offset;
+}
+
+static void test_spec(const char *input, const TzInfo *tz, usec_t from, usec_t to,
+                      unsigned *n_compared) {
+        const char *zone = tz_info_name(tz);
+        CalendarSpec *local, *own, *compiled;
+        char *named;
+        unsigned i;
+
+        assert_se(asprintf(&named, "%s %s", input, zone) >= 0);
+        assert_se(calendar_spec_from_string(input, &local) >= 0);
+        assert_se(calendar_spec_from_string(named, &own) >= 0);
+        assert_se(calendar_spec_from_string(named, &compiled) >= 0);
+        /* " UTC" is the flag, not the zone */
+        assert_se(own->tz || own->utc);
+        assert_se(calendar_spec_compile(compiled) >= 0);
+
+        for (i = 0; i < 100; i++) {
+                usec_t after = (usec_t) random_range((int64_t) from, (int64_t) to);
+                usec_t a = 0, b = 0, c = 0;
+                int ra, rb, rc;
+
+                ra = calendar_spec_next_usec(local, after, &a);
+                rb = calendar_spec_next_usec(own, after, &b);
+                rc = calendar_spec_next_usec(compiled, after, &c);
+
+                /* Both evaluators of the zone never disagree */
+                if (rb != rc || (rb >= 0 && b != c)) {
+                        printf("COMPILED MISMATCH \"%s\" after " USEC_FMT ": %i/" USEC_FMT ", compiled %i/" USEC_FMT "\n",
+                               named, after, rb, b, rc, c);
+                        abort();
+                }
+
+                if (ra < 0 || rb < 0 || !stable(tz, after, a > b ? a : b))
+                        continue;
+
+                if (a != b) {
+                        printf("MISMATCH \"%s\" after " USEC_FMT ": local " USEC_FMT ", own " USEC_FMT "\n",
+                               named, after, a, b);
+                        abort();
+                }
+                (*n_compared)++;
+        }
+
+        calendar_spec_free(local);
+        calendar_spec_free(own);
+        calendar_spec_free(compiled);
+        free(named);
+}
+
+int main(void) {
+        usec_t n = now(CLOCK_REALTIME);
+        unsigned i, j, n_compared = 0;
+        TzInfo *tz;
+
+        for (i = 0; i < ELEMENTSOF(zones); i++) {
+                assert_se(tz_info_load(zones[i], &tz) >= 0);
+                assert_se(strcmp(tz_info_name(tz), zones[i]) == 0);
+
+                assert_se(setenv("TZ", zones[i], 1) >= 0);
+                tzset();
+
+                test_offsets(tz, zones[i]);
+
+                for (j = 0; j < ELEMENTSOF(specs); j++)
+                        test_spec(specs[j], tz, n - USEC_PER_YEAR, n + 10 * USEC_PER_YEAR,
+                                  &n_compared);
+
+                tz_info_free(tz);
+        }
+
+        printf("%u lookups compared with the local time zone\n", n_compared);
+        assert_se(n_compared > 0);
+
+        assert_se(tz_info_load("Europe/Nowhere", &tz) == -ENOENT);
+        assert_se(tz_info_load("../../etc/passwd", &tz) == -EINVAL);
+        assert_se(tz_info_load("/etc/localtime", &tz) == -EINVAL);
+        assert_se(tz_info_load("zone.tab", &tz) == -EINVAL);
+        assert_se(tz_info_from_data("x", (const uint8_t *) "TZif", 4, &tz) == -EINVAL);
+
+        return 0;
+}
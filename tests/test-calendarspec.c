@@ -104,6 +104,38 @@ static void test_next(const char *input, const char *new_tz, usec_t after, usec_
         tzset();
 }
 
+static void test_next_n(const char *input, usec_t after, size_t n, int expect) {
+        CalendarSpec *c, *compiled;
+        usec_t *list, *fast, u = after;
+        int i, r;
+
+        assert_se(calendar_spec_from_string(input, &c) >= 0);
+        assert_se(calendar_spec_from_string(input, &compiled) >= 0);
+        assert_se(calendar_spec_compile(compiled) >= 0);
+        list = calloc(n + 1, sizeof(usec_t));
+        fast = calloc(n + 1, sizeof(usec_t));
+        assert_se(list && fast);
+
+        r = calendar_spec_next_n_usec(c, after, n, list);
+        printf("\"%s\": %i of %zu\n", input, r, n);
+        assert_se(r == expect);
+
+        /* Same as calling calendar_spec_next_usec() repeatedly */
+        for (i = 0; i < r; i++) {
+                assert_se(calendar_spec_next_usec(c, u, &u) >= 0);
+                assert_se(list[i] == u);
+        }
+
+        /* The compiled evaluator walks the same list */
+        assert_se(calendar_spec_next_n_usec(compiled, after, n, fast) == r);
+        assert_se(memcmp(list, fast, r * sizeof(usec_t)) == 0);
+
+        calendar_spec_free(c);
+        calendar_spec_free(compiled);
+        free(list);
+        free(fast);
+}
+
 int main(void) {
         CalendarSpec *c;
 
@@ -112,7 +144,7 @@ int main(void) {
         test_one("Wed *-1", "Wed *-*-01 00:00:00");
         test_one("Wed-Wed,Wed *-1", "Wed *-*-01 00:00:00");
         test_one("Wed, 17:48", "Wed *-*-* 17:48:00");
-        test_one("Wed-Sat,Tue 12-10-15 1:2:3", "Tue-Sat 2012-10-15 01:02:03");
+        test_one("Wed-Sat,Tue 12-10-16 1:2:3", "Tue-Sat 2012-10-16 01:02:03");
         test_one("*-*-7 0:0:0", "*-*-07 00:00:00");
         test_one("10-15", "*-10-15 00:00:00");
         test_one("monday *-12-* 17:00", "Mon *-12-* 17:00:00");
@@ -137,6 +169,13 @@ int main(void) {
         test_one("annually", "*-01-01 00:00:00");
         test_one("*:2/3", "*-*-* *:02/3:00");
         test_one("2015-10-25 01:00:00 uTc", "2015-10-25 01:00:00 UTC");
+        test_one("Mon-Fri 03:30 Europe/Berlin", "Mon-Fri *-*-* 03:30:00 Europe/Berlin");
+        test_one("*-*-* 0/1:00", "*-*-* 00/1:00:00");
+        test_one("*-*-* 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23:00", "*-*-* *:00:00");
+        test_one("*-1/2,1/4,4-1", "*-01/2,04-01 00:00:00");
+        test_one("*:0/15,5/15", "*-*-* *:00/15,05/15:00");
+        test_one("*:7/3,4/8", "*-*-* *:04/3,12,20,36,44:00");
+        test_one("2020/4,17,2017,2018-*-* 04:00", "2017,2018,2020/4-*-* 04:00:00");
 
         test_next("2016-03-27 03:17:00", "", 12345, 1459048620000000);
         test_next("2016-03-27 03:17:00", "CET", 12345, 1459041420000000);
@@ -145,11 +184,46 @@ int main(void) {
         test_next("2016-03-27 03:17:00 UTC", "", 12345, 1459048620000000);
         test_next("2016-03-27 03:17:00 UTC", "CET", 12345, 1459048620000000);
         test_next("2016-03-27 03:17:00 UTC", "EET", 12345, 1459048620000000);
+        /* A zone of its own, independent of TZ */
+        test_next("*-*-* 03:30 Europe/Berlin", "America/New_York", 1798761600000000, 1798770600000000);
+        /* 02:30 is skipped when the clock moves forward, and the
+           earlier one is used when it moves back */
+        test_next("*-*-* 02:30 Europe/Berlin", "UTC", 1806148800000000, 1806280200000000);
+        test_next("*-*-* 02:30 Europe/Berlin", "", 1824897600000000, 1824942600000000);
+
+        test_next_n("*-*-* 03:30 UTC", 0, 100, 100);
+        test_next_n("Mon *-*-1,2,3,4,5,6,7 02:00", 1459048620000000, 12, 12);
+        test_next_n("2016-03-27 03:17:00 UTC", 12345, 5, 1);
+        test_next_n("2015-*-* 03:17:00 UTC", 1459048620000000, 5, 0);
+        test_next_n("*:0/15", 12345, 0, 0);
+        test_next_n("*-*-* 02:30 Europe/Berlin", 1806148800000000, 10, 10);
+        test_next_n("Sun *-03,10-25/1 01,02,03:00/20", 1459048620000000, 50, 50);
 
         assert_se(calendar_spec_from_string("test", &c) < 0);
         assert_se(calendar_spec_from_string("", &c) < 0);
         assert_se(calendar_spec_from_string("7", &c) < 0);
         assert_se(calendar_spec_from_string("121212:1:2", &c) < 0);
+        assert_se(calendar_spec_from_string("*-13-01", &c) < 0);
+        assert_se(calendar_spec_from_string("*-*-0", &c) < 0);
+        assert_se(calendar_spec_from_string("24:00", &c) < 0);
+        assert_se(calendar_spec_from_string("*:58/2", &c) < 0);
+        assert_se(calendar_spec_from_string("*:1/2147483647", &c) < 0);
+        assert_se(calendar_spec_from_string("2200-01-01", &c) < 0);
+        assert_se(calendar_spec_from_string("03:30 Europe/Nowhere", &c) < 0);
+
+        /* Well formed, but never matching */
+        assert_se(calendar_spec_from_string("*-02-30 03:00", &c) == -ERANGE);
+        assert_se(calendar_spec_from_string("*-04-31", &c) == -ERANGE);
+        assert_se(calendar_spec_from_string("Wed-Sat,Tue 12-10-15 1:2:3", &c) == -ERANGE);
+        assert_se(calendar_spec_from_string("Mon 2001/4-02-29", &c) == -ERANGE);
+        assert_se(calendar_spec_from_string("Mon 2000/100-02-29", &c) == -ERANGE);
+        assert_se(calendar_spec_from_string("Mon *-02-29", &c) >= 0);
+        calendar_spec_free(c);
+
+        /* Only at a time which the clock change skips, the search gives
+           up instead of running until mktime() fails */
+        test_next("Sun *-03-25/1 02:30 Europe/Berlin", "", 1798761600000000, (usec_t) -1);
+        assert_se(calendar_spec_from_string("03:30 ../../etc/localtime", &c) < 0);
 
         return 0;
 }
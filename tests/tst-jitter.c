@@ -0,0 +1,153 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "basics.h"
+
+#include "common.h"
+
+/* test that the offsets of a fleet are spread evenly over the
+   maintenance window and are stable for every machine */
+
+#define N_MACHINES 20000
+#define N_BUCKETS  90 /* one per slot */
+#define DURATION   (90 * 60 * USEC_PER_SEC)
+
+static uint64_t seed = UINT64_C(0x2545F4914F6CDD1D);
+
+/* A simulated /etc/machine-id, 32 lower case hex digits */
+static void
+random_machine_id(char buf[33])
+{
+  for (int i = 0; i < 32; i++)
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+      buf[i] = "0123456789abcdef"[seed % 16];
+    }
+  buf[32] = '\0';
+}
+
+/* Pearson's chi-squared test of the offsets against an uniform
+   distribution, with 89 degrees of freedom 160 is far out of what
+   a good distribution ever gets */
+static int
+check_distribution(RM_JitterMode mode, const char *name)
+{
+  unsigned buckets[N_BUCKETS] = {0};
+  double expected = (double) N_MACHINES / N_BUCKETS;
+  double chi2 = 0;
+
+  for (int i = 0; i < N_MACHINES; i++)
+    {
+      char id[33];
+      usec_t offset, again;
+      int r;
+
+      random_machine_id(id);
+
+      r = rm_jitter_offset(mode, id, DURATION, &offset);
+      if (r < 0)
+	{
+	  fprintf(stderr, "%s: rm_jitter_offset failed: %s\n", name, strerror(-r));
+	  return -1;
+	}
+      if (offset >= DURATION || offset % USEC_PER_SEC != 0)
+	{
+	  fprintf(stderr, "%s: invalid offset %" PRIu64 "\n", name, offset);
+	  return -1;
+	}
+      if (mode != RM_JITTER_RANDOM)
+	{
+	  r = rm_jitter_offset(mode, id, DURATION, &again);
+	  if (r < 0 || again != offset)
+	    {
+	      fprintf(stderr, "%s: offset of %s is not stable\n", name, id);
+	      return -1;
+	    }
+	}
+
+      buckets[offset * N_BUCKETS / DURATION]++;
+    }
+
+  for (int i = 0; i < N_BUCKETS; i++)
+    chi2 += (buckets[i] - expected) * (buckets[i] - expected) / expected;
+
+  printf("%s: chi2=%.1f\n", name, chi2);
+  if (chi2 > 160)
+    {
+      fprintf(stderr, "%s: offsets are not evenly distributed\n", name);
+      return -1;
+    }
+
+  return 0;
+}
+
+/* the members of a failure domain get disjoint parts of the window */
+static int
+check_domain(const char *domain, unsigned size)
+{
+  bool used[64] = {false};
+  usec_t offset, width;
+
+  for (unsigned i = 0; i < size; i++)
+    {
+      int r = rm_domain_slot(domain, size, i, NULL, DURATION, &offset, &width);
+      if (r < 0)
+	{
+	  fprintf(stderr, "%s/%u: rm_domain_slot failed: %s\n", domain, i, strerror(-r));
+	  return -1;
+	}
+      if (width != DURATION / size / USEC_PER_SEC * USEC_PER_SEC ||
+	  offset % width != 0 || offset + width > DURATION || used[offset / width])
+	{
+	  fprintf(stderr, "%s/%u: slot %" PRIu64 "+%" PRIu64 " overlaps\n",
+		  domain, i, offset, width);
+	  return -1;
+	}
+      used[offset / width] = true;
+    }
+
+  return 0;
+}
+
+int
+main(void)
+{
+  usec_t offset;
+  RM_JitterMode mode;
+
+  if (check_distribution(RM_JITTER_RANDOM, "random") < 0 ||
+      check_distribution(RM_JITTER_MACHINE_ID, "machine-id") < 0)
+    return 1;
+
+  if (check_domain("rack-1", 8) < 0 || check_domain("rack-2", 8) < 0 ||
+      check_domain(NULL, 3) < 0 || check_domain("az-eu-1c", 64) < 0)
+    return 1;
+
+  /* an index has to be smaller than the size */
+  usec_t width;
+  if (rm_domain_slot("rack-1", 4, 4, NULL, DURATION, &offset, &width) != -EINVAL)
+    {
+      fprintf(stderr, "index out of range was accepted\n");
+      return 1;
+    }
+
+  if (rm_jitter_offset(RM_JITTER_UNKNOWN, NULL, DURATION, &offset) != -EINVAL)
+    {
+      fprintf(stderr, "unknown mode was accepted\n");
+      return 1;
+    }
+
+  if (rm_string_to_jitter("machine-id", &mode) < 0 || mode != RM_JITTER_MACHINE_ID ||
+      rm_string_to_jitter("sometimes", &mode) != -EINVAL)
+    {
+      fprintf(stderr, "rm_string_to_jitter failed\n");
+      return 1;
+    }
+
+  return 0;
+}
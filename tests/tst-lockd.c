@@ -0,0 +1,199 @@
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <systemd/sd-varlink.h>
+
+#include "basics.h"
+
+#include "common.h"
+
+/* test the slots of rebootmgr-lockd, started on a temporary socket */
+
+static const char *lockd_path;
+static char socket_path[PATH_MAX];
+
+static pid_t
+start_lockd(const char *slots, const char *lease)
+{
+  pid_t pid;
+
+  unlink(socket_path);
+
+  pid = fork();
+  if (pid < 0)
+    {
+      fprintf(stderr, "fork failed: %m\n");
+      return -1;
+    }
+  if (pid == 0)
+    {
+      if (lease)
+	execl(lockd_path, lockd_path, "-s", socket_path, "-n", slots,
+	      "-l", lease, NULL);
+      else
+	execl(lockd_path, lockd_path, "-s", socket_path, "-n", slots, NULL);
+      fprintf(stderr, "exec of %s failed: %m\n", lockd_path);
+      _exit(127);
+    }
+
+  return pid;
+}
+
+static void
+stop_lockd(pid_t pid)
+{
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  unlink(socket_path);
+}
+
+/* Call Acquire or Release and return the boolean field of the reply */
+static int
+call(const char *method, const char *group, const char *holder,
+     const char *field)
+{
+  _cleanup_(sd_varlink_unrefp) sd_varlink *link = NULL;
+  sd_json_variant *result, *v;
+  const char *error_id = NULL;
+  int r;
+
+  /* lockd may still be starting */
+  for (int i = 0; i < 50; i++)
+    {
+      r = sd_varlink_connect_address(&link, socket_path);
+      if (r >= 0)
+	break;
+      usleep(100000);
+    }
+  if (r < 0)
+    {
+      fprintf(stderr, "Cannot connect to %s: %s\n", socket_path, strerror(-r));
+      return r;
+    }
+
+  r = sd_varlink_callbo(link, method, &result, &error_id,
+			SD_JSON_BUILD_PAIR_STRING("Group", group),
+			SD_JSON_BUILD_PAIR_STRING("Holder", holder));
+  if (r < 0 || (error_id && strlen(error_id) > 0))
+    {
+      fprintf(stderr, "%s(%s, %s) failed: %s\n", method, group, holder,
+	      r < 0 ? strerror(-r) : error_id);
+      return r < 0 ? r : -EIO;
+    }
+
+  v = sd_json_variant_by_key(result, field);
+  if (v == NULL || !sd_json_variant_is_boolean(v))
+    return -EBADMSG;
+
+  return sd_json_variant_boolean(v);
+}
+
+static int
+check(const char *method, const char *group, const char *holder, int expected)
+{
+  char m[128];
+  int r;
+
+  snprintf(m, sizeof(m), "org.openSUSE.rebootmgr.Lock.%s", method);
+  r = call(m, group, holder, strcmp(method, "Acquire") == 0 ? "Acquired" : "Released");
+  if (r != expected)
+    {
+      fprintf(stderr, "%s(%s, %s) returned %i, expected %i\n",
+	      method, group, holder, r, expected);
+      return -1;
+    }
+
+  return 0;
+}
+
+static int
+check_slots(void)
+{
+  pid_t pid;
+  int r = 0;
+
+  pid = start_lockd("2", NULL);
+  if (pid < 0)
+    return -1;
+
+  /* two slots per group, the third machine has to wait */
+  if (check("Acquire", "a", "host1", 1) < 0 ||
+      check("Acquire", "a", "host2", 1) < 0 ||
+      check("Acquire", "a", "host3", 0) < 0 ||
+      /* other groups have their own slots */
+      check("Acquire", "b", "host3", 1) < 0 ||
+      /* asking again keeps the slot without taking a second one */
+      check("Acquire", "a", "host1", 1) < 0 ||
+      check("Acquire", "a", "host3", 0) < 0 ||
+      /* release frees the slot for the next machine */
+      check("Release", "a", "host1", 1) < 0 ||
+      check("Acquire", "a", "host3", 1) < 0 ||
+      check("Acquire", "a", "host1", 0) < 0 ||
+      /* releasing a slot not owned does nothing */
+      check("Release", "a", "host1", 0) < 0 ||
+      check("Release", "c", "host1", 0) < 0)
+    r = -1;
+
+  stop_lockd(pid);
+  return r;
+}
+
+static int
+check_lease(void)
+{
+  pid_t pid;
+  int r = 0;
+
+  pid = start_lockd("1", "1s");
+  if (pid < 0)
+    return -1;
+
+  if (check("Acquire", "a", "host1", 1) < 0 ||
+      check("Acquire", "a", "host2", 0) < 0)
+    r = -1;
+
+  /* host1 never comes back, its slot gets free */
+  if (r == 0)
+    {
+      sleep(2);
+      if (check("Acquire", "a", "host2", 1) < 0 ||
+	  check("Release", "a", "host1", 0) < 0 ||
+	  check("Release", "a", "host2", 1) < 0)
+	r = -1;
+    }
+
+  stop_lockd(pid);
+  return r;
+}
+
+int
+main(int argc, char **argv)
+{
+  char tmpdir[] = "/tmp/tst-lockd.XXXXXX";
+  int r = 0;
+
+  if (argc != 2)
+    {
+      fprintf(stderr, "Usage: tst-lockd <path to rebootmgr-lockd>\n");
+      return 1;
+    }
+  lockd_path = argv[1];
+
+  if (mkdtemp(tmpdir) == NULL)
+    {
+      fprintf(stderr, "mkdtemp failed: %m\n");
+      return 1;
+    }
+  snprintf(socket_path, sizeof(socket_path), "%s/lockd.socket", tmpdir);
+
+  if (check_slots() < 0 || check_lease() < 0)
+    r = 1;
+
+  rmdir(tmpdir);
+  return r;
+}
@@ -0,0 +1,147 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "basics.h"
+
+#include "common.h"
+
+/* test reading PSI and loadavg from a fake procfs */
+
+#define TEST_ROOT "tests/tst-pressure.proc"
+
+static int
+write_file(const char *name, const char *content)
+{
+  char path[256];
+  FILE *fp;
+
+  snprintf(path, sizeof(path), "%s/%s", TEST_ROOT, name);
+  fp = fopen(path, "w");
+  if (fp == NULL)
+    {
+      fprintf(stderr, "fopen(%s) failed: %m\n", path);
+      return -1;
+    }
+  fputs(content, fp);
+  fclose(fp);
+
+  return 0;
+}
+
+static int
+check_centi(const char *str, int ret, unsigned expected)
+{
+  unsigned v = 0;
+  int r;
+
+  r = rm_parse_centi(str, &v);
+  if (r != ret || (r == 0 && v != expected))
+    {
+      fprintf(stderr, "rm_parse_centi(\"%s\") returned %i/%u, expected %i/%u\n",
+	      str, r, v, ret, expected);
+      return -1;
+    }
+
+  return 0;
+}
+
+static int
+check_read(unsigned pressure, unsigned load)
+{
+  unsigned p, l;
+  int r;
+
+  r = rm_pressure_read(TEST_ROOT, &p, &l);
+  if (r < 0)
+    {
+      fprintf(stderr, "rm_pressure_read failed: %s\n", strerror(-r));
+      return -1;
+    }
+  if (p != pressure || l != load)
+    {
+      fprintf(stderr, "rm_pressure_read returned %u/%u, expected %u/%u\n",
+	      p, l, pressure, load);
+      return -1;
+    }
+
+  return 0;
+}
+
+static void
+cleanup(void)
+{
+  unlink(TEST_ROOT "/pressure/cpu");
+  unlink(TEST_ROOT "/pressure/io");
+  unlink(TEST_ROOT "/pressure/memory");
+  unlink(TEST_ROOT "/loadavg");
+  rmdir(TEST_ROOT "/pressure");
+  rmdir(TEST_ROOT);
+}
+
+int
+main(void)
+{
+  unsigned p, l;
+
+  if (check_centi("0", 0, 0) < 0 ||
+      check_centi("40", 0, 4000) < 0 ||
+      check_centi("1.5", 0, 150) < 0 ||
+      check_centi("12.34", 0, 1234) < 0 ||
+      check_centi("0.52 0.58 0.59 1/467 12345\n", 0, 52) < 0 ||
+      check_centi("1.234", -EINVAL, 0) < 0 ||
+      check_centi(".5", -EINVAL, 0) < 0 ||
+      check_centi("-1", -EINVAL, 0) < 0 ||
+      check_centi("1,5", -EINVAL, 0) < 0 ||
+      check_centi("", -EINVAL, 0) < 0 ||
+      check_centi("99999999999", -ERANGE, 0) < 0)
+    return 1;
+
+  cleanup();
+  if (mkdir_p(TEST_ROOT "/pressure", 0755) < 0)
+    {
+      fprintf(stderr, "mkdir_p failed: %m\n");
+      return 1;
+    }
+
+  /* no loadavg is an error */
+  if (rm_pressure_read(TEST_ROOT, &p, &l) != -ENOENT)
+    {
+      fprintf(stderr, "rm_pressure_read without loadavg did not fail\n");
+      return 1;
+    }
+
+  /* kernel without PSI */
+  if (write_file("loadavg", "3.07 2.10 1.95 4/812 98765\n") < 0 ||
+      check_read(0, 307) < 0)
+    return 1;
+
+  /* the highest "some avg10" wins, "full" is ignored */
+  if (write_file("pressure/cpu",
+		 "some avg10=12.50 avg60=80.00 avg300=1.00 total=123456\n"
+		 "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n") < 0 ||
+      write_file("pressure/io",
+		 "some avg10=3.00 avg60=2.00 avg300=1.00 total=1\n"
+		 "full avg10=99.00 avg60=2.00 avg300=1.00 total=1\n") < 0 ||
+      write_file("pressure/memory",
+		 "some avg10=47.11 avg60=0.00 avg300=0.00 total=42\n"
+		 "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n") < 0 ||
+      check_read(4711, 307) < 0)
+    return 1;
+
+  /* broken files are reported */
+  if (write_file("pressure/io", "some avg10=garbage\n") < 0)
+    return 1;
+  if (rm_pressure_read(TEST_ROOT, &p, &l) != -EINVAL)
+    {
+      fprintf(stderr, "rm_pressure_read of invalid file did not fail\n");
+      return 1;
+    }
+
+  /* cleanup after us */
+  cleanup();
+
+  return 0;
+}
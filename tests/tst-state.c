@@ -0,0 +1,145 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "basics.h"
+
+#include "common.h"
+
+/* test that the reboot request survives save_state/load_state */
+
+#define TEST_FILE "tests/tst-state.state"
+
+static int
+check_state(RM_RebootStatus status, RM_RebootMethod method, usec_t reboot_time,
+	    bool forced, bool lock_held)
+{
+  RM_RebootStatus s;
+  RM_RebootMethod m;
+  usec_t t;
+  bool f, l;
+  int r;
+
+  r = save_state(TEST_FILE, status, method, reboot_time, forced, lock_held);
+  if (r < 0)
+    {
+      fprintf(stderr, "save_state failed: %s\n", strerror(-r));
+      return -1;
+    }
+
+  r = load_state(TEST_FILE, &s, &m, &t, &f, &l);
+  if (r < 0)
+    {
+      fprintf(stderr, "load_state failed: %s\n", strerror(-r));
+      return -1;
+    }
+
+  if (s != status || m != method || t != reboot_time || f != forced ||
+      l != lock_held)
+    {
+      fprintf(stderr, "load_state returned %i/%i/%llu/%i/%i, expected %i/%i/%llu/%i/%i\n",
+	      s, m, (unsigned long long) t, f, l,
+	      status, method, (unsigned long long) reboot_time, forced, lock_held);
+      return -1;
+    }
+
+  return 0;
+}
+
+static int
+write_file(const char *content)
+{
+  FILE *fp;
+
+  fp = fopen(TEST_FILE, "w");
+  if (fp == NULL)
+    {
+      fprintf(stderr, "fopen failed: %m\n");
+      return -1;
+    }
+  fputs(content, fp);
+  fclose(fp);
+
+  return 0;
+}
+
+int
+main(void)
+{
+  static const char *const invalid[] = {"1 7 1 0\n", "2 2 1 5 3\n",
+    "2 2 1 5\n", "1 2 1 5 1\n", "3 2 1 5 0\n", "3 2 1 5 0 2\n",
+    "2 2 1 5 0 1\n"};
+  RM_RebootStatus s;
+  RM_RebootMethod m;
+  usec_t t;
+  bool f, l;
+  int r;
+
+  unlink(TEST_FILE);
+
+  r = load_state(TEST_FILE, &s, &m, &t, &f, &l);
+  if (r != -ENOENT)
+    {
+      fprintf(stderr, "load_state of missing file returned %i\n", r);
+      return 1;
+    }
+
+  if (check_state(RM_REBOOTSTATUS_WAITING_WINDOW, RM_REBOOTMETHOD_SOFT,
+		  1790000000000000ULL, false, false) < 0)
+    return 1;
+  if (check_state(RM_REBOOTSTATUS_REQUESTED, RM_REBOOTMETHOD_KEXEC, 1, false, true) < 0)
+    return 1;
+  if (check_state(RM_REBOOTSTATUS_WAITING_WINDOW, RM_REBOOTMETHOD_HARD,
+		  1790000000000000ULL, true, true) < 0)
+    return 1;
+  /* overwrite the existing file */
+  if (check_state(RM_REBOOTSTATUS_NOT_REQUESTED, RM_REBOOTMETHOD_UNKNOWN, 0, false, false) < 0)
+    return 1;
+
+  /* no leftover of the temporary file */
+  if (access(TEST_FILE ".new", F_OK) == 0)
+    {
+      fprintf(stderr, "temporary file was not renamed\n");
+      return 1;
+    }
+
+  /* a file of version 1 has no forced field, and no lock field like
+     version 2, the lock may be held */
+  if (write_file("1 2 1 1790000000000000\n") < 0)
+    return 1;
+  r = load_state(TEST_FILE, &s, &m, &t, &f, &l);
+  if (r < 0 || s != RM_REBOOTSTATUS_WAITING_WINDOW || m != RM_REBOOTMETHOD_HARD ||
+      t != 1790000000000000ULL || f || !l)
+    {
+      fprintf(stderr, "load_state of version 1 file failed: %i\n", r);
+      return 1;
+    }
+  if (write_file("2 2 1 1790000000000000 1\n") < 0)
+    return 1;
+  r = load_state(TEST_FILE, &s, &m, &t, &f, &l);
+  if (r < 0 || !f || !l)
+    {
+      fprintf(stderr, "load_state of version 2 file failed: %i\n", r);
+      return 1;
+    }
+
+  /* garbage and unknown values are rejected */
+  for (size_t i = 0; i < ELEMENTSOF(invalid); i++)
+    {
+      if (write_file(invalid[i]) < 0)
+	return 1;
+      r = load_state(TEST_FILE, &s, &m, &t, &f, &l);
+      if (r != -EINVAL)
+	{
+	  fprintf(stderr, "load_state of '%s' returned %i\n", invalid[i], r);
+	  return 1;
+	}
+    }
+
+  /* cleanup after us */
+  unlink(TEST_FILE);
+
+  return 0;
+}
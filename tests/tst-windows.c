@@ -0,0 +1,504 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "basics.h"
+
+#include "common.h"
+
+/* test the parsing of window lists and blackouts and that the merged
+   index gives the same answers as asking every window on its own */
+
+#define N_CHECKS 5000
+#define BLACKOUT_FILE "tst-windows.blackout"
+
+static uint64_t seed = UINT64_C(0x2545F4914F6CDD1D);
+
+static usec_t
+random_usec(usec_t from, usec_t to)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+
+  return from + seed % (to - from);
+}
+
+static int
+check_parse(void)
+{
+  static const char *const invalid_starts[] = {"03:30;", "; 03:30", "03:30;;04:00", "foo", "*-02-30"};
+  static const char *const invalid_durations[] = {"", "1h;", "foo", "1h;bar"};
+  RM_Window *windows;
+  time_t *durations;
+  char *start_str, *duration_str;
+  size_t n, n_durations;
+  int r;
+
+  r = rm_windows_from_string(" Mon-Fri 02:00 ; Sat,Sun 00:00;*-*-01 01:00 ", &windows, &n);
+  if (r < 0 || n != 3)
+    {
+      fprintf(stderr, "Parsing a list of windows failed: %i, %zu\n", r, n);
+      return 1;
+    }
+
+  r = rm_durations_from_string("2h;6h", &durations, &n_durations);
+  if (r < 0 || n_durations != 2 ||
+      rm_windows_set_durations(windows, n, durations, n_durations) != -EINVAL)
+    {
+      fprintf(stderr, "Two durations for three windows accepted\n");
+      return 1;
+    }
+  free(durations);
+
+  r = rm_durations_from_string("2h; 6h; 3h", &durations, &n_durations);
+  if (r < 0 || rm_windows_set_durations(windows, n, durations, n_durations) < 0)
+    {
+      fprintf(stderr, "Setting durations failed\n");
+      return 1;
+    }
+  free(durations);
+
+  r = rm_windows_to_string(windows, n, &start_str, &duration_str);
+  if (r < 0 || strcmp(start_str, "Mon-Fri *-*-* 02:00:00; Sat,Sun *-*-* 00:00:00; *-*-01 01:00:00") != 0 ||
+      strcmp(duration_str, "02:00; 06:00; 03:00") != 0)
+    {
+      fprintf(stderr, "Converting windows to string failed: %i, '%s', '%s'\n",
+	      r, r < 0 ? "" : start_str, r < 0 ? "" : duration_str);
+      return 1;
+    }
+  free(start_str);
+  free(duration_str);
+
+  /* One duration for all */
+  r = rm_durations_from_string("1h30m", &durations, &n_durations);
+  if (r < 0 || rm_windows_set_durations(windows, n, durations, n_durations) < 0 ||
+      windows[2].duration != 5400)
+    {
+      fprintf(stderr, "Setting one duration for all windows failed\n");
+      return 1;
+    }
+  free(durations);
+
+  r = rm_windows_to_string(windows, n, &start_str, &duration_str);
+  if (r < 0 || strcmp(duration_str, "01:30") != 0)
+    {
+      fprintf(stderr, "Equal durations are not written once\n");
+      return 1;
+    }
+  free(start_str);
+  free(duration_str);
+  rm_windows_free(windows, n);
+
+  r = rm_windows_from_string("  ", &windows, &n);
+  if (r < 0 || n != 0 || windows != NULL)
+    {
+      fprintf(stderr, "An empty list is not empty\n");
+      return 1;
+    }
+
+  for (size_t i = 0; i < ELEMENTSOF(invalid_starts); i++)
+    if (rm_windows_from_string(invalid_starts[i], &windows, &n) >= 0)
+      {
+	fprintf(stderr, "Invalid window start '%s' accepted\n", invalid_starts[i]);
+	return 1;
+      }
+  for (size_t i = 0; i < ELEMENTSOF(invalid_durations); i++)
+    if (rm_durations_from_string(invalid_durations[i], &durations, &n_durations) >= 0)
+      {
+	fprintf(stderr, "Invalid duration '%s' accepted\n", invalid_durations[i]);
+	return 1;
+      }
+
+  return 0;
+}
+
+static int
+check_blackouts(void)
+{
+  static const char *const invalid[] = {"2026-12-26..2026-12-24", "2026-12-24..",
+    "2026-13-01", "foo", "2026-12-24 10", "2026-12-24;;2026-12-25"};
+  RM_Interval *blackouts;
+  size_t n;
+  FILE *fp;
+  int r;
+
+  fp = fopen(BLACKOUT_FILE, "w");
+  if (fp == NULL)
+    {
+      fprintf(stderr, "Cannot create " BLACKOUT_FILE ": %m\n");
+      return 1;
+    }
+  fputs("# Public holidays\n\n 2026-05-01 \n2026-12-25\n", fp);
+  fclose(fp);
+
+  r = rm_blackouts_from_string("2026-12-24..2026-12-26; 2026-03-31 18:00 .. 2026-04-01 06:00",
+			       BLACKOUT_FILE, &blackouts, &n);
+  unlink(BLACKOUT_FILE);
+  if (r < 0 || n != 3)
+    {
+      fprintf(stderr, "Parsing blackouts failed: %i, %zu\n", r, n);
+      return 1;
+    }
+
+  /* Sorted, and the holiday is merged with the christmas week */
+  if (blackouts[0].start != 1774980000 * USEC_PER_SEC ||
+      blackouts[0].end != 1775023200 * USEC_PER_SEC ||
+      blackouts[1].start != 1777593600 * USEC_PER_SEC ||
+      blackouts[1].end != 1777680000 * USEC_PER_SEC ||
+      blackouts[2].start != 1798070400 * USEC_PER_SEC ||
+      blackouts[2].end != 1798329600 * USEC_PER_SEC)
+    {
+      fprintf(stderr, "Wrong blackouts\n");
+      return 1;
+    }
+
+  if (rm_blackout_end(blackouts, n, 1777600000 * USEC_PER_SEC) != 1777680000 * USEC_PER_SEC ||
+      rm_blackout_end(blackouts, n, 1777680000 * USEC_PER_SEC) != 1777680000 * USEC_PER_SEC ||
+      rm_blackout_end(blackouts, n, 1798070400 * USEC_PER_SEC) != 1798329600 * USEC_PER_SEC ||
+      rm_blackout_end(blackouts, n, 1700000000 * USEC_PER_SEC) != 1700000000 * USEC_PER_SEC)
+    {
+      fprintf(stderr, "rm_blackout_end() failed\n");
+      return 1;
+    }
+  free(blackouts);
+
+  for (size_t i = 0; i < ELEMENTSOF(invalid); i++)
+    if (rm_blackouts_from_string(invalid[i], NULL, &blackouts, &n) >= 0)
+      {
+	fprintf(stderr, "Invalid blackout '%s' accepted\n", invalid[i]);
+	return 1;
+      }
+  if (rm_blackouts_from_string(NULL, BLACKOUT_FILE, &blackouts, &n) != -ENOENT)
+    {
+      fprintf(stderr, "Missing blackout file accepted\n");
+      return 1;
+    }
+
+  return 0;
+}
+
+/* Only reboots waiting for the window are deferred, and not beyond its
+   end. Forced and instant reboots are never deferred. */
+static int
+check_defer(void)
+{
+  /* 2027-01-01 03:30 UTC, inside of the window */
+  usec_t inside = 1798774200 * USEC_PER_SEC, end = 1798776000 * USEC_PER_SEC;
+  RM_CTX ctx = {};
+  int r;
+
+  r = rm_windows_from_string("03:00", &ctx.windows, &ctx.n_windows);
+  if (r < 0)
+    {
+      fprintf(stderr, "Parsing window failed: %s\n", strerror(-r));
+      return 1;
+    }
+
+  ctx.reboot_status = RM_REBOOTSTATUS_WAITING_WINDOW;
+  ctx.reboot_forced = true;
+  if (rm_defer_deadline(&ctx, inside) != 0)
+    {
+      fprintf(stderr, "A forced reboot was deferred\n");
+      return 1;
+    }
+
+  ctx.reboot_forced = false;
+  if (rm_defer_deadline(&ctx, inside) != end ||
+      rm_defer_deadline(&ctx, inside + USEC_PER_MINUTE) != end)
+    {
+      fprintf(stderr, "Wrong deadline in the window\n");
+      return 1;
+    }
+
+  ctx.defer_deadline = 0;
+  if (rm_defer_deadline(&ctx, end + USEC_PER_HOUR) != 0)
+    {
+      fprintf(stderr, "A reboot outside of the window was deferred\n");
+      return 1;
+    }
+
+  ctx.reboot_status = RM_REBOOTSTATUS_REQUESTED;
+  if (rm_defer_deadline(&ctx, inside) != 0)
+    {
+      fprintf(stderr, "A reboot not waiting for a window was deferred\n");
+      return 1;
+    }
+
+  /* Second of four members of a failure domain: 03:15 to 03:30 */
+  ctx.reboot_status = RM_REBOOTSTATUS_WAITING_WINDOW;
+  ctx.domain_size = 4;
+  ctx.domain_index = 1;
+  ctx.defer_deadline = 0;
+  if (rm_defer_deadline(&ctx, inside - 10 * USEC_PER_MINUTE) != inside)
+    {
+      fprintf(stderr, "Deadline is not the end of the slot\n");
+      return 1;
+    }
+  ctx.domain_index = 3;
+  ctx.defer_deadline = 0;
+  if (rm_defer_deadline(&ctx, inside) != end)
+    {
+      fprintf(stderr, "Deadline of the last slot is not the end of the window\n");
+      return 1;
+    }
+
+  rm_window_index_reset(&ctx.window_index);
+  rm_windows_free(ctx.windows, ctx.n_windows);
+
+  return 0;
+}
+
+/* Is usec inside of any of the windows, including their first
+   microsecond, and not in a blackout */
+static bool
+allowed(const RM_Window *windows, size_t n,
+	const RM_Interval *blackouts, size_t n_blackouts, usec_t usec)
+{
+  for (size_t i = 0; i < n_blackouts; i++)
+    if (blackouts[i].start <= usec && usec < blackouts[i].end)
+      return false;
+
+  for (size_t i = 0; i < n; i++)
+    {
+      usec_t start, end;
+
+      if (calendar_spec_window_contains(windows[i].start, windows[i].duration * USEC_PER_SEC,
+					usec, &start, &end) > 0)
+	return true;
+      if (calendar_spec_next_usec(windows[i].start, usec - 1, &start) >= 0 &&
+	  start == usec)
+	return true;
+    }
+
+  return false;
+}
+
+/* Next point in time after usec at which a window begins or a
+   blackout ends */
+static usec_t
+next_change(const RM_Window *windows, size_t n,
+	    const RM_Interval *blackouts, size_t n_blackouts, usec_t usec)
+{
+  usec_t next = USEC_INFINITY;
+
+  for (size_t i = 0; i < n; i++)
+    {
+      usec_t t;
+
+      if (calendar_spec_next_usec(windows[i].start, usec, &t) >= 0 && t < next)
+	next = t;
+    }
+  for (size_t i = 0; i < n_blackouts; i++)
+    if (blackouts[i].end > usec && blackouts[i].end < next)
+      next = blackouts[i].end;
+
+  return next;
+}
+
+static int
+check_find(RM_WindowIndex *idx, const RM_Window *windows, size_t n,
+	   const RM_Interval *blackouts, size_t n_blackouts, usec_t usec)
+{
+  usec_t start, end, next = usec;
+  int r;
+
+  r = rm_window_find(idx, windows, n, blackouts, n_blackouts, usec, &start, &end);
+  if (r < 0)
+    {
+      fprintf(stderr, "rm_window_find(%" PRIu64 ") failed: %s\n", usec, strerror(-r));
+      return 1;
+    }
+
+  if (allowed(windows, n, blackouts, n_blackouts, usec))
+    {
+      if (start > usec || end <= usec)
+	{
+	  fprintf(stderr, "%" PRIu64 " is inside, but not in %" PRIu64 "-%" PRIu64 "\n",
+		  usec, start, end);
+	  return 1;
+	}
+    }
+  else
+    {
+      do
+	next = next_change(windows, n, blackouts, n_blackouts, next);
+      while (next != USEC_INFINITY && !allowed(windows, n, blackouts, n_blackouts, next));
+
+      if (start != next)
+	{
+	  fprintf(stderr, "Next window after %" PRIu64 " is at %" PRIu64 ", not %" PRIu64 "\n",
+		  usec, next, start);
+	  return 1;
+	}
+    }
+
+  /* The merged window ends where no window is open anymore */
+  if (!allowed(windows, n, blackouts, n_blackouts, end - 1) ||
+      (end < idx->until && allowed(windows, n, blackouts, n_blackouts, end)))
+    {
+      fprintf(stderr, "Window %" PRIu64 "-%" PRIu64 " has a wrong end\n", start, end);
+      return 1;
+    }
+
+  return 0;
+}
+
+/* ListWindows: every window once, complete and in order, even where
+   the index has cut it or several of them overlap */
+static int
+check_list(const char *starts, const char *durations_str, size_t count)
+{
+  RM_Window *windows;
+  RM_Interval *list;
+  time_t *durations;
+  size_t n, n_durations, n_list;
+  usec_t after = 1767225600 * USEC_PER_SEC + 1; /* 2026-01-01 */
+  usec_t prev = after;
+
+  if (rm_windows_from_string(starts, &windows, &n) < 0 ||
+      rm_durations_from_string(durations_str, &durations, &n_durations) < 0 ||
+      rm_windows_set_durations(windows, n, durations, n_durations) < 0)
+    {
+      fprintf(stderr, "Cannot parse '%s'\n", starts);
+      return 1;
+    }
+  free(durations);
+
+  if (rm_windows_list(windows, n, NULL, 0, after, count, &list, &n_list) < 0 ||
+      n_list != count)
+    {
+      fprintf(stderr, "Listing %zu windows of '%s' failed\n", count, starts);
+      return 1;
+    }
+
+  for (size_t i = 0; i < n_list; i++)
+    {
+      usec_t next = prev;
+
+      /* The next point in time a window opens */
+      do
+	next = next_change(windows, n, NULL, 0, next);
+      while (next != USEC_INFINITY &&
+	     (!allowed(windows, n, NULL, 0, next) || allowed(windows, n, NULL, 0, next - 1)));
+
+      if (list[i].start != next || list[i].end <= list[i].start ||
+	  !allowed(windows, n, NULL, 0, list[i].end - 1) ||
+	  allowed(windows, n, NULL, 0, list[i].end))
+	{
+	  fprintf(stderr, "Window %zu of '%s' is %" PRIu64 "-%" PRIu64 ", expected start %" PRIu64 "\n",
+		  i, starts, list[i].start, list[i].end, next);
+	  return 1;
+	}
+      prev = list[i].end;
+    }
+
+  free(list);
+  rm_windows_free(windows, n);
+
+  return 0;
+}
+
+static int
+check_index(const char *starts, const char *durations_str, const char *blackout)
+{
+  RM_WindowIndex idx = {}, sequential = {};
+  RM_Window *windows;
+  RM_Interval *blackouts;
+  time_t *durations;
+  size_t n, n_durations, n_blackouts;
+  usec_t from = 1767225600 * USEC_PER_SEC; /* 2026-01-01 */
+  usec_t to = from + 366 * USEC_PER_DAY;
+  usec_t t = from;
+  int r;
+
+  if (rm_windows_from_string(starts, &windows, &n) < 0 ||
+      rm_durations_from_string(durations_str, &durations, &n_durations) < 0 ||
+      rm_windows_set_durations(windows, n, durations, n_durations) < 0 ||
+      rm_blackouts_from_string(blackout, NULL, &blackouts, &n_blackouts) < 0)
+    {
+      fprintf(stderr, "Cannot parse '%s'\n", starts);
+      return 1;
+    }
+  free(durations);
+
+  for (size_t i = 0; i < n; i++)
+    calendar_spec_compile(windows[i].start);
+
+  for (int i = 0; i < N_CHECKS; i++)
+    {
+      /* Random points in time rebuild the index nearly every time,
+	 a clock which only moves forward uses the same one */
+      r = check_find(&idx, windows, n, blackouts, n_blackouts, random_usec(from, to));
+      if (r == 0)
+	r = check_find(&sequential, windows, n, blackouts, n_blackouts, t);
+      if (r != 0)
+	{
+	  fprintf(stderr, "... with windows '%s' and blackouts '%s'\n", starts, blackout ? blackout : "");
+	  return 1;
+	}
+      t += random_usec(0, 2 * USEC_PER_HOUR);
+    }
+
+  rm_window_index_reset(&idx);
+  rm_window_index_reset(&sequential);
+  rm_windows_free(windows, n);
+  free(blackouts);
+
+  return 0;
+}
+
+int
+main(void)
+{
+  RM_WindowIndex idx = {};
+  usec_t start, end;
+
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  if (check_parse() != 0 || check_blackouts() != 0 || check_defer() != 0)
+    return 1;
+
+  if (rm_window_find(&idx, NULL, 0, NULL, 0, 0, &start, &end) != -ENOENT)
+    {
+      fprintf(stderr, "Found a window without windows\n");
+      return 1;
+    }
+
+  /* Overlapping and back to back windows are listed as one */
+  if (check_list("03:00; 03:30", "1h; 1h", 20) != 0 ||
+      check_list("03:00; 04:00; Sat 04:30", "1h; 1h; 12h", 20) != 0 ||
+      check_list("*:0/10; Sun 12:00", "5m; 4h", 500) != 0 ||
+      /* Open from Friday to Sunday, the index ends in the middle */
+      check_list("Fri,Sat *:0/10", "15m", 20) != 0)
+    return 1;
+
+  /* Overlapping windows */
+  if (check_index("Mon-Fri 02:00; Sat,Sun 00:00; *-*-01 01:00; 03:30", "2h; 6h; 3h; 1h", NULL) != 0)
+    return 1;
+  /* More occurrences than the index takes of one window */
+  if (check_index("*:0/5; Sun 12:00", "1m; 4h", NULL) != 0)
+    return 1;
+  /* Windows which are months apart */
+  if (check_index("quarterly; *-06-15 12:00", "24h", NULL) != 0)
+    return 1;
+  /* Blackouts longer than the index range, and one ending inside of
+     an open window */
+  if (check_index("Mon-Fri 02:00; Sat,Sun 00:00; *-*-01 01:00", "2h; 6h; 3h",
+		  "2026-03-01..2026-03-14; 2026-06-10 12:00..2026-06-20 03:00; "
+		  "2026-12-20..2027-01-06") != 0)
+    return 1;
+  if (check_index("quarterly", "480h", "2026-04-01 00:30..2026-04-11") != 0)
+    return 1;
+  /* A window in the DST gap */
+  setenv("TZ", "Europe/Berlin", 1);
+  tzset();
+  if (check_index("*-*-* 02:30; Sun 01:00", "30m; 3h", NULL) != 0)
+    return 1;
+
+  return 0;
+}